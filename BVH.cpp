@@ -0,0 +1,132 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <functional>
+
+static AABB merge(AABB const &a, AABB const &b) {
+	return AABB{ .min = glm::min(a.min, b.min), .max = glm::max(a.max, b.max) };
+}
+
+void BVH::build(std::vector< AABB > const &bounds) {
+	item_bounds = bounds;
+	items.resize(bounds.size());
+	item_leaf.assign(bounds.size(), 0);
+	nodes.clear();
+	node_dirty.clear();
+	dirty_nodes.clear();
+	if (bounds.empty()) return;
+
+	std::vector< glm::vec3 > centroids(bounds.size());
+	for (uint32_t i = 0; i < bounds.size(); ++i) {
+		items[i] = i;
+		centroids[i] = 0.5f * (bounds[i].min + bounds[i].max);
+	}
+	nodes.reserve(2 * (bounds.size() / LeafSize + 1));
+	build_node(0, 0, uint32_t(bounds.size()), centroids);
+	node_dirty.assign(nodes.size(), 0);
+}
+
+uint32_t BVH::build_node(uint32_t parent, uint32_t first, uint32_t count, std::vector< glm::vec3 > const &centroids) {
+	uint32_t index = uint32_t(nodes.size());
+	nodes.emplace_back(Node{ .parent = parent, .first = first, .count = count });
+
+	if (count <= LeafSize) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			item_leaf[items[i]] = index;
+		}
+		compute_bounds(index);
+		return index;
+	}
+
+	//split at the median centroid along the axis the centroids spread furthest on:
+	glm::vec3 lo = centroids[items[first]], hi = lo;
+	for (uint32_t i = first + 1; i < first + count; ++i) {
+		lo = glm::min(lo, centroids[items[i]]);
+		hi = glm::max(hi, centroids[items[i]]);
+	}
+	glm::vec3 spread = hi - lo;
+	int axis = (spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2));
+	uint32_t half = count / 2;
+	std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+		[&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+	build_node(index, first, half, centroids); //(lands at index + 1)
+	uint32_t second = build_node(index, first + half, count - half, centroids);
+	nodes[index].second = second;
+	compute_bounds(index);
+	return index;
+}
+
+void BVH::compute_bounds(uint32_t node) {
+	Node &n = nodes[node];
+	if (n.second != 0) {
+		n.bounds = merge(nodes[node + 1].bounds, nodes[n.second].bounds);
+	} else {
+		n.bounds = AABB();
+		for (uint32_t i = n.first; i < n.first + n.count; ++i) {
+			n.bounds = merge(n.bounds, item_bounds[items[i]]);
+		}
+	}
+}
+
+void BVH::update(uint32_t item, AABB const &bounds) {
+	item_bounds[item] = bounds;
+	uint32_t leaf = item_leaf[item];
+	if (!node_dirty[leaf]) {
+		node_dirty[leaf] = 1;
+		dirty_nodes.push_back(leaf);
+	}
+}
+
+void BVH::refit() {
+	if (dirty_nodes.empty()) return;
+
+	//flag every ancestor of a changed leaf (the list grows while it is walked; the root stops the climb):
+	for (size_t i = 0; i < dirty_nodes.size(); ++i) {
+		uint32_t parent = nodes[dirty_nodes[i]].parent;
+		if (!node_dirty[parent]) {
+			node_dirty[parent] = 1;
+			dirty_nodes.push_back(parent);
+		}
+	}
+
+	//children always come after their parent, so recomputing in descending order sees finished children:
+	std::sort(dirty_nodes.begin(), dirty_nodes.end(), std::greater< uint32_t >());
+	for (uint32_t node : dirty_nodes) {
+		compute_bounds(node);
+		node_dirty[node] = 0;
+	}
+	dirty_nodes.clear();
+}
+
+void BVH::cull(FrustumPlanes const &frustum, std::vector< uint32_t > &inside, std::vector< uint32_t > &intersecting) const {
+	inside.clear();
+	intersecting.clear();
+	if (nodes.empty()) return;
+
+	//median splits keep the depth near log2(items), so a small fixed stack is plenty:
+	uint32_t stack[64];
+	uint32_t stack_size = 0;
+	stack[stack_size++] = 0;
+	while (stack_size > 0) {
+		uint32_t index = stack[--stack_size];
+		Node const &node = nodes[index];
+		Containment containment = classify_aabb(frustum, node.bounds);
+		if (containment == Containment::Outside) continue;
+		if (containment == Containment::Inside) {
+			inside.insert(inside.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+			continue;
+		}
+		if (node.second != 0) {
+			stack[stack_size++] = node.second;
+			stack[stack_size++] = index + 1;
+			continue;
+		}
+		for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+			uint32_t item = items[i];
+			Containment item_containment = classify_aabb(frustum, item_bounds[item]);
+			if (item_containment == Containment::Inside) inside.push_back(item);
+			else if (item_containment == Containment::Intersecting) intersecting.push_back(item);
+		}
+	}
+}
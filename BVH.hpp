@@ -0,0 +1,49 @@
+#pragma once
+
+#include "frustum_culling.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ *  Bounding volume hierarchy over a set of boxes ("items", referred to by index) for frustum culling.
+ *
+ *  build() splits the items top-down at the median centroid along the widest axis, so the depth stays
+ *  around log2(items / LeafSize). When items move, update() their bounds and call refit(): only the nodes
+ *  above changed leaves are recomputed and the tree shape is kept (rebuild when the item set changes).
+ *  cull() skips subtrees outside the frustum and accepts subtrees entirely inside it without visiting
+ *  their items one by one.
+ */
+
+struct BVH {
+	static constexpr uint32_t LeafSize = 4; //most items per leaf
+
+	struct Node {
+		AABB bounds;
+		uint32_t parent = 0; //(the root is its own parent)
+		uint32_t second = 0; //index of the second child (the first child directly follows its parent); 0 for leaves
+		uint32_t first = 0, count = 0; //range of 'items' under this node
+	};
+	std::vector< Node > nodes; //depth-first order, so every subtree's items are contiguous in 'items'
+	std::vector< uint32_t > items; //item indices, grouped by leaf
+	std::vector< uint32_t > item_leaf; //item -> leaf node holding it
+	std::vector< AABB > item_bounds; //item -> bounds
+
+	void build(std::vector< AABB > const &bounds);
+	//change an item's bounds; the tree catches up at the next refit():
+	void update(uint32_t item, AABB const &bounds);
+	void refit();
+
+	//items whose bounds are entirely inside the frustum go to 'inside', items whose bounds cross its planes go to
+	// 'intersecting' (these still need an exact test); both lists are cleared first. Safe to call from several threads:
+	void cull(FrustumPlanes const &frustum, std::vector< uint32_t > &inside, std::vector< uint32_t > &intersecting) const;
+
+	size_t size() const { return item_bounds.size(); }
+
+private:
+	std::vector< uint8_t > node_dirty;
+	std::vector< uint32_t > dirty_nodes; //nodes with node_dirty set
+
+	uint32_t build_node(uint32_t parent, uint32_t first, uint32_t count, std::vector< glm::vec3 > const &centroids);
+	void compute_bounds(uint32_t node);
+};
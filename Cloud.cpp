@@ -5,7 +5,7 @@
 #include <iostream>
 
 namespace Cloud {
-    Helpers::AllocatedImage3D Cloud::load_noise(RTG &rtg) {
+    Helpers::AllocatedImage3D Cloud::load_noise(RTG &rtg, Helpers::UploadBatch &uploads) {
         std::vector<float*> images(noise_count);
         uint32_t width = 0, height = 0;
         for (uint16_t i = 0; i < noise_count; ++i) {
@@ -43,7 +43,7 @@ namespace Cloud {
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			Helpers::Unmapped
 		);
-        rtg.helpers.transfer_to_image_3D(merged_images.data(), merged_images.size() * sizeof(merged_images[0]), noise);
+        uploads.image_3D(merged_images.data(), merged_images.size() * sizeof(merged_images[0]), noise);
         
         for (float* image : images) {
             stbi_image_free(image);
@@ -51,7 +51,7 @@ namespace Cloud {
         return noise;
     }
 
-    NVDF load_cloud(RTG &rtg, std::string directory)
+    NVDF load_cloud(RTG &rtg, Helpers::UploadBatch &uploads, std::string directory)
     // assuming 64 layers, file names is either field_data.number.tga or modeling_data.number.tga
     {
         NVDF cloud_nvdf;
@@ -102,7 +102,7 @@ namespace Cloud {
                     Helpers::Unmapped
                 );
 
-                rtg.helpers.transfer_to_image_3D(merged_images.data(), merged_images.size() * sizeof(float), image_output);
+                uploads.image_3D(merged_images.data(), merged_images.size() * sizeof(float), image_output);
             } else {
                 std::vector<unsigned char> merged_images(total_image_size);
                 for (size_t i = 0; i < cloud_voxel_layers; ++i) {
@@ -118,7 +118,7 @@ namespace Cloud {
                     Helpers::Unmapped
                 );
 
-                rtg.helpers.transfer_to_image_3D(merged_images.data(), merged_images.size(), image_output);
+                uploads.image_3D(merged_images.data(), merged_images.size(), image_output);
             }
 
             for (void* image : images) {
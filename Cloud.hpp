@@ -16,7 +16,8 @@ namespace Cloud {
     static const std::string noise_path = data_path("../resource/NubisVoxelCloudsPack/Noise/Examples/TGA/NubisVoxelCloudNoise.");
     static constexpr uint16_t noise_count = 128;
     static constexpr uint16_t cloud_voxel_layers = 64;
-    Helpers::AllocatedImage3D load_noise(RTG &);
+    //NOTE: pixel data is queued on 'uploads'; the images are ready once the batch has been waited on
+    Helpers::AllocatedImage3D load_noise(RTG &, Helpers::UploadBatch &uploads);
     
-    NVDF load_cloud(RTG &, std::string directory);
+    NVDF load_cloud(RTG &, Helpers::UploadBatch &uploads, std::string directory);
 }
\ No newline at end of file
@@ -21,7 +21,7 @@ void RTGRenderer::CloudLightGirdPipeline::create(RTG &rtg) {
 			},
 			VkDescriptorSetLayoutBinding{
 				.binding = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
 			},
@@ -0,0 +1,87 @@
+#include "RTGRenderer.hpp"
+
+#include "Helpers.hpp"
+
+#include "VK.hpp"
+
+static uint32_t comp_code[] =
+#include "spv/cull.comp.inl"
+;
+
+void RTGRenderer::CullPipeline::create(RTG &rtg) {
+	VkShaderModule comp_module = rtg.helpers.create_shader_module(comp_code);
+
+	{//the set0_Cull layout holds the instance boxes and frustum planes (read), the draw commands and counts (written),
+	 // and the visibility buffer and depth pyramid for occlusion culling
+		std::array<VkDescriptorSetLayoutBinding, 7> bindings;
+		for (uint32_t b = 0; b < bindings.size(); ++b) {
+			bindings[b] = VkDescriptorSetLayoutBinding{
+				.binding = b,
+				.descriptorType = (b == 6 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+			};
+		}
+
+		VkDescriptorSetLayoutCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = uint32_t(bindings.size()),
+			.pBindings = bindings.data(),
+		};
+
+		VK(vkCreateDescriptorSetLayout(rtg.device, &create_info, nullptr, &set0_Cull));
+	}
+
+	{//create pipeline layout:
+		VkPushConstantRange range{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(Push),
+		};
+
+		VkPipelineLayoutCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &set0_Cull,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &range,
+		};
+		VK(vkCreatePipelineLayout(rtg.device, &create_info, nullptr, &layout));
+	}
+
+	{//create pipeline:
+		VkPipelineShaderStageCreateInfo shader_stage{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = comp_module,
+			.pName = "main",
+		};
+
+		VkComputePipelineCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			.stage = shader_stage,
+			.layout = layout,
+		};
+
+		VK(vkCreateComputePipelines(rtg.device, VK_NULL_HANDLE, 1, &create_info, nullptr, &handle));
+
+		vkDestroyShaderModule(rtg.device, comp_module, nullptr);
+	}
+}
+
+void RTGRenderer::CullPipeline::destroy(RTG &rtg) {
+	if (set0_Cull != VK_NULL_HANDLE) {
+		vkDestroyDescriptorSetLayout(rtg.device, set0_Cull, nullptr);
+		set0_Cull = VK_NULL_HANDLE;
+	}
+
+	if (layout != VK_NULL_HANDLE) {
+		vkDestroyPipelineLayout(rtg.device, layout, nullptr);
+		layout = VK_NULL_HANDLE;
+	}
+
+	if (handle != VK_NULL_HANDLE) {
+		vkDestroyPipeline(rtg.device, handle, nullptr);
+		handle = VK_NULL_HANDLE;
+	}
+}
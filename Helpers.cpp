@@ -5,9 +5,12 @@
 
 #include <vulkan/utility/vk_format_utils.h> //useful for byte counting
 #include <utility>
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
+#include <numeric>
+#include <string>
 
 Helpers::Allocation::Allocation(Allocation &&from) {
 	assert(handle == VK_NULL_HANDLE && offset == 0 && size == 0 && mapped == nullptr);
@@ -42,20 +45,70 @@ Helpers::Allocation::~Allocation() {
 
 Helpers::Allocation Helpers::allocate(VkDeviceSize size, VkDeviceSize alignment, uint32_t memory_type_index, MapFlag map) {
 	Helpers::Allocation allocation;
+	allocation.size = size;
 
-	VkMemoryAllocateInfo alloc_info{
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize = size,
-		.memoryTypeIndex = memory_type_index
-	};
+	//linear (buffer) and optimal (image) resources may share a block, so keep them bufferImageGranularity apart:
+	alignment = std::max(alignment, rtg.device_properties.limits.bufferImageGranularity);
 
-	VK(vkAllocateMemory(rtg.device, &alloc_info, nullptr, &allocation.handle));
+	VkDeviceSize block_size = memory_block_size(memory_type_index);
+	if (size > block_size / 2) { //big enough to get its own memory:
+		VkMemoryAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = size,
+			.memoryTypeIndex = memory_type_index
+		};
+		VK(vkAllocateMemory(rtg.device, &alloc_info, nullptr, &allocation.handle));
+		dedicated_allocations.emplace(allocation.handle, memory_type_index);
 
-	allocation.size = size;
-	allocation.offset = 0;
+		allocation.offset = 0;
+		if (map == Mapped) {
+			VK(vkMapMemory(rtg.device, allocation.handle, 0, allocation.size, 0, &allocation.mapped));
+		}
+		return allocation;
+	}
+
+	std::vector< std::unique_ptr< MemoryBlock > > &pool = memory_pools.at(memory_type_index);
+
+	//first block with room wins (TLSF makes each attempt O(1)):
+	MemoryBlock *block = nullptr;
+	std::optional< uint64_t > offset;
+	for (std::unique_ptr< MemoryBlock > &candidate : pool) {
+		offset = candidate->placement.allocate(size, alignment);
+		if (offset) {
+			block = candidate.get();
+			break;
+		}
+	}
 
+	if (!block) { //every block is full, so make a new one:
+		std::unique_ptr< MemoryBlock > new_block = std::make_unique< MemoryBlock >();
+		new_block->memory_type_index = memory_type_index;
+		new_block->placement = TLSF(block_size);
+
+		VkMemoryAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = block_size,
+			.memoryTypeIndex = memory_type_index
+		};
+		VK(vkAllocateMemory(rtg.device, &alloc_info, nullptr, &new_block->handle));
+
+		if (memory_properties.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			VK(vkMapMemory(rtg.device, new_block->handle, 0, VK_WHOLE_SIZE, 0, &new_block->mapped));
+		}
+
+		offset = new_block->placement.allocate(size, alignment);
+		assert(offset); //size <= block_size / 2, so it always fits in an empty block
+
+		block = new_block.get();
+		memory_blocks.emplace(block->handle, block);
+		pool.emplace_back(std::move(new_block));
+	}
+
+	allocation.handle = block->handle;
+	allocation.offset = *offset;
 	if (map == Mapped) {
-		VK(vkMapMemory(rtg.device, allocation.handle, 0, allocation.size, 0, &allocation.mapped));
+		assert(block->mapped); //should have asked for a host-visible memory type
+		allocation.mapped = block->mapped;
 	}
 
 	return allocation;
@@ -66,18 +119,69 @@ Helpers::Allocation Helpers::allocate(VkMemoryRequirements const &req, VkMemoryP
 }
 
 void Helpers::free(Helpers::Allocation &&allocation) {
-	if (allocation.mapped != nullptr) {
-		vkUnmapMemory(rtg.device, allocation.handle);
-		allocation.mapped = nullptr;
+	if (allocation.handle == VK_NULL_HANDLE) return;
+
+	if (auto f = memory_blocks.find(allocation.handle); f != memory_blocks.end()) {
+		MemoryBlock *block = f->second;
+		block->placement.free(allocation.offset);
+
+		//give empty blocks back to the driver, but keep one per memory type around for the next allocation:
+		std::vector< std::unique_ptr< MemoryBlock > > &pool = memory_pools[block->memory_type_index];
+		if (block->placement.empty() && pool.size() > 1) {
+			if (block->mapped) vkUnmapMemory(rtg.device, block->handle);
+			vkFreeMemory(rtg.device, block->handle, nullptr);
+			memory_blocks.erase(f);
+			pool.erase(std::find_if(pool.begin(), pool.end(), [block](std::unique_ptr< MemoryBlock > const &b) { return b.get() == block; }));
+		}
+	} else {
+		//dedicated allocation:
+		if (allocation.mapped != nullptr) {
+			vkUnmapMemory(rtg.device, allocation.handle);
+		}
+		vkFreeMemory(rtg.device, allocation.handle, nullptr);
+		dedicated_allocations.erase(allocation.handle);
 	}
 
-	vkFreeMemory(rtg.device, allocation.handle, nullptr);
-
 	allocation.handle = VK_NULL_HANDLE;
 	allocation.offset = 0;
 	allocation.size = 0;
+	allocation.mapped = nullptr;
+}
+
+VkDeviceSize Helpers::memory_block_size(uint32_t memory_type_index) const {
+	//256MiB blocks, or an eighth of the heap for small heaps (e.g. the 256MiB host-visible device-local heap):
+	VkDeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[memory_type_index].heapIndex].size;
+	return std::min< VkDeviceSize >(256 * 1024 * 1024, heap_size / 8);
 }
 
+void Helpers::dump_memory_stats() const {
+	std::cout << "Device memory: " << (memory_blocks.size() + dedicated_allocations.size()) << " allocations of "
+	          << rtg.device_properties.limits.maxMemoryAllocationCount << " allowed.\n";
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+		VkDeviceSize reserved = 0, used = 0, free_bytes = 0, largest_free = 0;
+		uint32_t allocations = 0, free_ranges = 0;
+		for (std::unique_ptr< MemoryBlock > const &block : memory_pools[i]) {
+			reserved += block->placement.size();
+			used += block->placement.used();
+			allocations += block->placement.allocation_count();
+			free_bytes += block->placement.size() - block->placement.used();
+			largest_free = std::max(largest_free, block->placement.largest_free());
+			free_ranges += block->placement.free_range_count();
+		}
+		uint32_t dedicated = 0;
+		for (auto const &[handle, type] : dedicated_allocations) {
+			if (type == i) dedicated += 1;
+		}
+		if (memory_pools[i].empty() && dedicated == 0) continue;
+
+		//fragmentation: how much of the free space is unusable for a single allocation of the total free size
+		double fragmentation = (free_bytes ? 1.0 - double(largest_free) / double(free_bytes) : 0.0);
+		std::cout << " [" << i << "] " << memory_pools[i].size() << " block(s), " << used << " / " << reserved << " bytes used by "
+		          << allocations << " allocation(s); " << free_ranges << " free range(s), largest " << largest_free
+		          << " (fragmentation " << int(fragmentation * 100.0 + 0.5) << "%); " << dedicated << " dedicated allocation(s)\n";
+	}
+	std::cout.flush();
+}
 
 //----------------------------
 
@@ -796,6 +900,372 @@ VkDeviceSize Helpers::get_cube_buffer_offset(uint32_t base_width, uint32_t base_
     return VkDeviceSize(mip_offset + cur_mip_face_offset);
 }
 
+//----------------------------
+
+Helpers::UploadBatch::UploadBatch(Helpers &helpers_) : helpers(helpers_) {
+	VkCommandBufferAllocateInfo alloc_info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = helpers.transfer_command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1,
+	};
+	VK(vkAllocateCommandBuffers(helpers.rtg.device, &alloc_info, &command_buffer));
+
+	VkFenceCreateInfo fence_info{
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = 0, //unsignaled; submit() signals it
+	};
+	VK(vkCreateFence(helpers.rtg.device, &fence_info, nullptr, &fence));
+}
+
+Helpers::UploadBatch::~UploadBatch() {
+	if (submitted) {
+		//(not using VK macro to avoid throw-ing in destructor)
+		std::cerr << "UploadBatch destroyed without wait(); waiting now." << std::endl;
+		vkWaitForFences(helpers.rtg.device, 1, &fence, VK_TRUE, UINT64_MAX);
+	}
+	for (AllocatedBuffer &block : arena) {
+		helpers.destroy_buffer(std::move(block));
+	}
+	arena.clear();
+	if (timestamps != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(helpers.rtg.device, timestamps, nullptr);
+		timestamps = VK_NULL_HANDLE;
+	}
+	if (fence != VK_NULL_HANDLE) {
+		vkDestroyFence(helpers.rtg.device, fence, nullptr);
+		fence = VK_NULL_HANDLE;
+	}
+	if (command_buffer != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(helpers.rtg.device, helpers.transfer_command_pool, 1, &command_buffer);
+		command_buffer = VK_NULL_HANDLE;
+	}
+}
+
+std::pair< VkBuffer, VkDeviceSize > Helpers::UploadBatch::stage(void const *data, size_t size, VkDeviceSize alignment) {
+	assert(!submitted); //can't add to a batch that's in flight
+	VkDeviceSize offset = (arena.empty() ? 0 : helpers.align_buffer_size(size_t(arena_used), size_t(alignment)));
+	if (arena.empty() || offset + size > arena.back().size) {
+		//start a new block (big enough for this upload, even if it is larger than the usual block size):
+		arena.emplace_back(helpers.create_buffer(
+			std::max(ArenaBlockSize, VkDeviceSize(size)),
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			Mapped
+		));
+		offset = 0;
+	}
+	std::memcpy(reinterpret_cast< char * >(arena.back().allocation.data()) + offset, data, size);
+	arena_used = offset + size;
+	staged_bytes += size;
+	return std::make_pair(arena.back().handle, offset);
+}
+
+void Helpers::UploadBatch::buffer(void const *data, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset) {
+	assert(target.handle); //target buffer should be allocated already
+	assert(target_offset + size <= target.size);
+	if (size == 0) return;
+
+	auto [src, src_offset] = stage(data, size, 16);
+	buffer_copies.emplace_back(BufferCopy{
+		.src = src,
+		.dst = target.handle,
+		.region{
+			.srcOffset = src_offset,
+			.dstOffset = target_offset,
+			.size = size,
+		},
+	});
+}
+
+void Helpers::UploadBatch::image(void const *data, size_t size, AllocatedImage &target, std::string label) {
+	assert(target.handle); //target image should be allocated already
+	//check data is the right size:
+	size_t bytes_per_pixel = vkuFormatElementSize(target.format);
+	assert(size == target.extent.width * target.extent.height * bytes_per_pixel);
+
+	//buffer offsets for image copies must be a multiple of both the texel size and 4:
+	auto [src, src_offset] = stage(data, size, std::lcm(VkDeviceSize(4), VkDeviceSize(bytes_per_pixel)));
+	ImageCopy &copy = image_copies.emplace_back(ImageCopy{
+		.src = src,
+		.dst = target.handle,
+		.range{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+		.dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		.bytes = size,
+		.label = std::move(label),
+	});
+	copy.regions.emplace_back(VkBufferImageCopy{
+		.bufferOffset = src_offset,
+		.bufferRowLength = target.extent.width,
+		.bufferImageHeight = target.extent.height,
+		.imageSubresource{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.mipLevel = 0,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+		.imageOffset{ .x = 0, .y = 0, .z = 0 },
+		.imageExtent{
+			.width = target.extent.width,
+			.height = target.extent.height,
+			.depth = 1
+		},
+	});
+}
+
+void Helpers::UploadBatch::image_3D(void const *data, size_t size, AllocatedImage3D &target) {
+	assert(target.handle); //target image should be allocated already
+	//check data is the right size:
+	size_t bytes_per_pixel = vkuFormatElementSize(target.format);
+	assert(size == target.extent.width * target.extent.height * target.extent.depth * bytes_per_pixel);
+
+	auto [src, src_offset] = stage(data, size, std::lcm(VkDeviceSize(4), VkDeviceSize(bytes_per_pixel)));
+	ImageCopy &copy = image_copies.emplace_back(ImageCopy{
+		.src = src,
+		.dst = target.handle,
+		.range{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+		.dst_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //volumes are read by the cloud compute passes
+		.bytes = size,
+	});
+	copy.regions.emplace_back(VkBufferImageCopy{
+		.bufferOffset = src_offset,
+		.bufferRowLength = target.extent.width,
+		.bufferImageHeight = target.extent.height,
+		.imageSubresource{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.mipLevel = 0,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+		.imageOffset{ .x = 0, .y = 0, .z = 0 },
+		.imageExtent = target.extent,
+	});
+}
+
+void Helpers::UploadBatch::image_cube(void const *data, size_t size, AllocatedImage &target, uint8_t mip_levels) {
+	assert(target.handle); //target image should be allocated already
+	size_t bytes_per_pixel = vkuFormatElementSize(target.format);
+	assert(size == helpers.get_cube_buffer_offset(target.extent.width, target.extent.height, 0, mip_levels, bytes_per_pixel));
+
+	auto [src, src_offset] = stage(data, size, std::lcm(VkDeviceSize(4), VkDeviceSize(bytes_per_pixel)));
+	ImageCopy &copy = image_copies.emplace_back(ImageCopy{
+		.src = src,
+		.dst = target.handle,
+		.range{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.baseMipLevel = 0,
+			.levelCount = mip_levels,
+			.baseArrayLayer = 0,
+			.layerCount = 6,
+		},
+		.dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		.bytes = size,
+	});
+	copy.regions.reserve(6 * mip_levels);
+	for (uint32_t face = 0; face < 6; ++face) {
+		for (uint32_t level = 0; level < mip_levels; ++level) {
+			copy.regions.emplace_back(VkBufferImageCopy{
+				.bufferOffset = src_offset + helpers.get_cube_buffer_offset(target.extent.width, target.extent.height, face, level, bytes_per_pixel),
+				.bufferRowLength = target.extent.width >> level,
+				.bufferImageHeight = target.extent.height >> level,
+				.imageSubresource{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = level,
+					.baseArrayLayer = face,
+					.layerCount = 1,
+				},
+				.imageOffset{ .x = 0, .y = 0, .z = 0 },
+				.imageExtent{
+					.width = target.extent.width >> level,
+					.height = target.extent.height >> level,
+					.depth = 1
+				},
+			});
+		}
+	}
+}
+
+void Helpers::UploadBatch::submit() {
+	assert(!submitted);
+	if (buffer_copies.empty() && image_copies.empty()) return; //nothing to do; wait() will return immediately
+
+	VK(vkResetCommandBuffer(command_buffer, 0));
+
+	VkCommandBufferBeginInfo begin_info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	VK(vkBeginCommandBuffer(command_buffer, &begin_info));
+
+	//(--debug) time the copies on the GPU, if the queue can write timestamps:
+	uint32_t timestamp_count = 2 + uint32_t(image_copies.size());
+	if (helpers.rtg.configuration.debug) {
+		uint32_t count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(helpers.rtg.physical_device, &count, nullptr);
+		std::vector< VkQueueFamilyProperties > queue_families(count);
+		vkGetPhysicalDeviceQueueFamilyProperties(helpers.rtg.physical_device, &count, queue_families.data());
+		if (queue_families[helpers.rtg.graphics_queue_family.value()].timestampValidBits != 0) {
+			VkQueryPoolCreateInfo create_info{
+				.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				.queryType = VK_QUERY_TYPE_TIMESTAMP,
+				.queryCount = timestamp_count,
+			};
+			VK(vkCreateQueryPool(helpers.rtg.device, &create_info, nullptr, &timestamps));
+			vkCmdResetQueryPool(command_buffer, timestamps, 0, timestamp_count);
+		}
+	}
+
+	//every barrier for the batch goes in a single call before and a single call after the copies:
+	std::vector< VkImageMemoryBarrier > barriers;
+	barriers.reserve(image_copies.size());
+
+	{ //put all receiving images in destination-optimal layout
+		for (ImageCopy const &copy : image_copies) {
+			barriers.emplace_back(VkImageMemoryBarrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = 0,
+				.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED, //throw away old image
+				.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = copy.dst,
+				.subresourceRange = copy.range,
+			});
+		}
+		if (!barriers.empty()) {
+			vkCmdPipelineBarrier(
+				command_buffer, //commandBuffer
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, //srcStageMask
+				VK_PIPELINE_STAGE_TRANSFER_BIT, //dstStageMask
+				0, //dependencyFlags
+				0, nullptr, //memory barrier count, pointer
+				0, nullptr, //buffer memory barrier count, pointer
+				uint32_t(barriers.size()), barriers.data() //image memory barrier count, pointer
+			);
+		}
+	}
+
+	{ //copies
+		//(a timestamp is written once every earlier command has finished its transfers)
+		if (timestamps) vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, timestamps, 0);
+		for (BufferCopy const &copy : buffer_copies) {
+			vkCmdCopyBuffer(command_buffer, copy.src, copy.dst, 1, &copy.region);
+		}
+		if (timestamps) vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, timestamps, 1);
+		for (ImageCopy const &copy : image_copies) {
+			vkCmdCopyBufferToImage(
+				command_buffer,
+				copy.src,
+				copy.dst,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				uint32_t(copy.regions.size()), copy.regions.data()
+			);
+			if (timestamps) vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, timestamps, 2 + uint32_t(&copy - image_copies.data()));
+		}
+	}
+
+	{ //transition images to shader-read-only-optimal layout and make buffer writes visible:
+		VkPipelineStageFlags dst_stages = 0;
+		barriers.clear();
+		for (ImageCopy const &copy : image_copies) {
+			barriers.emplace_back(VkImageMemoryBarrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = copy.dst,
+				.subresourceRange = copy.range,
+			});
+			dst_stages |= copy.dst_stage;
+		}
+
+		VkMemoryBarrier buffer_barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+		};
+		if (!buffer_copies.empty()) {
+			dst_stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		}
+
+		vkCmdPipelineBarrier(
+			command_buffer, //commandBuffer
+			VK_PIPELINE_STAGE_TRANSFER_BIT, //srcStageMask
+			dst_stages, //dstStageMask
+			0, //dependencyFlags
+			(buffer_copies.empty() ? 0 : 1), &buffer_barrier, //memory barrier count, pointer
+			0, nullptr, //buffer memory barrier count, pointer
+			uint32_t(barriers.size()), barriers.data() //image memory barrier count, pointer
+		);
+	}
+
+	VK(vkEndCommandBuffer(command_buffer));
+
+	VkSubmitInfo submit_info{
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &command_buffer,
+	};
+	VK(vkQueueSubmit(helpers.rtg.graphics_queue, 1, &submit_info, fence));
+	submitted = true;
+}
+
+void Helpers::UploadBatch::wait() {
+	if (submitted) {
+		VK(vkWaitForFences(helpers.rtg.device, 1, &fence, VK_TRUE, UINT64_MAX));
+		submitted = false;
+	}
+
+	if (helpers.rtg.configuration.debug && (!buffer_copies.empty() || !image_copies.empty())) {
+		std::cout << "Upload batch: " << buffer_copies.size() << " buffers, " << image_copies.size() << " images, "
+		          << staged_bytes << " bytes staged in " << arena.size() << " block(s)." << std::endl;
+		if (timestamps != VK_NULL_HANDLE) {
+			std::vector< uint64_t > ticks(2 + image_copies.size());
+			VK(vkGetQueryPoolResults(helpers.rtg.device, timestamps, 0, uint32_t(ticks.size()), sizeof(uint64_t) * ticks.size(), ticks.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+			auto ms = [&](uint32_t from, uint32_t to) {
+				return double(ticks[to] - ticks[from]) * double(helpers.rtg.device_properties.limits.timestampPeriod) * 1e-6;
+			};
+			//(copies may overlap on the GPU, so an image's time runs from the previous copy finishing to its own finishing)
+			std::cout << "  GPU copy time: " << ms(0, uint32_t(ticks.size()) - 1) << " ms in all, buffers " << ms(0, 1) << " ms." << std::endl;
+			for (uint32_t i = 0; i < image_copies.size(); ++i) {
+				ImageCopy const &copy = image_copies[i];
+				std::cout << "  " << (copy.label.empty() ? "image " + std::to_string(i) : copy.label) << ": "
+				          << copy.bytes << " bytes, " << ms(1 + i, 2 + i) << " ms." << std::endl;
+			}
+		}
+	}
+	if (timestamps != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(helpers.rtg.device, timestamps, nullptr);
+		timestamps = VK_NULL_HANDLE;
+	}
+
+	//staging memory is no longer needed:
+	for (AllocatedBuffer &block : arena) {
+		helpers.destroy_buffer(std::move(block));
+	}
+	arena.clear();
+	arena_used = 0;
+	staged_bytes = 0;
+	buffer_copies.clear();
+	image_copies.clear();
+}
+
 void Helpers::gpu_image_transfer_to_buffer(AllocatedBuffer &target, AllocatedImage &image, 
 	VkSemaphore image_available, VkSemaphore image_done, VkFence workspace_available, uint8_t workspace_index)
 {
@@ -883,6 +1353,64 @@ void Helpers::gpu_image_transfer_to_buffer(AllocatedBuffer &target, AllocatedIma
 
 //----------------------------
 
+Helpers::StreamBuffer Helpers::create_stream_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkDeviceSize alignment) {
+	StreamBuffer stream;
+	stream.usage = usage;
+	stream.alignment = std::max< VkDeviceSize >(alignment, 1);
+	size = stream.padded(size);
+
+	//prefer memory the GPU reads at full speed but the CPU can still write directly (resizable BAR / UMA):
+	constexpr VkMemoryPropertyFlags Preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	bool has_preferred = false;
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
+		if ((memory_properties.memoryTypes[i].propertyFlags & Preferred) == Preferred) has_preferred = true;
+	}
+	stream.buffer = create_buffer(
+		size,
+		usage,
+		has_preferred ? Preferred : (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+		Mapped
+	);
+	return stream;
+}
+
+bool Helpers::reserve_stream_buffer(StreamBuffer &stream, VkDeviceSize size) {
+	assert(stream.head == 0); //can't move blocks that have already been handed out
+	if (stream.buffer.handle != VK_NULL_HANDLE && size <= stream.buffer.size) return false;
+
+	//grow geometrically so that slowly-growing per-frame data doesn't re-allocate (and rewrite descriptors) every frame:
+	VkDeviceSize new_size = std::max(size, stream.buffer.size * 2);
+	VkBufferUsageFlags usage = stream.usage;
+	VkDeviceSize alignment = stream.alignment;
+	if (stream.buffer.handle != VK_NULL_HANDLE) {
+		destroy_buffer(std::move(stream.buffer));
+	}
+	stream = create_stream_buffer(new_size, usage, alignment);
+	return true;
+}
+
+void Helpers::destroy_stream_buffer(StreamBuffer &&stream) {
+	if (stream.buffer.handle != VK_NULL_HANDLE) {
+		destroy_buffer(std::move(stream.buffer));
+	}
+	stream.head = 0;
+}
+
+VkDeviceSize Helpers::StreamBuffer::allocate(VkDeviceSize size) {
+	VkDeviceSize offset = padded(head);
+	if (offset + size > buffer.size) {
+		throw std::runtime_error("StreamBuffer overflow: " + std::to_string(offset + size) + " bytes needed of " + std::to_string(buffer.size) + " (missing reserve_stream_buffer?).");
+	}
+	head = offset + size;
+	return offset;
+}
+
+VkDeviceSize Helpers::StreamBuffer::push(void const *src, VkDeviceSize size) {
+	VkDeviceSize offset = allocate(size);
+	std::memcpy(data(offset), src, size);
+	return offset;
+}
+
 uint32_t Helpers::find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags flags) const {
 	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
 		VkMemoryType const &type = memory_properties.memoryTypes[i];
@@ -977,6 +1505,7 @@ void Helpers::create() {
 	};
 	VK(vkAllocateCommandBuffers(rtg.device, &alloc_info, transfer_command_buffers.data()));
 	vkGetPhysicalDeviceMemoryProperties(rtg.physical_device, &memory_properties);
+	memory_pools.resize(memory_properties.memoryTypeCount);
 	if (rtg.configuration.debug) {
 		std::cout << "Memory types:\n";
 		for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i) {
@@ -1006,4 +1535,20 @@ void Helpers::destroy() {
 		vkDestroyCommandPool(rtg.device, transfer_command_pool, nullptr);
 		transfer_command_pool = VK_NULL_HANDLE;
 	}
+
+	//release memory blocks (everything allocated from them should have been freed by now):
+	for (std::vector< std::unique_ptr< MemoryBlock > > &pool : memory_pools) {
+		for (std::unique_ptr< MemoryBlock > &block : pool) {
+			if (!block->placement.empty()) {
+				std::cerr << "Freeing a memory block with " << block->placement.allocation_count() << " allocation(s) still in it." << std::endl;
+			}
+			if (block->mapped) vkUnmapMemory(rtg.device, block->handle);
+			vkFreeMemory(rtg.device, block->handle, nullptr);
+		}
+	}
+	memory_pools.clear();
+	memory_blocks.clear();
+	if (!dedicated_allocations.empty()) {
+		std::cerr << dedicated_allocations.size() << " dedicated allocation(s) were never freed." << std::endl;
+	}
 }
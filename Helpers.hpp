@@ -1,7 +1,13 @@
 #pragma once
 
+#include "TLSF.hpp"
+
 #include <vulkan/vulkan_core.h>
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 struct RTG;
@@ -16,7 +22,7 @@ struct Helpers {
 		VkDeviceMemory handle = VK_NULL_HANDLE;
 		VkDeviceSize offset = 0; //offset of the allocated object inside the memory
 		VkDeviceSize size = 0; //size of the allocated object inside the memory (might be *larger* than the internal size of the object!)
-		void *mapped = nullptr;
+		void *mapped = nullptr; //mapping of the whole of 'handle' (shared with other allocations in the same block)
 		void *data() const { return reinterpret_cast< char * >(mapped) + offset; } //get pointer to beginning of allocation, taking offset into account
 
 		//Call an all-zero (no handle, offset, size, mapped) Allocation "empty":
@@ -40,6 +46,23 @@ struct Helpers {
 	//free an allocated block:
 	void free(Allocation &&allocation);
 
+	//Allocations are placed inside large per-memory-type blocks (TLSF placement, see TLSF.hpp), so many objects
+	// share one VkDeviceMemory at real offsets. Host-visible blocks stay mapped for their whole lifetime.
+	// Requests bigger than half a block get a dedicated VkDeviceMemory of their own.
+	struct MemoryBlock {
+		VkDeviceMemory handle = VK_NULL_HANDLE;
+		uint32_t memory_type_index = 0;
+		void *mapped = nullptr; //persistent mapping (host-visible memory types only)
+		TLSF placement;
+	};
+	std::vector< std::vector< std::unique_ptr< MemoryBlock > > > memory_pools; //[memory type index] -> blocks
+	std::unordered_map< VkDeviceMemory, MemoryBlock * > memory_blocks; //block lookup for free()
+	std::unordered_map< VkDeviceMemory, uint32_t > dedicated_allocations; //dedicated memory -> memory type index
+	VkDeviceSize memory_block_size(uint32_t memory_type_index) const;
+
+	//print reserved/used bytes and fragmentation for every memory type in use:
+	void dump_memory_stats() const;
+
 	//specializations that also create a buffer or image (respectively):
 	struct AllocatedBuffer {
 		VkBuffer handle = VK_NULL_HANDLE;
@@ -74,7 +97,7 @@ struct Helpers {
 	//-----------------------
 	//CPU -> GPU data transfer:
 
-	// NOTE: synchronizes *hard* against the GPU; inefficient to use for streaming data!
+	// NOTE: synchronizes *hard* against the GPU; inefficient to use for streaming data! (see UploadBatch below for bulk loads)
 	void transfer_to_buffer(void *data, size_t size, AllocatedBuffer &target);
 	void transfer_to_image(void *data, size_t size, AllocatedImage &image); //NOTE: image layout after call is VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 	void transfer_to_image_3D(void *data, size_t size, AllocatedImage3D &image); //NOTE: image layout after call is VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
@@ -86,7 +109,90 @@ struct Helpers {
 
 	VkCommandPool transfer_command_pool = VK_NULL_HANDLE;
 	std::vector<VkCommandBuffer> transfer_command_buffers;
-	
+
+	//Batched CPU -> GPU transfer: queued uploads are copied into a shared host-visible staging arena and
+	// recorded into one command buffer at submit(); wait() blocks on a single fence for the whole batch.
+	//Usage: UploadBatch batch(helpers); batch.image(...); batch.buffer(...); ... batch.submit(); (other work) batch.wait();
+	// NOTE: source data is copied when queued, so callers may free it immediately.
+	// NOTE: image layout after wait() is VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL (same as transfer_to_image*).
+	// NOTE: with --debug, the copies are timed with GPU timestamps and wait() lists each image's copy time ('label' names it).
+	struct UploadBatch {
+		UploadBatch(Helpers &helpers);
+		UploadBatch(UploadBatch const &) = delete;
+		~UploadBatch(); //waits for a submitted batch if wait() wasn't called
+
+		void buffer(void const *data, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset = 0);
+		void image(void const *data, size_t size, AllocatedImage &target, std::string label = {});
+		void image_3D(void const *data, size_t size, AllocatedImage3D &target);
+		void image_cube(void const *data, size_t size, AllocatedImage &target, uint8_t mip_levels = 1);
+
+		void submit(); //record and submit everything queued; doesn't block
+		void wait(); //block until the submitted copies are done, then free the staging arena
+
+		Helpers &helpers;
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		VkFence fence = VK_NULL_HANDLE;
+		bool submitted = false;
+		//(--debug) timestamps written before the copies, after the buffer copies, and after each image copy; created
+		// by submit() when the queue supports timestamps, destroyed by wait():
+		VkQueryPool timestamps = VK_NULL_HANDLE;
+
+		//staging arena: blocks of at least ArenaBlockSize bytes, filled front to back:
+		static constexpr VkDeviceSize ArenaBlockSize = 64 * 1024 * 1024;
+		std::vector< AllocatedBuffer > arena;
+		VkDeviceSize arena_used = 0; //bytes used in arena.back()
+		size_t staged_bytes = 0;
+
+		struct BufferCopy {
+			VkBuffer src = VK_NULL_HANDLE;
+			VkBuffer dst = VK_NULL_HANDLE;
+			VkBufferCopy region{};
+		};
+		std::vector< BufferCopy > buffer_copies;
+
+		struct ImageCopy {
+			VkBuffer src = VK_NULL_HANDLE;
+			VkImage dst = VK_NULL_HANDLE;
+			VkImageSubresourceRange range{};
+			VkPipelineStageFlags dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT; //first stage that samples the image
+			std::vector< VkBufferImageCopy > regions;
+			size_t bytes = 0; //staged for this image
+			std::string label; //(--debug) names the image in wait()'s copy times
+		};
+		std::vector< ImageCopy > image_copies;
+
+		//copy 'size' bytes into the arena at an offset that is a multiple of 'alignment'; returns the buffer and offset:
+		std::pair< VkBuffer, VkDeviceSize > stage(void const *data, size_t size, VkDeviceSize alignment);
+	};
+
+	//-----------------------
+	//Per-frame streaming:
+
+	//A persistently mapped buffer that one workspace fills from the front every frame: rewind() once the workspace's
+	// fence has signalled, then push() each block of per-frame data and bind it at the returned offset (as a dynamic
+	// descriptor offset or a vertex buffer offset). Workspaces take turns, so together their buffers act as a ring.
+	// Uses host-visible device-local memory when the device has it, so shaders read the data without a staging copy.
+	struct StreamBuffer {
+		AllocatedBuffer buffer;
+		VkBufferUsageFlags usage = 0;
+		VkDeviceSize alignment = 1; //every block starts at a multiple of this
+		VkDeviceSize head = 0; //bytes handed out since rewind()
+
+		void rewind() { head = 0; }
+		//space a block of 'size' bytes takes up, including padding to the next block:
+		VkDeviceSize padded(VkDeviceSize size) const { return (size + alignment - 1) / alignment * alignment; }
+		//reserve 'size' bytes at the next aligned offset and return that offset (write through data(offset)):
+		VkDeviceSize allocate(VkDeviceSize size);
+		//allocate() and copy 'size' bytes from 'src':
+		VkDeviceSize push(void const *src, VkDeviceSize size);
+		void *data(VkDeviceSize offset) const { return reinterpret_cast< char * >(buffer.allocation.data()) + offset; }
+	};
+	StreamBuffer create_stream_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkDeviceSize alignment);
+	//make room for 'size' bytes (call right after rewind()); returns true if the buffer was replaced, in which case
+	// descriptors that reference it must be rewritten:
+	bool reserve_stream_buffer(StreamBuffer &stream, VkDeviceSize size);
+	void destroy_stream_buffer(StreamBuffer &&stream);
+
 	//-----------------------
 	//Misc utilities:
 
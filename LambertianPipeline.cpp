@@ -8,21 +8,27 @@ static uint32_t vert_code[] =
 #include "spv/lambertian.vert.inl"
 ;
 
+static uint32_t vert_packed_code[] = 
+#include "spv/lambertian.packed.vert.inl"
+;
+
 static uint32_t frag_code[] = 
 #include "spv/lambertian.frag.inl"
 ;
 
 void RTGRenderer::LambertianPipeline::create(RTG &rtg, VkRenderPass render_pass, uint32_t subpass) {
-    VkShaderModule vert_module = rtg.helpers.create_shader_module(vert_code);
+    bool packed = (rtg.configuration.vertex_format == 1); //(PosNorTanTexPackedVertex inputs)
+    VkShaderModule vert_module = (packed ? rtg.helpers.create_shader_module(vert_packed_code) : rtg.helpers.create_shader_module(vert_code));
     VkShaderModule frag_module = rtg.helpers.create_shader_module(frag_code);
 
-    {//the set0_World layout holds world info in a uniform buffer used in the fragment shader and the environment cubemap and IBL BRDF LUT:
-		std::array<VkDescriptorSetLayoutBinding, 7> bindings{
+    {//the set0_World layout holds world info in a uniform buffer used in the fragment shader and the environment cubemap and IBL BRDF LUT
+	 // (World, the sphere and spot lights, and the light cluster lists are also used by the light cluster compute pass):
+		std::array<VkDescriptorSetLayoutBinding, 8> bindings{
 			VkDescriptorSetLayoutBinding{
 				.binding = 0,
-				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
 				.descriptorCount = 1,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT
 			},
             VkDescriptorSetLayoutBinding{
 				.binding = 1,
@@ -38,21 +44,21 @@ void RTGRenderer::LambertianPipeline::create(RTG &rtg, VkRenderPass render_pass,
 			},
             VkDescriptorSetLayoutBinding{// sun light
 				.binding = 3,
-				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
 			},
             VkDescriptorSetLayoutBinding{// sphere light
 				.binding = 4,
-				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
 				.descriptorCount = 1,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT
 			},
             VkDescriptorSetLayoutBinding{ // spot light
 				.binding = 5,
-				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
 				.descriptorCount = 1,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT
 			},
             VkDescriptorSetLayoutBinding{ // shadow atlas
 				.binding = 6,
@@ -60,6 +66,12 @@ void RTGRenderer::LambertianPipeline::create(RTG &rtg, VkRenderPass render_pass,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
 			},
+            VkDescriptorSetLayoutBinding{ // light cluster lists
+				.binding = 7,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT
+			},
 		};
 		
 		VkDescriptorSetLayoutCreateInfo create_info{
@@ -75,7 +87,7 @@ void RTGRenderer::LambertianPipeline::create(RTG &rtg, VkRenderPass render_pass,
 		std::array<VkDescriptorSetLayoutBinding, 1> bindings{
 			VkDescriptorSetLayoutBinding{
 				.binding = 0,
-				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT
 			},
@@ -228,7 +240,7 @@ void RTGRenderer::LambertianPipeline::create(RTG &rtg, VkRenderPass render_pass,
             .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
             .stageCount = uint32_t(stages.size()),
             .pStages = stages.data(),
-            .pVertexInputState = &Vertex::array_input_state,
+            .pVertexInputState = (packed ? &PackedVertex::array_input_state : &Vertex::array_input_state),
             .pInputAssemblyState = &input_assembly_state,
             .pViewportState = &viewport_state,
             .pRasterizationState = &rasterization_state,
@@ -0,0 +1,61 @@
+#include "RTGRenderer.hpp"
+
+#include "Helpers.hpp"
+
+#include "VK.hpp"
+
+static uint32_t comp_code[] =
+#include "spv/light_clusters.comp.inl"
+;
+
+void RTGRenderer::LightClusterPipeline::create(RTG &rtg, VkDescriptorSetLayout set0_World) {
+	VkShaderModule comp_module = rtg.helpers.create_shader_module(comp_code);
+
+	{//create pipeline layout (set 0 belongs to the objects pipelines, so the World set can be bound as-is):
+		VkPushConstantRange range{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(Push),
+		};
+
+		VkPipelineLayoutCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = 1,
+			.pSetLayouts = &set0_World,
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &range,
+		};
+		VK(vkCreatePipelineLayout(rtg.device, &create_info, nullptr, &layout));
+	}
+
+	{//create pipeline:
+		VkPipelineShaderStageCreateInfo shader_stage{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = comp_module,
+			.pName = "main",
+		};
+
+		VkComputePipelineCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			.stage = shader_stage,
+			.layout = layout,
+		};
+
+		VK(vkCreateComputePipelines(rtg.device, VK_NULL_HANDLE, 1, &create_info, nullptr, &handle));
+
+		vkDestroyShaderModule(rtg.device, comp_module, nullptr);
+	}
+}
+
+void RTGRenderer::LightClusterPipeline::destroy(RTG &rtg) {
+	if (layout != VK_NULL_HANDLE) {
+		vkDestroyPipelineLayout(rtg.device, layout, nullptr);
+		layout = VK_NULL_HANDLE;
+	}
+
+	if (handle != VK_NULL_HANDLE) {
+		vkDestroyPipeline(rtg.device, handle, nullptr);
+		handle = VK_NULL_HANDLE;
+	}
+}
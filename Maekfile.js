@@ -32,18 +32,38 @@ const main_objs = [
 	maek.CPP('RTG.cpp'),
 	maek.CPP('Helpers.cpp'),
 	maek.CPP('data_path.cpp'),
+	maek.CPP('TLSF.cpp'),
 ];
 
 const viewer_objs = [
 	maek.CPP('main.cpp'),
 	maek.CPP('PosColVertex.cpp'),
 	maek.CPP('PosNorTanTexVertex.cpp'),
+	maek.CPP('PosNorTanTexPackedVertex.cpp'),
 	maek.CPP('PosNorTexVertex.cpp'),
-	maek.CPP('ShadowAtlas.cpp'),
 	maek.CPP('Cloud.cpp'),
 	maek.CPP('scene.cpp'),
+	maek.CPP('scene_cache.cpp'),
 	maek.CPP('frustum_culling.cpp'),
+	maek.CPP('BVH.cpp'),
+	maek.CPP('mesh_indexing.cpp'),
+]
+
+//json parsing (shared with the benchmarks):
+const sejp_objs = [
 	maek.CPP('sejp.cpp'),
+	maek.CPP('mapped_file.cpp'),
+]
+
+//CPU light binning and the thread pool it runs on (shared with the benchmarks):
+const light_binning_objs = [
+	maek.CPP('light_binning.cpp'),
+	maek.CPP('ThreadPool.cpp'),
+]
+
+//shadow atlas region allocation (shared with the benchmarks):
+const shadow_atlas_objs = [
+	maek.CPP('ShadowAtlas.cpp'),
 ]
 
 const common_objs = [
@@ -80,13 +100,15 @@ main_objs.push( maek.CPP('Tutorial-LinesPipeline.cpp', undefined, { depends:[...
 // build lambertian shaders and pipeline:
 const lambertian_shaders = [
 	maek.GLSLC('glsl/lambertian.vert', 'spv/lambertian.vert', {GLSLCFlags: []}),
-	maek.GLSLC('glsl/lambertian.frag', 'spv/lambertian.frag', {GLSLCFlags: [], depends:["glsl/light.glsl"]}),
+	maek.GLSLC('glsl/lambertian.vert', 'spv/lambertian.packed.vert', {GLSLCFlags: ['-DPACKED_VERTEX'], depends:["glsl/packed_vertex.glsl"]}),
+	maek.GLSLC('glsl/lambertian.frag', 'spv/lambertian.frag', {GLSLCFlags: [], depends:["glsl/light.glsl", "glsl/clusters.glsl"]}),
 ];
 main_objs.push( maek.CPP('LambertianPipeline.cpp', undefined, { depends:[...lambertian_shaders] } ) );
 
 // build environment shaders and pipeline:
 const environment_shaders = [
 	maek.GLSLC('glsl/environment.vert', 'spv/environment.vert', {GLSLCFlags: []}),
+	maek.GLSLC('glsl/environment.vert', 'spv/environment.packed.vert', {GLSLCFlags: ['-DPACKED_VERTEX'], depends:["glsl/packed_vertex.glsl"]}),
 	maek.GLSLC('glsl/environment.frag', 'spv/environment.frag', {GLSLCFlags: []}),
 ];
 main_objs.push( maek.CPP('EnvironmentPipeline.cpp', undefined, { depends:[...environment_shaders] } ) );
@@ -94,6 +116,7 @@ main_objs.push( maek.CPP('EnvironmentPipeline.cpp', undefined, { depends:[...env
 // build mirror shaders and pipeline:
 const mirror_shaders = [
 	maek.GLSLC('glsl/mirror.vert', 'spv/mirror.vert', {GLSLCFlags: []}),
+	maek.GLSLC('glsl/mirror.vert', 'spv/mirror.packed.vert', {GLSLCFlags: ['-DPACKED_VERTEX'], depends:["glsl/packed_vertex.glsl"]}),
 	maek.GLSLC('glsl/mirror.frag', 'spv/mirror.frag', {GLSLCFlags: []}),
 ];
 main_objs.push( maek.CPP('MirrorPipeline.cpp', undefined, { depends:[...mirror_shaders] } ) );
@@ -101,7 +124,8 @@ main_objs.push( maek.CPP('MirrorPipeline.cpp', undefined, { depends:[...mirror_s
 // build mirror shaders and pipeline:
 const pbr_shaders = [
 	maek.GLSLC('glsl/pbr.vert', 'spv/pbr.vert', {GLSLCFlags: []}),
-	maek.GLSLC('glsl/pbr.frag', 'spv/pbr.frag', {GLSLCFlags: [], depends:["glsl/light.glsl"]}),
+	maek.GLSLC('glsl/pbr.vert', 'spv/pbr.packed.vert', {GLSLCFlags: ['-DPACKED_VERTEX'], depends:["glsl/packed_vertex.glsl"]}),
+	maek.GLSLC('glsl/pbr.frag', 'spv/pbr.frag', {GLSLCFlags: [], depends:["glsl/light.glsl", "glsl/clusters.glsl"]}),
 ];
 main_objs.push( maek.CPP('PBRPipeline.cpp', undefined, { depends:[...pbr_shaders] } ) );
 
@@ -109,6 +133,7 @@ main_objs.push( maek.CPP('PBRPipeline.cpp', undefined, { depends:[...pbr_shaders
 // build shadow shaders and pipeline:
 const shadow_shaders = [
 	maek.GLSLC('glsl/shadow.vert', 'spv/shadow.vert', {GLSLCFlags: []}),
+	maek.GLSLC('glsl/shadow.vert', 'spv/shadow.packed.vert', {GLSLCFlags: ['-DPACKED_VERTEX'], depends:["glsl/packed_vertex.glsl"]}),
 	maek.GLSLC('glsl/shadow.frag', 'spv/shadow.frag', {GLSLCFlags: []}),
 ];
 main_objs.push( maek.CPP('ShadowAtlasPipeline.cpp', undefined, { depends:[...shadow_shaders] } ) );
@@ -124,10 +149,33 @@ const cloud_lightgrid_shaders = [
 ]
 main_objs.push( maek.CPP('CloudLightGridPipeline.cpp', undefined, { depends:[...cloud_lightgrid_shaders] } ) );
 
+// build gpu culling shader and pipeline
+const cull_shaders = [
+	maek.GLSLC('glsl/cull.comp', 'spv/cull.comp', {GLSLCFlags: []}),
+]
+main_objs.push( maek.CPP('CullPipeline.cpp', undefined, { depends:[...cull_shaders] } ) );
+
+// build depth pyramid shader and pipeline (occlusion culling)
+const depth_pyramid_shaders = [
+	maek.GLSLC('glsl/depth_pyramid.comp', 'spv/depth_pyramid.comp', {GLSLCFlags: []}),
+]
+main_objs.push( maek.CPP('DepthPyramidPipeline.cpp', undefined, { depends:[...depth_pyramid_shaders] } ) );
 
-const main_exe = maek.LINK([...main_objs, ...viewer_objs, ...common_objs], 'bin/viewer');
+// build light cluster shader and pipeline (clustered lighting)
+const light_cluster_shaders = [
+	maek.GLSLC('glsl/light_clusters.comp', 'spv/light_clusters.comp', {GLSLCFlags: [], depends:["glsl/light.glsl", "glsl/clusters.glsl"]}),
+]
+main_objs.push( maek.CPP('LightClusterPipeline.cpp', undefined, { depends:[...light_cluster_shaders] } ) );
+
+
+const main_exe = maek.LINK([...main_objs, ...viewer_objs, ...sejp_objs, ...light_binning_objs, ...shadow_atlas_objs, ...common_objs], 'bin/viewer');
 const nanite_mesh_exe = maek.LINK([...nanite_mesh_objs, ...common_objs], 'bin/mesh_process');
 
+//benchmarks (not built by default; e.g. `node Maekfile.js bin/sejp_bench`):
+const sejp_bench_exe = maek.LINK([maek.CPP('bench/sejp_bench.cpp'), ...sejp_objs], 'bin/sejp_bench');
+const light_binning_bench_exe = maek.LINK([maek.CPP('bench/light_binning_bench.cpp'), ...light_binning_objs], 'bin/light_binning_bench');
+const shadow_atlas_bench_exe = maek.LINK([maek.CPP('bench/shadow_atlas_bench.cpp'), ...shadow_atlas_objs], 'bin/shadow_atlas_bench');
+
 //default targets:
 maek.TARGETS = [main_exe, nanite_mesh_exe];
 
@@ -143,7 +191,7 @@ function custom_flags_and_rules() {
 		console.log(`Using GLFW_DIR='${GLFW_DIR}'; set GLFW_DIR environment variable to override.`);
 
 		maek.options.CPP = ['g++', '-std=c++20', '-Wall', '-Werror', "-Wno-deprecated", '-g'];
-		maek.options.LINK = ['g++', '-std=c++20', '-Wall', '-Werror', '-g'];
+		maek.options.LINK = ['g++', '-std=c++20', '-Wall', '-Werror', '-g', '-pthread'];
 
 		maek.options.CPPFlags = [
 			'-O2',
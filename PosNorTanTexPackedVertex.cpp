@@ -0,0 +1,116 @@
+#include "PosNorTanTexPackedVertex.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+static std::array<VkVertexInputBindingDescription, 1> bindings{
+	VkVertexInputBindingDescription{
+		.binding = 0,
+		.stride = sizeof(PosNorTanTexPackedVertex),
+		.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+	}
+};
+
+static std::array<VkVertexInputAttributeDescription, 4> attributes{
+	VkVertexInputAttributeDescription{
+		.location = 0,
+		.binding = 0,
+		.format = VK_FORMAT_R16G16B16A16_UNORM,
+		.offset = offsetof(PosNorTanTexPackedVertex, Position),
+	},
+	VkVertexInputAttributeDescription{
+		.location = 1,
+		.binding = 0,
+		.format = VK_FORMAT_R16G16_SNORM,
+		.offset = offsetof(PosNorTanTexPackedVertex, Normal),
+	},
+	VkVertexInputAttributeDescription{
+		.location = 2,
+		.binding = 0,
+		.format = VK_FORMAT_R16G16_SNORM,
+		.offset = offsetof(PosNorTanTexPackedVertex, Tangent),
+	},
+	VkVertexInputAttributeDescription{
+		.location = 3,
+		.binding = 0,
+		.format = VK_FORMAT_R16G16_SFLOAT,
+		.offset = offsetof(PosNorTanTexPackedVertex, TexCoord),
+	},
+};
+
+const VkPipelineVertexInputStateCreateInfo PosNorTanTexPackedVertex::array_input_state{
+	.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+	.vertexBindingDescriptionCount = uint32_t(bindings.size()),
+	.pVertexBindingDescriptions = bindings.data(),
+	.vertexAttributeDescriptionCount = uint32_t(attributes.size()),
+	.pVertexAttributeDescriptions = attributes.data(),
+};
+
+static uint16_t to_unorm16(float v) {
+	return uint16_t(std::lround(std::clamp(v, 0.0f, 1.0f) * 65535.0f));
+}
+
+static int16_t to_snorm16(float v) {
+	return int16_t(std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+//round-to-nearest float to half conversion:
+static uint16_t to_half(float f) {
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t mantissa = bits & 0x7fffff;
+	if (((bits >> 23) & 0xff) == 0xff) return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0)); //inf or nan
+	int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+	if (exponent >= 31) return uint16_t(sign | 0x7c00); //too large: inf
+	if (exponent <= 0) { //subnormal (or zero)
+		if (exponent < -10) return uint16_t(sign);
+		mantissa |= 0x800000;
+		uint32_t shift = uint32_t(14 - exponent);
+		return uint16_t((sign | (mantissa >> shift)) + ((mantissa >> (shift - 1)) & 1));
+	}
+	//(a carry out of the mantissa correctly bumps the exponent)
+	return uint16_t((sign | (uint32_t(exponent) << 10) | (mantissa >> 13)) + ((mantissa >> 12) & 1));
+}
+
+//octahedral encoding of a direction (see Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors", 2014):
+static void to_octahedral(float x, float y, float z, int16_t *out) {
+	float l1 = std::abs(x) + std::abs(y) + std::abs(z);
+	float u = 0.0f, v = 0.0f;
+	if (l1 > 0.0f) {
+		u = x / l1;
+		v = y / l1;
+		if (z < 0.0f) {
+			float fold_u = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+			float fold_v = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+			u = fold_u;
+			v = fold_v;
+		}
+	}
+	out[0] = to_snorm16(u);
+	out[1] = to_snorm16(v);
+}
+
+PosNorTanTexPackedVertex PosNorTanTexPackedVertex::pack(PosNorTanTexVertex const &vertex, float const min[3], float const scale[3]) {
+	PosNorTanTexPackedVertex packed;
+	packed.Position.x = to_unorm16((vertex.Position.x - min[0]) / scale[0]);
+	packed.Position.y = to_unorm16((vertex.Position.y - min[1]) / scale[1]);
+	packed.Position.z = to_unorm16((vertex.Position.z - min[2]) / scale[2]);
+	packed.Position.w = (vertex.Tangent.w < 0.0f ? 0 : 0xffff);
+
+	int16_t normal[2];
+	to_octahedral(vertex.Normal.x, vertex.Normal.y, vertex.Normal.z, normal);
+	packed.Normal.x = normal[0];
+	packed.Normal.y = normal[1];
+
+	int16_t tangent[2];
+	to_octahedral(vertex.Tangent.x / scale[0], vertex.Tangent.y / scale[1], vertex.Tangent.z / scale[2], tangent);
+	packed.Tangent.x = tangent[0];
+	packed.Tangent.y = tangent[1];
+
+	packed.TexCoord.s = to_half(vertex.TexCoord.s);
+	packed.TexCoord.t = to_half(vertex.TexCoord.t);
+	return packed;
+}
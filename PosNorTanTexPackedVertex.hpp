@@ -0,0 +1,24 @@
+#pragma once
+
+#include "PosNorTanTexVertex.hpp"
+
+#include <vulkan/vulkan_core.h>
+
+#include <cstdint>
+
+//a quantized PosNorTanTexVertex, for --vertex-format packed (20 bytes instead of 48):
+struct PosNorTanTexPackedVertex {
+	struct { uint16_t x,y,z,w; } Position; //unorm xyz within the mesh's box; w: tangent sign (0 is -1, 65535 is +1)
+	struct { int16_t x,y; } Normal; //snorm octahedral
+	struct { int16_t x,y; } Tangent; //snorm octahedral
+	struct { uint16_t s,t; } TexCoord; //half floats
+	//a pipeline vertex input state that works with a buffer holding a PosNorTanTexPackedVertex[] array:
+	static const VkPipelineVertexInputStateCreateInfo array_input_state;
+
+	//quantize 'vertex' relative to the box at 'min' with size 'scale' (positions decode to min + scale * Position.xyz).
+	// Every 'scale' component must be positive. The tangent is stored divided by 'scale', so that transforming it by
+	// a matrix with the decode folded in (as the shaders do) yields the original direction:
+	static PosNorTanTexPackedVertex pack(PosNorTanTexVertex const &vertex, float const min[3], float const scale[3]);
+};
+
+static_assert(sizeof(PosNorTanTexPackedVertex) == 4*2 + 2*2 + 2*2 + 2*2, "PosNorTanTexPackedVertex is packed.");
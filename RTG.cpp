@@ -21,6 +21,17 @@
 #include <fstream>
 
 void RTG::Configuration::parse(int argc, char **argv) {
+	//the [0-9]+ parameter following flag 'arg' at argi:
+	auto number_parameter = [&](int &argi, std::string const &arg, std::string const &what) {
+		if (argi + 1 >= argc) throw std::runtime_error(arg + " requires a parameter (" + what + ").");
+		argi += 1;
+		std::string val = argv[argi];
+		if (val.empty() || val.find_first_not_of("0123456789") != std::string::npos) {
+			throw std::runtime_error(arg + " should match [0-9]+, got '" + val + "'.");
+		}
+		return uint32_t(std::stoul(val));
+	};
+
 	for (int argi = 1; argi < argc; ++argi) {
 		std::string arg = argv[argi];
 		if (arg == "--debug") {
@@ -49,6 +60,10 @@ void RTG::Configuration::parse(int argc, char **argv) {
 			if (argi + 1 >= argc) throw std::runtime_error("--scene requires a parameter (a .72 format scene path).");
 			argi += 1;
 			scene_path = argv[argi];
+		} else if (arg == "--scene-cache") {
+			if (argi + 1 >= argc) throw std::runtime_error("--scene-cache requires a parameter (a directory for compiled scenes).");
+			argi += 1;
+			scene_cache = argv[argi];
 		} else if (arg == "--camera"){
 			argi += 1;
 			scene_camera = argv[argi];
@@ -77,9 +92,63 @@ void RTG::Configuration::parse(int argc, char **argv) {
 			else if (settings == "frustum") {
 				culling_settings = 1;
 			}
+			else if (settings == "gpu") {
+				culling_settings = 2;
+			}
+			else if (settings == "occlusion") {
+				culling_settings = 3;
+			}
+			else {
+				throw std::runtime_error("--culling only takes none, frustum, gpu, or occlusion as parameters");
+			}
+		} else if (arg == "--draw-mode"){
+			if (argi + 1 >= argc) throw std::runtime_error("--draw-mode requires a parameter (direct or indirect).");
+			argi += 1;
+			std::string mode = argv[argi];
+			if (mode == "direct") {
+				draw_mode = 0;
+			}
+			else if (mode == "indirect") {
+				draw_mode = 1;
+			}
+			else {
+				throw std::runtime_error("--draw-mode only takes direct or indirect as parameters");
+			}
+		} else if (arg == "--vertex-format"){
+			if (argi + 1 >= argc) throw std::runtime_error("--vertex-format requires a parameter (float or packed).");
+			argi += 1;
+			std::string format = argv[argi];
+			if (format == "float") {
+				vertex_format = 0;
+			}
+			else if (format == "packed") {
+				vertex_format = 1;
+			}
+			else {
+				throw std::runtime_error("--vertex-format only takes float or packed as parameters");
+			}
+		} else if (arg == "--light-binning"){
+			if (argi + 1 >= argc) throw std::runtime_error("--light-binning requires a parameter (gpu or cpu).");
+			argi += 1;
+			std::string binning = argv[argi];
+			if (binning == "gpu") {
+				light_binning = 0;
+			}
+			else if (binning == "cpu") {
+				light_binning = 1;
+			}
 			else {
-				throw std::runtime_error("--culling only takes none or frustum as parameters");
+				throw std::runtime_error("--light-binning only takes gpu or cpu as parameters");
+			}
+		} else if (arg == "--sun-shadows"){
+			sun_shadows = number_parameter(argi, arg, "the number of sun lights to shadow");
+		} else if (arg == "--cascades"){
+			cascades = number_parameter(argi, arg, "the number of cascades per sun light");
+			if (cascades < 1 || cascades > 4) {
+				throw std::runtime_error("--cascades only takes 1 to 4 as parameters");
 			}
+		} else if (arg == "--cascade-size"){
+			cascade_size = number_parameter(argi, arg, "texels on a side");
 		} else if (arg == "--headless"){
 			argi += 1;
 			headless_event_path = argv[argi];
@@ -99,9 +168,16 @@ void RTG::Configuration::usage(std::function< void(const char *, const char *) >
 	callback("--physical-device <name>", "Run on the named physical device (guesses, otherwise).");
 	callback("--drawing-size <w> <h>", "Set the size of the surface to draw to.");
 	callback("--scene <p>", "Read the scene file in .s72 format.");
+	callback("--scene-cache <dir>", "Read/write compiled binary scenes in <dir>, skipping .s72 parsing when the source is unchanged.");
 	callback("--camera <c>", "View the scene through camera with name <c>.");
 	callback("--animation < loop | play-once | paused >", "Animate the scene with drivers starting paused, only plays once, or loops, default plays ones");
-	callback("--culling < none | frustum >", "Choose how the scene should be culled");
+	callback("--culling < none | frustum | gpu | occlusion >", "Choose how the scene should be culled (gpu: frustum culling in a compute pass feeding indirect draws; occlusion: gpu plus depth pyramid occlusion culling)");
+	callback("--draw-mode < direct | indirect >", "Submit instances with one draw call each, or with indirect draws per material (default direct)");
+	callback("--vertex-format < float | packed >", "Store mesh vertices as floats, or quantized to 20 bytes each (default float)");
+	callback("--light-binning < gpu | cpu >", "Assign lights to light clusters in a compute pass, or on the CPU as a reference (default gpu)");
+	callback("--sun-shadows <count>", "Give cascaded shadow maps to the first <count> sun lights that have a shadow size (default 1)");
+	callback("--cascades <count>", "Split each shadowed sun light's shadow into <count> cascades over the view's depth, 1 to 4 (default 4)");
+	callback("--cascade-size <texels>", "Resolution of the nearest sun cascade, halved for each farther one; also shadows suns without a shadow size (default: the sun's shadow size)");
 	callback("--headless <event>", "Runs in headless mode with events given in the <event> path");
 }
 
@@ -440,10 +516,14 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 			VkPhysicalDeviceFeatures features;
 			vkGetPhysicalDeviceFeatures(physical_device, &features);
 
-			VkPhysicalDeviceFeatures enabled_features = {};
+			enabled_features = {};
 			if (features.samplerAnisotropy) {
 				enabled_features.samplerAnisotropy = true;
 			}
+			//lets one vkCmdDrawIndexedIndirect submit a whole batch (--draw-mode indirect falls back to one command per call without it):
+			if (features.multiDrawIndirect) {
+				enabled_features.multiDrawIndirect = true;
+			}
 
 			VkDeviceCreateInfo create_info{
 				.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
@@ -461,9 +541,28 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 				.pEnabledFeatures = &enabled_features,
 			};
 
+			//drawIndirectCount lets GPU culling (--culling gpu) hand the draw counts straight to the draws:
+			VkPhysicalDeviceVulkan12Features vulkan12_features{
+				.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+			};
+			if (device_properties.apiVersion >= VK_API_VERSION_1_2) {
+				VkPhysicalDeviceVulkan12Features supported{
+					.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+				};
+				VkPhysicalDeviceFeatures2 features2{
+					.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+					.pNext = &supported,
+				};
+				vkGetPhysicalDeviceFeatures2(physical_device, &features2);
+				vulkan12_features.drawIndirectCount = supported.drawIndirectCount;
+				draw_indirect_count = (supported.drawIndirectCount == VK_TRUE);
+				create_info.pNext = &vulkan12_features;
+			}
+
 			#if defined(__APPLE__)
 			VkPhysicalDevicePortabilitySubsetFeaturesKHR portability_features{
 				.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PORTABILITY_SUBSET_FEATURES_KHR,
+				.pNext = const_cast< void * >(create_info.pNext),
 				.mutableComparisonSamplers = VK_TRUE,
 			};
 			create_info.pNext = &portability_features;
@@ -517,9 +616,6 @@ RTG::~RTG() {
 		}
 	}
 
-	//destroy any resource destruction required by Helpers structure:
-	helpers.destroy();
-
 	//destroy workspace resources:
 	for (auto &workspace : workspaces) {
 		if (workspace.workspace_available != VK_NULL_HANDLE) {
@@ -540,6 +636,10 @@ RTG::~RTG() {
 	//destroy the swapchain:
 	destroy_swapchain();
 
+	//destroy any resource destruction required by Helpers structure:
+	//(after the swapchain, since headless swapchain images live in Helpers' memory blocks)
+	helpers.destroy();
+
 	//destroy the rest of the resources:
 	if (device != VK_NULL_HANDLE) {
 		vkDestroyDevice(device, nullptr);
@@ -65,11 +65,35 @@ struct RTG {
 		//camera to use for the scene
 		std::optional<std::string> scene_camera;
 
+		//directory holding compiled binary scene caches (unset disables the cache):
+		//  `--scene-cache <dir>` command-line flag
+		std::optional<std::string> scene_cache;
+
 		//animtion settings
 		uint8_t animation_settings = 0; // 0 play once, 1 loop, 2 paused
 
 		//culling settings
-		uint8_t culling_settings = 1; // 0 no culling, 1 frustum culling
+		uint8_t culling_settings = 1; // 0 no culling, 1 frustum culling, 2 frustum culling in a compute pass (draws indirectly), 3 as 2 plus occlusion culling
+
+		//how the material pipelines submit instances:
+		//  `--draw-mode <direct|indirect>` command-line flag
+		uint8_t draw_mode = 0; // 0 direct (vkCmdDrawIndexed per mesh run), 1 indirect (vkCmdDrawIndexedIndirect per material batch)
+
+		//how object vertices are stored on the GPU:
+		//  `--vertex-format <float|packed>` command-line flag
+		uint8_t vertex_format = 0; // 0 float (PosNorTanTexVertex), 1 packed (PosNorTanTexPackedVertex: quantized positions, octahedral normals and tangents, half texcoords)
+
+		//where sphere and spot lights are assigned to the view's light clusters:
+		//  `--light-binning <gpu|cpu>` command-line flag
+		uint8_t light_binning = 0; // 0 gpu (light cluster compute pass), 1 cpu (LightBinning on the worker threads, lists uploaded every frame)
+
+		//sun light cascaded shadow maps (see RTGRenderer::Cascade):
+		//  `--sun-shadows <count>` command-line flag: how many sun lights (the first ones with a shadow size) get shadows
+		uint32_t sun_shadows = 1;
+		//  `--cascades <count>` command-line flag: shadow maps per sun light, each covering a slice of the view's depth (1 to 4)
+		uint32_t cascades = 4;
+		//  `--cascade-size <texels>` command-line flag: resolution of the nearest cascade, halved for each farther one (0: the sun light's own "shadow" size)
+		uint32_t cascade_size = 0;
 
 		//headless mode (for benchmarking)
 		bool headless_mode = false;
@@ -139,6 +163,8 @@ struct RTG {
 	VkQueue compute_queue = VK_NULL_HANDLE;
 
 	VkPhysicalDeviceProperties device_properties{};
+	VkPhysicalDeviceFeatures enabled_features{}; //core features enabled on 'device'
+	bool draw_indirect_count = false; //Vulkan 1.2 drawIndirectCount enabled on 'device'
 
 	//-------------------------------------------------
 	//Handles for the window and surface:
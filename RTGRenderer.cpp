@@ -11,19 +11,117 @@
 #include "VK.hpp"
 #include "rgbe.hpp"
 #include "data_path.hpp"
+#include "mapped_file.hpp"
+#include "mesh_indexing.hpp"
+#include "simd.hpp"
 
 #include "stb_image.h"
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstring>
-#include <deque>
 #include <iostream>
 #include <fstream>
+#include <future>
+#include <memory>
+#include <unordered_map>
 
 static constexpr unsigned int WORKGROUP_SIZE = 32;
 
+//copies 'count' packed vertices from (possibly unaligned) 'src' to 'dst' and returns their bounds:
+static AABB copy_vertices_with_AABB(PosNorTanTexVertex *dst, char const *src, uint32_t count) {
+	std::memcpy(dst, src, size_t(count) * sizeof(PosNorTanTexVertex));
+	AABB aabb;
+	uint32_t i = 0;
+	#ifdef RTG_SSE
+	if (count > 0) {
+		//(a 4-wide load of Position also picks up Normal.x; that lane is ignored)
+		__m128 lo = _mm_loadu_ps(&dst[0].Position.x);
+		__m128 hi = lo;
+		for (i = 1; i < count; ++i) {
+			__m128 p = _mm_loadu_ps(&dst[i].Position.x);
+			lo = _mm_min_ps(lo, p);
+			hi = _mm_max_ps(hi, p);
+		}
+		alignas(16) float lo_f[4], hi_f[4];
+		_mm_store_ps(lo_f, lo);
+		_mm_store_ps(hi_f, hi);
+		aabb.min = glm::vec3(lo_f[0], lo_f[1], lo_f[2]);
+		aabb.max = glm::vec3(hi_f[0], hi_f[1], hi_f[2]);
+	}
+	#endif
+	for (; i < count; ++i) {
+		glm::vec3 cur_vert_pos = {dst[i].Position.x, dst[i].Position.y, dst[i].Position.z};
+		aabb.min = glm::min(aabb.min, cur_vert_pos);
+		aabb.max = glm::max(aabb.max, cur_vert_pos);
+	}
+	return aabb;
+}
+
+//folds 'bytes' (a multiple of 4) of 'data' into 'hash' (for shadow caching, where a changed input must change the hash):
+static uint64_t hash_words(uint64_t hash, void const *data, size_t bytes) {
+	for (size_t i = 0; i < bytes / 4; ++i) {
+		uint32_t word;
+		std::memcpy(&word, reinterpret_cast< char const * >(data) + 4 * i, 4);
+		hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+//folds instance 'index' of pipeline 'pipeline' (which, mesh, and world transform) into a shadow's 'hash':
+static uint64_t hash_instance(uint64_t hash, uint32_t pipeline, uint32_t index, RTGRenderer::ObjectInstance const &inst) {
+	std::array< uint32_t, 2 > which{pipeline, index};
+	hash = hash_words(hash, which.data(), sizeof(which));
+	hash = hash_words(hash, &inst.vertices, sizeof(inst.vertices));
+	return hash_words(hash, &inst.transform.WORLD_FROM_LOCAL, sizeof(inst.transform.WORLD_FROM_LOCAL));
+}
+
+//stable LSD radix sort of 'values' by 'keys', a byte per pass; passes where every key has the same byte are skipped,
+// so keys that only use a few of their bits cost few passes. The _tmp vectors are scratch:
+static void radix_sort_by_key(std::vector< uint64_t > &keys, std::vector< uint32_t > &values, std::vector< uint64_t > &keys_tmp, std::vector< uint32_t > &values_tmp) {
+	assert(keys.size() == values.size());
+	size_t count = keys.size();
+	if (count < 2) return;
+	keys_tmp.resize(count);
+	values_tmp.resize(count);
+	for (uint32_t shift = 0; shift < 64; shift += 8) {
+		std::array< uint32_t, 256 > offsets{};
+		for (uint64_t key : keys) {
+			++offsets[(key >> shift) & 0xff];
+		}
+		if (offsets[(keys[0] >> shift) & 0xff] == count) continue;
+		uint32_t sum = 0;
+		for (uint32_t &offset : offsets) {
+			uint32_t bucket = offset;
+			offset = sum;
+			sum += bucket;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t &offset = offsets[(keys[i] >> shift) & 0xff];
+			keys_tmp[offset] = keys[i];
+			values_tmp[offset] = values[i];
+			++offset;
+		}
+		keys.swap(keys_tmp);
+		values.swap(values_tmp);
+	}
+}
+
+uint64_t RTGRenderer::draw_sort_key(ObjectInstance const &inst) {
+	//view depth of the instance's origin (clip w; with packed vertices, its mesh box's min corner), bucketed logarithmically from 1/16 to 4096 units:
+	float depth = inst.transform.CLIP_FROM_LOCAL[3][3];
+	uint32_t depth_bucket = uint32_t(std::clamp((std::log2(std::max(depth, 1.0e-6f)) + 4.0f) * 16.0f, 0.0f, 255.0f));
+	//material (24 bits) | mesh (24 bits) | depth bucket (8 bits) | unused (8 bits):
+	return (uint64_t(inst.material_index & 0xffffff) << 40)
+	     | (uint64_t(inst.mesh_index & 0xffffff) << 16)
+	     | (uint64_t(depth_bucket) << 8);
+}
+
 RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), shadow_atlas(ShadowAtlas(shadow_atlas_length)) {
 
 	// read cluster info
@@ -127,6 +225,17 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 		};
 
 		VK( vkCreateRenderPass(rtg.device, &create_info, nullptr, &render_pass) );
+
+		//the same pass again, continuing from what the first one left in the attachments (for the late phase of --culling occlusion):
+		attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[0].initialLayout = color_final_layout;
+		attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+		attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		dependencies[1].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+		VK( vkCreateRenderPass(rtg.device, &create_info, nullptr, &render_pass_resume) );
 	}
 
 	{// create shadow atlas render pass, referenced https://github.com/SaschaWillems/Vulkan/blob/master/examples/shadowmapping/shadowmapping.cpp
@@ -134,11 +243,11 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 		VkAttachmentDescription attachment_description{
 			.format = depth_format,
 			.samples = VK_SAMPLE_COUNT_1_BIT,
-			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD, //(shadow caching: regions that aren't redrawn keep last frame's depth; the rest are cleared one by one)
 			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
 			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, //(where last frame's main pass left it; render() moves it there before the first frame)
 			.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
 		};
 
@@ -159,9 +268,9 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 				.srcSubpass = VK_SUBPASS_EXTERNAL,
 				.dstSubpass = 0,
 				.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-				.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
 				.srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
-				.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, //(read: the load)
 				.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
 			},
 			VkSubpassDependency {
@@ -263,20 +372,49 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 	shadow_pipeline.create(rtg, shadow_atlas_pass, 0);
 	cloud_pipeline.create(rtg);
 	cloud_lightgrid_pipeline.create(rtg);
+	cull_pipeline.create(rtg);
+	depth_pyramid_pipeline.create(rtg);
+	light_cluster_pipeline.create(rtg, lambertian_pipeline.set0_World);
+
+	{//sampler for the depth pyramid and the depth image it is built from (both are only read with texelFetch):
+		VkSamplerCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+			.magFilter = VK_FILTER_NEAREST,
+			.minFilter = VK_FILTER_NEAREST,
+			.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+			.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+			.mipLodBias = 0.0f,
+			.anisotropyEnable = VK_FALSE,
+			.maxAnisotropy = 0.0f,
+			.compareEnable = VK_FALSE,
+			.compareOp = VK_COMPARE_OP_ALWAYS,
+			.minLod = 0.0f,
+			.maxLod = VK_LOD_CLAMP_NONE,
+			.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+			.unnormalizedCoordinates = VK_FALSE,
+		};
+		VK(vkCreateSampler(rtg.device, &create_info, nullptr, &depth_pyramid_sampler));
+	}
+
+	//all static resource uploads (cloud volumes, environment, LUT, vertices, textures) are queued here,
+	//submitted once every image exists, and waited on at the end of the constructor:
+	Helpers::UploadBatch uploads(rtg.helpers);
 
 	if (scene.has_cloud) {//cloud resources
 		{// lodad cloud voxel data as 3D images
 		
-			Cloud_noise = Cloud::load_noise(rtg);
+			Cloud_noise = Cloud::load_noise(rtg, uploads);
 			if (scene.cloud->cloud_type == Scene::Cloud::CloudType::PARKOUR) {
 
-				Clouds_NVDF = Cloud::load_cloud(rtg, std::string("../resource/NubisVoxelCloudsPack/NVDFs/Examples/ParkouringCloud/TGA/"));
+				Clouds_NVDF = Cloud::load_cloud(rtg, uploads, std::string("../resource/NubisVoxelCloudsPack/NVDFs/Examples/ParkouringCloud/TGA/"));
 			}
 			else if (scene.cloud->cloud_type == Scene::Cloud::CloudType::STORMBIRD) {
-				Clouds_NVDF = Cloud::load_cloud(rtg, std::string("../resource/NubisVoxelCloudsPack/NVDFs/Examples/StormbirdCloud/TGA/"));
+				Clouds_NVDF = Cloud::load_cloud(rtg, uploads, std::string("../resource/NubisVoxelCloudsPack/NVDFs/Examples/StormbirdCloud/TGA/"));
 			}
 			else {
-				Clouds_NVDF = Cloud::load_cloud(rtg, scene.cloud->folder_path);
+				Clouds_NVDF = Cloud::load_cloud(rtg, uploads, scene.cloud->folder_path);
 			}
 		}
 
@@ -459,7 +597,7 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			Helpers::Unmapped, 6, mip_levels
 		);
-		rtg.helpers.transfer_to_image_cube(rgb_image.data(), sizeof(rgb_image[0]) * rgb_image.size(), World_environment, mip_levels);
+		uploads.image_cube(rgb_image.data(), sizeof(rgb_image[0]) * rgb_image.size(), World_environment, mip_levels);
 	
 		//free images:
 		for (unsigned char* image : images){
@@ -556,7 +694,7 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 				Helpers::Unmapped
 			);
 			
-			rtg.helpers.transfer_to_image(converted_image.data(), sizeof(converted_image[0]) * width * height * 2, World_environment_brdf_lut);
+			uploads.image(converted_image.data(), sizeof(converted_image[0]) * width * height * 2, World_environment_brdf_lut);
 			
 			//free image:
 			stbi_image_free(image);
@@ -586,25 +724,33 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 	{//create descriptor pool:
 		uint32_t per_workspace = uint32_t(rtg.workspaces.size()); //for easier-to-read counting
 
-		std::array< VkDescriptorPoolSize, 3> pool_sizes{
+		std::array< VkDescriptorPoolSize, 5> pool_sizes{
 			VkDescriptorPoolSize{
-				.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				.descriptorCount = 2 * per_workspace, //one descriptor per set, two sets per workspace
+				.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+				.descriptorCount = 4 * per_workspace, //Camera, World, and CloudWorld in both cloud sets
 			},
 			VkDescriptorPoolSize{
 				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.descriptorCount = 5 * per_workspace, //one descriptor per set, one set per workspace
+				.descriptorCount = 6 * per_workspace + DepthPyramidMaxLevels, //one descriptor per set, one set per workspace; depth pyramid levels
+			},
+			VkDescriptorPoolSize{
+				.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+				.descriptorCount = 4 * per_workspace, //three lights descriptors for set 0, one Transforms for set 1
 			},
 			VkDescriptorPoolSize{
 				.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				.descriptorCount = 4 * per_workspace, //three descriptor for set 0, one for set 1, one set per workspace
+				.descriptorCount = 7 * per_workspace, //GPU culling set, light cluster lists in the World set
+			},
+			VkDescriptorPoolSize{
+				.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+				.descriptorCount = DepthPyramidMaxLevels, //depth pyramid levels
 			},
 		};
 		
 		VkDescriptorPoolCreateInfo create_info{
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 			.flags = 0, //because CREATE_FREE_DESCRIPTOR_SET_BIT isn't included, *can't* free individual descriptors allocated from this pool
-			.maxSets = 6 * per_workspace, //three sets per workspace
+			.maxSets = 7 * per_workspace + DepthPyramidMaxLevels, //seven sets per workspace, one per depth pyramid level
 			.poolSizeCount = uint32_t(pool_sizes.size()),
 			.pPoolSizes = pool_sizes.data(),
 		};
@@ -612,6 +758,19 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 		VK(vkCreateDescriptorPool(rtg.device, &create_info, nullptr, &descriptor_pool));
 	}
 
+	{ //allocate descriptor sets for the depth pyramid levels (written in on_swapchain, once the pyramid exists)
+		std::array< VkDescriptorSetLayout, DepthPyramidMaxLevels > layouts;
+		layouts.fill(depth_pyramid_pipeline.set0_Level);
+		VkDescriptorSetAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = descriptor_pool,
+			.descriptorSetCount = uint32_t(layouts.size()),
+			.pSetLayouts = layouts.data(),
+		};
+
+		VK(vkAllocateDescriptorSets(rtg.device, &alloc_info, DepthPyramid_descriptors.data()));
+	}
+
 	if (scene.has_cloud) { //allocate descriptor sets for Cloud descriptor
 		VkDescriptorSetAllocateInfo alloc_info{
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
@@ -691,20 +850,18 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			};
 			VK(vkAllocateCommandBuffers(rtg.device, &alloc_info, &workspace.command_buffer));
 		}
-	
-		workspace.Camera_src = rtg.helpers.create_buffer(
-			sizeof(LinesPipeline::Camera),
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT, //going to have GPU copy from this memory
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, //host-visible memory, coherent (no special sync needed)
-			Helpers::Mapped //get a pointer to the memory
-		);
-		workspace.Camera = rtg.helpers.create_buffer(
-			sizeof(LinesPipeline::Camera),
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, //going to use as a uniform buffer, also going to have GPU copy into this memory
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //GPU-local memory
-			Helpers::Unmapped //don't get a pointer to the memory
-		);
 
+		//one recording pool for each thread that can record (the pool's workers and the thread calling render):
+		workspace.recording_pools.resize(thread_pool.size() + 1);
+		for (Workspace::RecordingPool &pool : workspace.recording_pools) {
+			VkCommandPoolCreateInfo create_info{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+				.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+				.queueFamilyIndex = rtg.graphics_queue_family.value(),
+			};
+			VK(vkCreateCommandPool(rtg.device, &create_info, nullptr, &pool.handle));
+		}
+	
 		{//allocate descriptor set for Camera descriptor
 			VkDescriptorSetAllocateInfo alloc_info{
 				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
@@ -716,32 +873,6 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			VK(vkAllocateDescriptorSets(rtg.device, &alloc_info, &workspace.Camera_descriptors));
 		}
 
-		workspace.World_src = rtg.helpers.create_buffer(
-			sizeof(LambertianPipeline::World),
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			Helpers::Mapped
-		);
-		workspace.World = rtg.helpers.create_buffer(
-			sizeof(LambertianPipeline::World),
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			Helpers::Unmapped
-		);
-
-		workspace.Cloud_World_src = rtg.helpers.create_buffer(
-			sizeof(CloudPipeline::CloudWorld),
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			Helpers::Mapped
-		);
-
-		workspace.Cloud_World = rtg.helpers.create_buffer(
-			sizeof(CloudPipeline::CloudWorld),
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			Helpers::Unmapped
-		);
 		{// create 3D image and image view for the light grid
 			constexpr VkExtent3D lightgrid_extent = {256, 256, 32};
 			workspace.Cloud_lightgrid = rtg.helpers.create_image_3D(
@@ -821,22 +952,22 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			world.SPOT_LIGHT_COUNT = scene.light_instance_count.spot_light;
 		}
 
-		{// create Light buffers
-			size_t needed_bytes = light_info.sphere_light_alignment + light_info.spot_light_size;
-			workspace.Light_src = rtg.helpers.create_buffer(
-				needed_bytes,
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT, //going to have GPU copy from this memory
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, //host-visible memory, coherent (no special sync needed)
-				Helpers::Mapped //get a pointer to the memory
+		{//create the stream buffer for per-frame data:
+			//blocks are bound at dynamic offsets, so they must satisfy both uniform and storage offset alignment:
+			VkDeviceSize alignment = std::max(
+				rtg.device_properties.limits.minUniformBufferOffsetAlignment,
+				rtg.device_properties.limits.minStorageBufferOffsetAlignment
 			);
-			workspace.Light = rtg.helpers.create_buffer(
-				needed_bytes,
-				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, //going to use as storage buffer, also going to have GPU into this memory
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //GPU-local memory
-				Helpers::Unmapped //don't get a pointer to the memory
+			workspace.stream = rtg.helpers.create_stream_buffer(
+				1024 * 1024,
+				VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, //(transfer: --light-binning cpu)
+				alignment
 			);
+			workspace.Transforms_capacity = 64 * 1024; //grown in render() as needed
+			//(scenes with very many lights might not fit in the initial size:)
+			rtg.helpers.reserve_stream_buffer(workspace.stream, frame_stream_bytes(workspace, 0, 0));
 		}
-		
+
 
 		{//allocate descriptor set for Transforms descriptor
 			VkDescriptorSetAllocateInfo alloc_info{
@@ -847,38 +978,47 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			};
 
 			VK(vkAllocateDescriptorSets(rtg.device, &alloc_info, &workspace.Transforms_descriptors));
-			//NOTE: will fill in this descriptor set in render when buffers are [re-]allocated
 		}
 
-		{//point descriptors to buffers:
-			VkDescriptorBufferInfo Camera_info{
-				.buffer = workspace.Camera.handle,
-				.offset = 0,
-				.range = workspace.Camera.size,
+		{//allocate descriptor set for GPU culling (written in render)
+			VkDescriptorSetAllocateInfo alloc_info{
+				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+				.descriptorPool = descriptor_pool,
+				.descriptorSetCount = 1,
+				.pSetLayouts = &cull_pipeline.set0_Cull,
 			};
 
-			VkDescriptorBufferInfo World_info{
-				.buffer = workspace.World.handle,
-				.offset = 0,
-				.range = workspace.World.size,
-			};
+			VK(vkAllocateDescriptorSets(rtg.device, &alloc_info, &workspace.Cull_descriptors));
+		}
+
+		write_stream_descriptors(workspace);
+
+		{//the light cluster lists are written by the GPU every frame, so each workspace has its own:
+			workspace.Light_clusters = rtg.helpers.create_buffer(
+				LightClusterPipeline::ClusterCount * LightClusterPipeline::ClusterStride * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, //(transfer: --light-binning cpu copies its lists in)
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				Helpers::Unmapped
+			);
 
-			VkDescriptorBufferInfo SunLight_info{
-				.buffer = workspace.Light.handle,
+			VkDescriptorBufferInfo Light_clusters_info{
+				.buffer = workspace.Light_clusters.handle,
 				.offset = 0,
-				.range = light_info.sun_light_size,
+				.range = workspace.Light_clusters.size,
 			};
-			VkDescriptorBufferInfo SphereLight_info{
-				.buffer = workspace.Light.handle,
-				.offset = light_info.sun_light_alignment,
-				.range = light_info.sphere_light_size,
-			};
-			VkDescriptorBufferInfo SpotLight_info{
-				.buffer = workspace.Light.handle,
-				.offset = light_info.sphere_light_alignment,
-				.range = light_info.spot_light_size,
+			VkWriteDescriptorSet write{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = workspace.World_descriptors,
+				.dstBinding = 7,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &Light_clusters_info,
 			};
+			vkUpdateDescriptorSets(rtg.device, 1, &write, 0, nullptr);
+		}
 
+		{//point descriptors to images:
 			VkDescriptorImageInfo World_environment_info{
 				.sampler = World_environment_sampler,
 				.imageView = World_environment_view,
@@ -897,27 +1037,7 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			};
 
-			std::array< VkWriteDescriptorSet, 8 > writes{
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = workspace.Camera_descriptors,
-					.dstBinding = 0,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-					.pBufferInfo = &Camera_info,
-				},
-				
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = workspace.World_descriptors,
-					.dstBinding = 0,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-					.pBufferInfo = &World_info,
-				},
-
+			std::array< VkWriteDescriptorSet, 3 > writes{
 				VkWriteDescriptorSet{
 					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 					.dstSet = workspace.World_descriptors,
@@ -938,36 +1058,6 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 					.pImageInfo = &World_environment_brdf_lut_info,
 				},
 
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = workspace.World_descriptors,
-					.dstBinding = 3,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-					.pBufferInfo = &SunLight_info,
-				},
-
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = workspace.World_descriptors,
-					.dstBinding = 4,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-					.pBufferInfo = &SphereLight_info,
-				},
-
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = workspace.World_descriptors,
-					.dstBinding = 5,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-					.pBufferInfo = &SpotLight_info,
-				},
-
 				VkWriteDescriptorSet{
 					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 					.dstSet = workspace.World_descriptors,
@@ -989,12 +1079,6 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 		}
 
 		if (scene.has_cloud) {// update cloud descriptors
-			VkDescriptorBufferInfo Cloud_World_info{
-				.buffer = workspace.Cloud_World.handle,
-				.offset = 0,
-				.range = workspace.Cloud_World.size,
-			};
-
 			VkDescriptorImageInfo Cloud_lightgrid_info{
 				.sampler = cloud_sampler,
 				.imageView = workspace.Cloud_lightgrid_view,
@@ -1007,27 +1091,7 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			};
 
-			std::array<VkWriteDescriptorSet, 4> writes = {
-
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = workspace.Cloud_World_descriptors,
-					.dstBinding = 1,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-					.pBufferInfo = &Cloud_World_info,
-				},
-
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = workspace.Cloud_LightGrid_World_descriptors,
-					.dstBinding = 1,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-					.pBufferInfo = &Cloud_World_info,
-				},
+			std::array<VkWriteDescriptorSet, 2> writes = {
 
 				VkWriteDescriptorSet{
 					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
@@ -1063,109 +1127,263 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 	}
 	
 
-	{//create object vertices
+	{//create object vertices and indices
+		//each distinct .b72 is mapped once; meshes are copied out of the mappings in parallel chunks,
+		//computing the bounding box of each chunk while its vertices are still in cache:
 		std::vector<PosNorTanTexVertex> vertices;
 		vertices.resize(scene.vertices_count);
 		uint32_t new_vertices_start = 0;
+		std::vector<uint32_t> mesh_first_vertex(scene.meshes.size(), 0); //in 'vertices'
 		mesh_vertices.assign(scene.meshes.size(), ObjectVertices());
 		mesh_AABBs.assign(scene.meshes.size(),AABB());
+
+		std::unordered_map< std::string, MappedFile > sources;
+		std::vector< MappedFile const * > mesh_sources(scene.meshes.size(), nullptr);
 		for (uint32_t i = 0; i < uint32_t(scene.meshes.size()); ++i) {
 			Scene::Mesh& cur_mesh = scene.meshes[i];
-			mesh_vertices[i].count = cur_mesh.count;
-			mesh_vertices[i].first = new_vertices_start;  
-			std::ifstream file(scene.scene_path + "/" + cur_mesh.attributes[0].source, std::ios::binary); // assuming the attribute layout holds
-			if (!file.is_open()) throw std::runtime_error("Error opening file for mesh data: " + scene.scene_path + "/" + cur_mesh.attributes[0].source);
-			if (!file.read(reinterpret_cast< char * >(&vertices[new_vertices_start]), cur_mesh.count * sizeof(PosNorTanTexVertex))) {
-				throw std::runtime_error("Failed to read mesh data: " + scene.scene_path + "/" + cur_mesh.attributes[0].source);
+			mesh_first_vertex[i] = new_vertices_start;
+			new_vertices_start += cur_mesh.count;
+			if (cur_mesh.count == 0) continue;
+
+			// assuming the attribute layout holds (interleaved PosNorTanTex, starting at the position attribute)
+			Scene::Mesh::Attribute const &position = cur_mesh.attributes[0];
+			std::string path = scene.scene_path + "/" + position.source;
+			if (position.stride != sizeof(PosNorTanTexVertex)) {
+				throw std::runtime_error("Mesh " + cur_mesh.name + " has stride " + std::to_string(position.stride) + ", expected interleaved PosNorTanTex (" + std::to_string(sizeof(PosNorTanTexVertex)) + ").");
+			}
+			auto source = sources.find(path);
+			if (source == sources.end()) {
+				try {
+					source = sources.emplace(path, MappedFile(path)).first;
+				} catch (std::exception &e) {
+					throw std::runtime_error("Error opening file for mesh data: " + path + " (" + e.what() + ")");
+				}
 			}
-			//find OOB
-			for (size_t vertex_i = mesh_vertices[i].first; vertex_i < (mesh_vertices[i].first + mesh_vertices[i].count); ++vertex_i) {
-				glm::vec3 cur_vert_pos = {vertices[vertex_i].Position.x, vertices[vertex_i].Position.y, vertices[vertex_i].Position.z};
-				mesh_AABBs[i].min = glm::min(mesh_AABBs[i].min, cur_vert_pos);
-				mesh_AABBs[i].max = glm::max(mesh_AABBs[i].max, cur_vert_pos);
+			if (size_t(position.offset) + size_t(cur_mesh.count) * sizeof(PosNorTanTexVertex) > source->second.size()) {
+				throw std::runtime_error("Failed to read mesh data: " + path + " is too short for mesh " + cur_mesh.name);
 			}
-			new_vertices_start += cur_mesh.count;
+			mesh_sources[i] = &source->second;
 		}
 		assert(new_vertices_start == scene.vertices_count);
 
-		size_t bytes = vertices.size() * sizeof(vertices[0]);
+		struct Chunk {
+			uint32_t mesh;
+			uint32_t first; //relative to the mesh
+			uint32_t count;
+			AABB aabb;
+		};
+		constexpr uint32_t ChunkVertices = 1 << 14;
+		std::vector< Chunk > chunks;
+		for (uint32_t i = 0; i < uint32_t(scene.meshes.size()); ++i) {
+			if (mesh_sources[i] == nullptr) continue;
+			for (uint32_t first = 0; first < scene.meshes[i].count; first += ChunkVertices) {
+				chunks.emplace_back(Chunk{ .mesh = i, .first = first, .count = std::min(ChunkVertices, scene.meshes[i].count - first) });
+			}
+		}
+
+		thread_pool.parallel_for(uint32_t(chunks.size()), [&](uint32_t c) {
+			Chunk &chunk = chunks[c];
+			char const *src = mesh_sources[chunk.mesh]->data() + scene.meshes[chunk.mesh].attributes[0].offset + size_t(chunk.first) * sizeof(PosNorTanTexVertex);
+			PosNorTanTexVertex *dst = &vertices[mesh_first_vertex[chunk.mesh] + chunk.first];
+			chunk.aabb = copy_vertices_with_AABB(dst, src, chunk.count);
+		});
+
+		for (Chunk const &chunk : chunks) {
+			mesh_AABBs[chunk.mesh].min = glm::min(mesh_AABBs[chunk.mesh].min, chunk.aabb.min);
+			mesh_AABBs[chunk.mesh].max = glm::max(mesh_AABBs[chunk.mesh].max, chunk.aabb.max);
+		}
+
+		if (rtg.configuration.debug) {
+			std::cout << "Loaded " << scene.vertices_count << " vertices for " << scene.meshes.size() << " meshes from " << sources.size() << " files in " << chunks.size() << " chunks." << std::endl;
+		}
+
+		//weld each mesh into indexed form and order its triangles for the vertex cache (meshes are independent, so in parallel):
+		struct IndexedMesh {
+			std::vector<PosNorTanTexVertex> vertices;
+			std::vector<uint32_t> indices;
+		};
+		std::vector<IndexedMesh> indexed(scene.meshes.size());
+		thread_pool.parallel_for(uint32_t(scene.meshes.size()), [&](uint32_t i) {
+			IndexedMesh &mesh = indexed[i];
+			weld_vertices(vertices.data() + mesh_first_vertex[i], scene.meshes[i].count, mesh.vertices, mesh.indices);
+			if (scene.meshes[i].topology == VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST) {
+				optimize_vertex_cache(mesh.indices, mesh.vertices);
+			}
+		});
+		std::vector<PosNorTanTexVertex>().swap(vertices); //(no longer needed)
+
+		uint32_t welded_vertices = 0, index_count = 0;
+		object_index_type = VK_INDEX_TYPE_UINT16;
+		for (uint32_t i = 0; i < uint32_t(scene.meshes.size()); ++i) {
+			mesh_vertices[i] = ObjectVertices{
+				.first_index = index_count,
+				.index_count = uint32_t(indexed[i].indices.size()),
+				.vertex_offset = int32_t(welded_vertices),
+			};
+			welded_vertices += uint32_t(indexed[i].vertices.size());
+			index_count += uint32_t(indexed[i].indices.size());
+			if (indexed[i].vertices.size() > 0x10000) object_index_type = VK_INDEX_TYPE_UINT32;
+		}
+
+		std::vector<PosNorTanTexVertex> welded(welded_vertices);
+		std::vector<uint16_t> indices_16;
+		std::vector<uint32_t> indices_32;
+		if (object_index_type == VK_INDEX_TYPE_UINT16) indices_16.resize(index_count);
+		else indices_32.resize(index_count);
+		thread_pool.parallel_for(uint32_t(scene.meshes.size()), [&](uint32_t i) {
+			ObjectVertices const &range = mesh_vertices[i];
+			std::copy(indexed[i].vertices.begin(), indexed[i].vertices.end(), welded.begin() + range.vertex_offset);
+			if (object_index_type == VK_INDEX_TYPE_UINT16) {
+				std::copy(indexed[i].indices.begin(), indexed[i].indices.end(), indices_16.begin() + range.first_index);
+			} else {
+				std::copy(indexed[i].indices.begin(), indexed[i].indices.end(), indices_32.begin() + range.first_index);
+			}
+		});
+
+		if (rtg.configuration.debug) {
+			uint64_t triangles = 0;
+			double misses = 0.0;
+			for (uint32_t i = 0; i < uint32_t(scene.meshes.size()); ++i) {
+				uint64_t mesh_triangles = indexed[i].indices.size() / 3;
+				misses += average_cache_miss_ratio(indexed[i].indices, uint32_t(indexed[i].vertices.size())) * double(mesh_triangles);
+				triangles += mesh_triangles;
+			}
+			std::cout << "Welded " << scene.vertices_count << " vertices to " << welded_vertices << " with " << index_count
+			          << (object_index_type == VK_INDEX_TYPE_UINT16 ? " 16" : " 32") << "-bit indices; "
+			          << (triangles ? misses / double(triangles) : 0.0) << " vertex cache misses per triangle." << std::endl;
+		}
+
+		//with --vertex-format packed, quantize each mesh's vertices within its box:
+		std::vector<PosNorTanTexPackedVertex> packed;
+		mesh_position_decode.clear();
+		if (rtg.configuration.vertex_format == 1) {
+			packed.resize(welded.size());
+			mesh_position_decode.assign(scene.meshes.size(), glm::mat4x4(1.0f));
+			thread_pool.parallel_for(uint32_t(scene.meshes.size()), [&](uint32_t i) {
+				if (indexed[i].vertices.empty()) return;
+				AABB const &box = mesh_AABBs[i];
+				glm::vec3 extent = box.max - box.min;
+				//(flat meshes keep a unit scale on their flat axis, so the decode stays invertible)
+				float min[3] = {box.min.x, box.min.y, box.min.z};
+				float scale[3] = {extent.x > 0.0f ? extent.x : 1.0f, extent.y > 0.0f ? extent.y : 1.0f, extent.z > 0.0f ? extent.z : 1.0f};
+				mesh_position_decode[i] = glm::scale(glm::translate(glm::mat4x4(1.0f), box.min), glm::vec3(scale[0], scale[1], scale[2]));
+				uint32_t first = uint32_t(mesh_vertices[i].vertex_offset);
+				for (uint32_t v = 0; v < uint32_t(indexed[i].vertices.size()); ++v) {
+					packed[first + v] = PosNorTanTexPackedVertex::pack(welded[first + v], min, scale);
+				}
+			});
+			std::vector<PosNorTanTexVertex>().swap(welded);
+		}
+
+		void const *vertex_data = (packed.empty() ? static_cast< void const * >(welded.data()) : static_cast< void const * >(packed.data()));
+		size_t bytes = (packed.empty() ? welded.size() * sizeof(welded[0]) : packed.size() * sizeof(packed[0]));
+
+		if (rtg.configuration.debug) {
+			std::cout << "Object vertices use " << bytes << " bytes (" << (packed.empty() ? "float" : "packed") << ")." << std::endl;
+		}
 
 		object_vertices = rtg.helpers.create_buffer(
-			bytes,
+			std::max< size_t >(bytes, 4), //(buffers can't be empty)
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			Helpers::Unmapped
 		);
 
 		//copy data to buffer:
-		rtg.helpers.transfer_to_buffer(vertices.data(), bytes, object_vertices);
+		if (bytes) {
+			uploads.buffer(vertex_data, bytes, object_vertices);
+		}
+
+		size_t index_bytes = (object_index_type == VK_INDEX_TYPE_UINT16 ? indices_16.size() * sizeof(uint16_t) : indices_32.size() * sizeof(uint32_t));
+		object_indices = rtg.helpers.create_buffer(
+			std::max< size_t >(index_bytes, 4), //(buffers can't be empty)
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped
+		);
+		if (index_bytes) {
+			uploads.buffer(object_index_type == VK_INDEX_TYPE_UINT16 ? static_cast< void const * >(indices_16.data()) : static_cast< void const * >(indices_32.data()), index_bytes, object_indices);
+		}
 	}
 
 	{//make some textures
+		//image files are decoded (and RGBE-converted) concurrently on the thread pool while this thread creates
+		//the images in scene order and stages their pixels into the upload batch
 		textures.reserve(scene.textures.size()); // index 0-4 is the default textures
 
 		// all images loaded should be flipped as s72 file format has the image origin at bottom left while stbi load is top left
 		stbi_set_flip_vertically_on_load(true);
 
+		struct DecodedTexture {
+			int width = 0, height = 0;
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			std::unique_ptr< unsigned char, void(*)(void *) > image{nullptr, stbi_image_free};
+			std::vector< uint32_t > converted; //E5B9G9R9 pixels for RGBE sources
+			void *data() { return converted.empty() ? static_cast< void * >(image.get()) : static_cast< void * >(converted.data()); }
+			size_t size = 0;
+			double decode_ms = 0.0;
+		};
+
+		std::vector< std::future< DecodedTexture > > decoded(scene.textures.size());
 		for (uint32_t i = 0; i < scene.textures.size(); ++i) {
-			Scene::Texture& cur_texture = scene.textures[i];
-			if (cur_texture.has_src) {
-				int width,height,n;
-				unsigned char* image;
-				std::string source = std::get<std::string>(cur_texture.value);
-				
+			Scene::Texture const &cur_texture = scene.textures[i];
+			if (!cur_texture.has_src) continue;
+			auto decode = std::make_shared< std::packaged_task< DecodedTexture() > >([path = scene.scene_path + "/" + std::get<std::string>(cur_texture.value), cur_texture]() {
+				auto before = std::chrono::high_resolution_clock::now();
+				DecodedTexture ret;
+				int n;
 				if (cur_texture.single_channel) { // just read the r value
 					assert(cur_texture.format != Scene::Texture::RGBE);
-					VkFormat format = cur_texture.format == Scene::Texture::Linear ? VK_FORMAT_R8_UNORM : VK_FORMAT_R8_SRGB;
-					image = stbi_load((scene.scene_path +"/"+ source).c_str(), &width, &height, &n, 1);
-					if (image == NULL) throw std::runtime_error("Error loading texture " + scene.scene_path + "/" + source);
-					textures.emplace_back(rtg.helpers.create_image(
-						VkExtent2D{ .width = uint32_t(width) , .height = uint32_t(height) }, //size of image
-						format,
-						VK_IMAGE_TILING_OPTIMAL,
-						VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
-						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
-						Helpers::Unmapped
-					));
-					
-					rtg.helpers.transfer_to_image(image, sizeof(image[0]) * width*height, textures.back());
-				}
-				else {
-					image = stbi_load((scene.scene_path +"/"+ source).c_str(), &width, &height, &n, 4);
-					if (image == NULL) throw std::runtime_error("Error loading texture " + scene.scene_path + "/" + source);		
+					ret.format = cur_texture.format == Scene::Texture::Linear ? VK_FORMAT_R8_UNORM : VK_FORMAT_R8_SRGB;
+					ret.image.reset(stbi_load(path.c_str(), &ret.width, &ret.height, &n, 1));
+					if (!ret.image) throw std::runtime_error("Error loading texture " + path);
+					ret.size = sizeof(unsigned char) * ret.width * ret.height;
+				} else {
+					ret.image.reset(stbi_load(path.c_str(), &ret.width, &ret.height, &n, 4));
+					if (!ret.image) throw std::runtime_error("Error loading texture " + path);
 					if (cur_texture.format == Scene::Texture::RGBE) {
-						std::vector<uint32_t> converted_image(width * height);
-						for (uint32_t pixel_i = 0; pixel_i< uint32_t(width * height); ++pixel_i) {
+						unsigned char const *image = ret.image.get();
+						ret.converted.resize(size_t(ret.width) * ret.height);
+						for (uint32_t pixel_i = 0; pixel_i< uint32_t(ret.width * ret.height); ++pixel_i) {
 							glm::u8vec4 rgbe_pixel = glm::u8vec4(image[4*pixel_i], image[4*pixel_i + 1], image[4*pixel_i + 2], image[4*pixel_i + 3]);
-							converted_image[pixel_i] = rgbe_to_E5B9G9R9(rgbe_pixel);
+							ret.converted[pixel_i] = rgbe_to_E5B9G9R9(rgbe_pixel);
 						}
-						textures.emplace_back(rtg.helpers.create_image(
-							VkExtent2D{ .width = uint32_t(width) , .height = uint32_t(height) }, //size of image
-							VK_FORMAT_E5B9G9R9_UFLOAT_PACK32,
-							VK_IMAGE_TILING_OPTIMAL,
-							VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
-							VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
-							Helpers::Unmapped
-						));
-						
-						rtg.helpers.transfer_to_image(converted_image.data(), sizeof(converted_image[0])*width*height, textures.back());
-					}
-					else {
-						VkFormat format = cur_texture.format == Scene::Texture::sRGB ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
-						textures.emplace_back(rtg.helpers.create_image(
-							VkExtent2D{ .width = uint32_t(width) , .height = uint32_t(height) }, //size of image
-							format, 
-							VK_IMAGE_TILING_OPTIMAL,
-							VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
-							VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
-							Helpers::Unmapped
-						));
-						
-						rtg.helpers.transfer_to_image(image, sizeof(image[0]) * width*height*4, textures.back());
+						ret.image.reset();
+						ret.format = VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
+						ret.size = sizeof(uint32_t) * ret.converted.size();
+					} else {
+						ret.format = cur_texture.format == Scene::Texture::sRGB ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+						ret.size = sizeof(unsigned char) * ret.width * ret.height * 4;
 					}
 				}
-				//free image:
-				stbi_image_free(image);
+				ret.decode_ms = std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+				return ret;
+			});
+			decoded[i] = decode->get_future();
+			thread_pool.submit([decode]() { (*decode)(); });
+		}
+
+		for (uint32_t i = 0; i < scene.textures.size(); ++i) {
+			Scene::Texture& cur_texture = scene.textures[i];
+			if (cur_texture.has_src) {
+				DecodedTexture pixels = decoded[i].get(); //(rethrows decode errors)
+				textures.emplace_back(rtg.helpers.create_image(
+					VkExtent2D{ .width = uint32_t(pixels.width) , .height = uint32_t(pixels.height) }, //size of image
+					pixels.format,
+					VK_IMAGE_TILING_OPTIMAL,
+					VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
+					Helpers::Unmapped
+				));
+				//(the copy itself runs with the rest of the batch; its GPU time is listed by uploads.wait() under this name)
+				auto before = std::chrono::high_resolution_clock::now();
+				uploads.image(pixels.data(), pixels.size, textures.back(), std::get<std::string>(cur_texture.value));
+				double stage_ms = std::chrono::duration< double, std::milli >(std::chrono::high_resolution_clock::now() - before).count();
+				if (rtg.configuration.debug) {
+					std::cout << "Texture " << std::get<std::string>(cur_texture.value)
+					          << " (" << pixels.width << "x" << pixels.height << "): decode " << pixels.decode_ms
+					          << " ms, copy to staging memory " << stage_ms << " ms" << std::endl;
+				}
 			}
 			else {
 				if (cur_texture.single_channel) {
@@ -1180,7 +1398,7 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 					));
 
 					//transfer data:
-					rtg.helpers.transfer_to_image(&value, sizeof(uint8_t), textures.back());
+					uploads.image(&value, sizeof(uint8_t), textures.back());
 				}
 				else {
 					glm::vec3 value = std::get<glm::vec3>(cur_texture.value);
@@ -1196,10 +1414,13 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 					));
 
 					//transfer data:
-					rtg.helpers.transfer_to_image(&data, sizeof(uint8_t) * 4, textures.back());
+					uploads.image(&data, sizeof(uint8_t) * 4, textures.back());
 				}
 			}
 		}
+
+		//every image now exists, so the copies can start while descriptors are set up:
+		uploads.submit();
 	}
 
 	{//make image views for the textures
@@ -1429,6 +1650,13 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 		debug_camera.type = DebugCamera;
 
 	}
+
+	//static resources must be resident before the first frame:
+	uploads.wait();
+
+	if (rtg.configuration.debug) {
+		rtg.helpers.dump_memory_stats();
+	}
 }
 
 RTGRenderer::~RTGRenderer() {
@@ -1528,8 +1756,21 @@ RTGRenderer::~RTGRenderer() {
 	shadow_pipeline.destroy(rtg);
 	cloud_pipeline.destroy(rtg);
 	cloud_lightgrid_pipeline.destroy(rtg);
+	cull_pipeline.destroy(rtg);
+	depth_pyramid_pipeline.destroy(rtg);
+	light_cluster_pipeline.destroy(rtg);
+
+	if (depth_pyramid_sampler != VK_NULL_HANDLE) {
+		vkDestroySampler(rtg.device, depth_pyramid_sampler, nullptr);
+		depth_pyramid_sampler = VK_NULL_HANDLE;
+	}
+
+	if (occlusion_visibility.handle != VK_NULL_HANDLE) {
+		rtg.helpers.destroy_buffer(std::move(occlusion_visibility));
+	}
 	
 	rtg.helpers.destroy_buffer(std::move(object_vertices));
+	rtg.helpers.destroy_buffer(std::move(object_indices));
 
 	if (shadow_sampler) {
 		vkDestroySampler(rtg.device, shadow_sampler, nullptr);
@@ -1560,49 +1801,23 @@ RTGRenderer::~RTGRenderer() {
 			workspace.command_buffer = VK_NULL_HANDLE;
 		}
 
-		if (workspace.lines_vertices_src.handle != VK_NULL_HANDLE) {
-		rtg.helpers.destroy_buffer(std::move(workspace.lines_vertices_src));
-		}
-		if (workspace.lines_vertices.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.lines_vertices));
-		}
-		if (workspace.Camera_src.handle != VK_NULL_HANDLE) {
-				rtg.helpers.destroy_buffer(std::move(workspace.Camera_src));
-			}
-		if (workspace.Camera.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.Camera));
-		}
-		// Camera descriptors are freed when the pool is destroyed
-
-		if (workspace.Cloud_World_src.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.Cloud_World_src));
-		}
-		if (workspace.Cloud_World.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.Cloud_World));
+		for (Workspace::RecordingPool &pool : workspace.recording_pools) {
+			//(also frees the secondaries)
+			vkDestroyCommandPool(rtg.device, pool.handle, nullptr);
 		}
+		workspace.recording_pools.clear();
 
-		if (workspace.World_src.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.World_src));
-		}
-		if (workspace.World.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.World));
-		}
+		rtg.helpers.destroy_stream_buffer(std::move(workspace.stream));
+		//Camera, World, Transforms descriptors are freed when the pool is destroyed
 
-		if (workspace.Light_src.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.Light_src));
-		}
-		if (workspace.Light.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.Light));
+		if (workspace.Light_clusters.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.Light_clusters));
 		}
-		//World descriptors freed when pool is destroyed.
 
-		if (workspace.Transforms_src.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.Transforms_src));
+		for (Helpers::AllocatedBuffer &buffer : workspace.retired_buffers) {
+			rtg.helpers.destroy_buffer(std::move(buffer));
 		}
-		if (workspace.Transforms.handle != VK_NULL_HANDLE) {
-			rtg.helpers.destroy_buffer(std::move(workspace.Transforms));
-		}
-		//Transforms_descriptors freed when pool is destroyed.
+		workspace.retired_buffers.clear();
 
 		if (workspace.Cloud_lightgrid.handle) {
 			rtg.helpers.destroy_image_3D(std::move(workspace.Cloud_lightgrid));
@@ -1644,6 +1859,11 @@ RTGRenderer::~RTGRenderer() {
 		vkDestroyRenderPass(rtg.device, render_pass, nullptr);
 		render_pass = VK_NULL_HANDLE;
 	}
+
+	if (render_pass_resume != VK_NULL_HANDLE) {
+		vkDestroyRenderPass(rtg.device, render_pass_resume, nullptr);
+		render_pass_resume = VK_NULL_HANDLE;
+	}
 }
 
 void RTGRenderer::on_swapchain(RTG &rtg_, RTG::SwapchainEvent const &swapchain) {
@@ -1698,6 +1918,69 @@ void RTGRenderer::on_swapchain(RTG &rtg_, RTG::SwapchainEvent const &swapchain)
 	}
 	std::cout<< "There are "<< swapchain.image_views.size() << " images in the swapchain" <<std::endl;
 
+	if (rtg.configuration.culling_settings >= 2) {//depth pyramid (the culling pass binds it in both GPU culling modes):
+		VkExtent2D extent{
+			.width = std::bit_floor(swapchain.extent.width),
+			.height = std::bit_floor(swapchain.extent.height),
+		};
+		depth_pyramid_levels = std::min(uint32_t(std::bit_width(std::max(extent.width, extent.height))), DepthPyramidMaxLevels);
+		depth_pyramid = rtg.helpers.create_image(
+			extent,
+			VK_FORMAT_R32_SFLOAT,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, //built by compute, read by the culling pass
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped,
+			1, depth_pyramid_levels
+		);
+
+		for (uint32_t level = 0; level <= depth_pyramid_levels; ++level) {
+			//(the last view covers every level)
+			bool all_levels = (level == depth_pyramid_levels);
+			VkImageViewCreateInfo create_info{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.image = depth_pyramid.handle,
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = depth_pyramid.format,
+				.subresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = (all_levels ? 0 : level),
+					.levelCount = (all_levels ? depth_pyramid_levels : 1),
+					.baseArrayLayer = 0,
+					.layerCount = 1
+				},
+			};
+			VK(vkCreateImageView(rtg.device, &create_info, nullptr, all_levels ? &depth_pyramid_view : &depth_pyramid_level_views[level]));
+		}
+
+		//level l is built from level l - 1, and level 0 from the depth image:
+		std::array< VkDescriptorImageInfo, 2 * DepthPyramidMaxLevels > image_infos;
+		std::array< VkWriteDescriptorSet, 2 * DepthPyramidMaxLevels > writes;
+		for (uint32_t level = 0; level < depth_pyramid_levels; ++level) {
+			image_infos[2 * level + 0] = VkDescriptorImageInfo{
+				.sampler = depth_pyramid_sampler,
+				.imageView = (level == 0 ? swapchain_depth_image_view : depth_pyramid_level_views[level - 1]),
+				.imageLayout = (level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL),
+			};
+			image_infos[2 * level + 1] = VkDescriptorImageInfo{
+				.imageView = depth_pyramid_level_views[level],
+				.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+			};
+			for (uint32_t b = 0; b < 2; ++b) {
+				writes[2 * level + b] = VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.dstSet = DepthPyramid_descriptors[level],
+					.dstBinding = b,
+					.dstArrayElement = 0,
+					.descriptorCount = 1,
+					.descriptorType = (b == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE),
+					.pImageInfo = &image_infos[2 * level + b],
+				};
+			}
+		}
+		vkUpdateDescriptorSets(rtg.device, 2 * depth_pyramid_levels, writes.data(), 0, nullptr);
+	}
+
 	// target image for cloud rendering
 	for (auto& workspace : workspaces) {
 		workspace.Cloud_target = rtg.helpers.create_image(
@@ -1743,6 +2026,17 @@ void RTGRenderer::destroy_framebuffers() {
 
 	rtg.helpers.destroy_image(std::move(swapchain_depth_image));
 
+	if (depth_pyramid.handle != VK_NULL_HANDLE) {
+		for (uint32_t level = 0; level < depth_pyramid_levels; ++level) {
+			vkDestroyImageView(rtg.device, depth_pyramid_level_views[level], nullptr);
+			depth_pyramid_level_views[level] = VK_NULL_HANDLE;
+		}
+		vkDestroyImageView(rtg.device, depth_pyramid_view, nullptr);
+		depth_pyramid_view = VK_NULL_HANDLE;
+		rtg.helpers.destroy_image(std::move(depth_pyramid));
+		depth_pyramid_levels = 0;
+	}
+
 	for (auto& workspace : workspaces) {
 		if (workspace.Cloud_target_view) {
 			vkDestroyImageView(rtg.device, workspace.Cloud_target_view, nullptr);
@@ -1755,10 +2049,170 @@ void RTGRenderer::destroy_framebuffers() {
 }
 
 
-void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
-	//assert that parameters are valid:
-	assert(&rtg == &rtg_);
-	assert(render_params.workspace_index < workspaces.size());
+VkDeviceSize RTGRenderer::frame_stream_bytes(Workspace const &workspace, VkDeviceSize lines_bytes, VkDeviceSize extra_bytes) const {
+	Helpers::StreamBuffer const &stream = workspace.stream;
+	return stream.padded(sizeof(LinesPipeline::Camera))
+	     + stream.padded(sizeof(LambertianPipeline::World))
+	     + stream.padded(sizeof(CloudPipeline::CloudWorld))
+	     + stream.padded(light_info.sphere_light_alignment + light_info.spot_light_size)
+	     + stream.padded(lines_bytes)
+	     + stream.padded(extra_bytes)
+	     + workspace.Transforms_capacity;
+}
+
+void RTGRenderer::write_stream_descriptors(Workspace &workspace) {
+	//descriptor offsets are relative to the block each frame binds, so only the ranges matter here:
+	VkDescriptorBufferInfo Camera_info{
+		.buffer = workspace.stream.buffer.handle,
+		.offset = 0,
+		.range = sizeof(LinesPipeline::Camera),
+	};
+
+	VkDescriptorBufferInfo World_info{
+		.buffer = workspace.stream.buffer.handle,
+		.offset = 0,
+		.range = sizeof(LambertianPipeline::World),
+	};
+
+	//the three light arrays share one block (and one dynamic offset):
+	VkDescriptorBufferInfo SunLight_info{
+		.buffer = workspace.stream.buffer.handle,
+		.offset = 0,
+		.range = light_info.sun_light_size,
+	};
+	VkDescriptorBufferInfo SphereLight_info{
+		.buffer = workspace.stream.buffer.handle,
+		.offset = light_info.sun_light_alignment,
+		.range = light_info.sphere_light_size,
+	};
+	VkDescriptorBufferInfo SpotLight_info{
+		.buffer = workspace.stream.buffer.handle,
+		.offset = light_info.sphere_light_alignment,
+		.range = light_info.spot_light_size,
+	};
+
+	VkDescriptorBufferInfo Transforms_info{
+		.buffer = workspace.stream.buffer.handle,
+		.offset = 0,
+		.range = workspace.Transforms_capacity,
+	};
+
+	VkDescriptorBufferInfo Cloud_World_info{
+		.buffer = workspace.stream.buffer.handle,
+		.offset = 0,
+		.range = sizeof(CloudPipeline::CloudWorld),
+	};
+
+	std::vector< VkWriteDescriptorSet > writes{
+		VkWriteDescriptorSet{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = workspace.Camera_descriptors,
+			.dstBinding = 0,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			.pBufferInfo = &Camera_info,
+		},
+		VkWriteDescriptorSet{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = workspace.World_descriptors,
+			.dstBinding = 0,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			.pBufferInfo = &World_info,
+		},
+		VkWriteDescriptorSet{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = workspace.World_descriptors,
+			.dstBinding = 3,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			.pBufferInfo = &SunLight_info,
+		},
+		VkWriteDescriptorSet{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = workspace.World_descriptors,
+			.dstBinding = 4,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			.pBufferInfo = &SphereLight_info,
+		},
+		VkWriteDescriptorSet{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = workspace.World_descriptors,
+			.dstBinding = 5,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			.pBufferInfo = &SpotLight_info,
+		},
+		VkWriteDescriptorSet{
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = workspace.Transforms_descriptors,
+			.dstBinding = 0,
+			.dstArrayElement = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			.pBufferInfo = &Transforms_info,
+		},
+	};
+
+	if (scene.has_cloud) {
+		for (VkDescriptorSet set : {workspace.Cloud_World_descriptors, workspace.Cloud_LightGrid_World_descriptors}) {
+			writes.emplace_back(VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = set,
+				.dstBinding = 1,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+				.pBufferInfo = &Cloud_World_info,
+			});
+		}
+	}
+
+	vkUpdateDescriptorSets(
+		rtg.device,
+		uint32_t(writes.size()), writes.data(), //descriptorWrites count, data
+		0, nullptr //descriptorCopies count, data
+	);
+}
+
+VkCommandBuffer RTGRenderer::begin_secondary(Workspace &workspace, VkRenderPass render_pass, VkFramebuffer framebuffer) {
+	Workspace::RecordingPool &pool = workspace.recording_pools.at(ThreadPool::thread_index());
+	if (pool.used == pool.secondaries.size()) {
+		VkCommandBufferAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = pool.handle,
+			.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+			.commandBufferCount = 1,
+		};
+		VK(vkAllocateCommandBuffers(rtg.device, &alloc_info, &pool.secondaries.emplace_back()));
+	}
+	VkCommandBuffer command_buffer = pool.secondaries[pool.used++];
+
+	VkCommandBufferInheritanceInfo inheritance_info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+		.renderPass = render_pass,
+		.subpass = 0,
+		.framebuffer = framebuffer,
+	};
+	VkCommandBufferBeginInfo begin_info{
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+		.pInheritanceInfo = &inheritance_info,
+	};
+	VK(vkBeginCommandBuffer(command_buffer, &begin_info));
+	return command_buffer;
+}
+
+void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
+	//assert that parameters are valid:
+	assert(&rtg == &rtg_);
+	assert(render_params.workspace_index < workspaces.size());
 	assert(render_params.image_index < swapchain_framebuffers.size());
 
 	// //prevent faulty attempt to render when the swapchain has no area
@@ -1770,6 +2224,16 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 
 	//reset the command buffer (clear old commands):
 	VK(vkResetCommandBuffer(workspace.command_buffer, 0));
+	for (Workspace::RecordingPool &pool : workspace.recording_pools) {
+		VK(vkResetCommandPool(rtg.device, pool.handle, 0));
+		pool.used = 0;
+	}
+
+	//buffers retired the last time this workspace rendered are no longer in use:
+	for (Helpers::AllocatedBuffer &buffer : workspace.retired_buffers) {
+		rtg.helpers.destroy_buffer(std::move(buffer));
+	}
+	workspace.retired_buffers.clear();
 
 	{//begin recording:
 		VkCommandBufferBeginInfo begine_info{
@@ -1779,112 +2243,597 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 		VK(vkBeginCommandBuffer(workspace.command_buffer, &begine_info));
 	}
 
+	//per-frame data is written straight into this workspace's stream (safe: RTG waited on the workspace's fence before
+	// calling render) and bound at these offsets; host-coherent writes are visible to the GPU once the work is submitted:
+	struct {
+		VkDeviceSize Camera = 0;
+		VkDeviceSize World = 0;
+		VkDeviceSize Cloud_World = 0;
+		VkDeviceSize Lights = 0;
+		VkDeviceSize lines_vertices = 0;
+		VkDeviceSize indirect_commands = 0;
+		VkDeviceSize indirect_counts = 0; //(--culling gpu) commands written per batch
+		VkDeviceSize Cull_Instances = 0;
+		VkDeviceSize Cull_Planes = 0;
+		VkDeviceSize Cull_Batch_First = 0;
+		VkDeviceSize Transforms = 0;
+		VkDeviceSize View_Transforms = 0; //the view's instances' transforms, in in_view_instances order
+		VkDeviceSize Light_clusters = 0; //(--light-binning cpu) the cluster lists binned in update, copied to workspace.Light_clusters
+	} stream_offsets;
+
+	bool cpu_light_binning = (rtg.configuration.light_binning == 1);
+
+	//--culling gpu always draws through indirect commands, since only the GPU knows what is visible:
+	bool gpu_culling = (rtg.configuration.culling_settings >= 2);
+	bool occlusion_culling = (rtg.configuration.culling_settings == 3);
+	bool indirect = (gpu_culling || rtg.configuration.draw_mode == 1);
+
+	std::array<std::vector<ObjectInstance> const *, 4> instances{&lambertian_instances, &environment_instances, &mirror_instances, &pbr_instances};
+	//instances of all pipelines share the Transforms array, so each pipeline's firstInstance is shifted by the ones before it:
+	std::array<uint32_t, 4> index_offset{};
+	for (uint32_t m = 1; m < 4; ++m) {
+		index_offset[m] = index_offset[m - 1] + uint32_t(instances[m - 1]->size());
+	}
+	uint32_t instance_count = index_offset[3] + uint32_t(instances[3]->size());
+	//the main pass draws each run of instances with the same material and mesh as one instanced draw, so it reads a copy of
+	// the transforms in in_view_instances order (where every run is contiguous); each pipeline's list starts at view_offset:
+	std::array<uint32_t, 4> view_offset{};
+	for (uint32_t m = 1; m < 4; ++m) {
+		view_offset[m] = view_offset[m - 1] + uint32_t(in_view_instances[m - 1].size());
+	}
+	uint32_t view_count = view_offset[3] + uint32_t(in_view_instances[3].size());
+	//length of the run of instances sharing a material and mesh that starts at position i of in_view_instances[m]:
+	auto view_run = [&](uint32_t m, uint32_t i) {
+		std::vector<uint32_t> const &list = in_view_instances[m];
+		ObjectInstance const &inst = (*instances[m])[list[i]];
+		uint32_t end = i + 1;
+		while (end < list.size()) {
+			ObjectInstance const &next = (*instances[m])[list[end]];
+			if (next.material_index != inst.material_index || next.mesh_index != inst.mesh_index) break;
+			++end;
+		}
+		return end - i;
+	};
+	uint32_t cull_view_batches = 0; //(--culling gpu) batches in the view frustum; the spot light frustums' follow
+	uint32_t cull_late_batches = 0; //(--culling occlusion) first late phase batch
+	uint32_t cull_commands = 0; //(--culling gpu) room for commands in all batches
+
+	if (rtg.configuration.draw_mode == 1 && !gpu_culling) {//build indirect draw commands: one batch per (pipeline, material) in view, one per spot light frustum
+		auto command = [&](uint32_t m, uint32_t index) {
+			ObjectInstance const &inst = (*instances[m])[index];
+			return VkDrawIndexedIndirectCommand{
+				.indexCount = inst.vertices.index_count,
+				.instanceCount = 1,
+				.firstIndex = inst.vertices.first_index,
+				.vertexOffset = inst.vertices.vertex_offset,
+				.firstInstance = index + index_offset[m],
+			};
+		};
+
+		indirect_commands.clear();
+		for (uint32_t m = 0; m < 4; ++m) {
+			//update() sorted the list by draw_sort_key, so every material is one run (a batch), and each of its meshes one instanced command:
+			indirect_batches[m].clear();
+			for (uint32_t i = 0; i < in_view_instances[m].size(); ) {
+				ObjectInstance const &inst = (*instances[m])[in_view_instances[m][i]];
+				if (indirect_batches[m].empty() || indirect_batches[m].back().material_index != inst.material_index) {
+					indirect_batches[m].emplace_back(IndirectBatch{
+						.material_index = inst.material_index,
+						.first = uint32_t(indirect_commands.size()),
+					});
+				}
+				uint32_t run = view_run(m, i);
+				indirect_batches[m].back().count += 1;
+				indirect_commands.emplace_back(VkDrawIndexedIndirectCommand{
+					.indexCount = inst.vertices.index_count,
+					.instanceCount = run,
+					.firstIndex = inst.vertices.first_index,
+					.vertexOffset = inst.vertices.vertex_offset,
+					.firstInstance = view_offset[m] + i, //(into View_Transforms)
+				});
+				i += run;
+			}
+		}
+
+		shadow_indirect_batches.clear();
+		for (auto const &in_spot_light : in_spot_light_instances) {
+			IndirectBatch &batch = shadow_indirect_batches.emplace_back(IndirectBatch{
+				.first = uint32_t(indirect_commands.size()),
+			});
+			for (uint32_t m = 0; m < 4; ++m) {
+				for (uint32_t index : in_spot_light[m]) {
+					indirect_commands.emplace_back(command(m, index));
+				}
+			}
+			batch.count = uint32_t(indirect_commands.size()) - batch.first;
+		}
+	} else if (gpu_culling) {//lay out room for the culling pass's commands: one batch per (pipeline, material), one per spot light frustum
+		cull_instances.clear();
+		cull_batch_first.clear();
+		for (uint32_t m = 0; m < 4; ++m) {
+			//every instance may be visible, so each batch gets room for all of its material's instances:
+			cull_material_batch.assign(material_descriptors.size(), -1U);
+			indirect_batches[m].clear();
+			for (ObjectInstance const &inst : *instances[m]) {
+				uint32_t &batch_index = cull_material_batch[inst.material_index];
+				if (batch_index == -1U) {
+					batch_index = uint32_t(indirect_batches[m].size());
+					indirect_batches[m].emplace_back(IndirectBatch{
+						.material_index = inst.material_index,
+						.slot = uint32_t(cull_batch_first.size()),
+					});
+					cull_batch_first.emplace_back(0);
+				}
+				IndirectBatch &batch = indirect_batches[m][batch_index];
+				cull_instances.emplace_back(CullPipeline::Instance{
+					.FIRST_INDEX = inst.vertices.first_index,
+					.INDEX_COUNT = inst.vertices.index_count,
+					.VERTEX_OFFSET = inst.vertices.vertex_offset,
+					.BATCH = batch.slot,
+					.VIEW_SLOT = batch.count,
+				});
+				batch.count += 1;
+			}
+			for (IndirectBatch &batch : indirect_batches[m]) {
+				batch.first = cull_commands;
+				cull_batch_first[batch.slot] = cull_commands;
+				cull_commands += batch.count;
+			}
+		}
+		cull_view_batches = uint32_t(cull_batch_first.size());
+
+		shadow_indirect_batches.clear();
+		for (uint32_t f = 0; f < in_spot_light_instances.size(); ++f) {
+			shadow_indirect_batches.emplace_back(IndirectBatch{
+				.first = cull_commands,
+				.count = instance_count,
+				.slot = uint32_t(cull_batch_first.size()),
+			});
+			cull_batch_first.emplace_back(cull_commands);
+			cull_commands += instance_count;
+		}
+
+		//the late phase draws the instances the early phase missed, batched like the early phase:
+		cull_late_batches = uint32_t(cull_batch_first.size());
+		for (uint32_t m = 0; m < 4; ++m) {
+			late_indirect_batches[m].clear();
+			if (!occlusion_culling) continue;
+			for (IndirectBatch const &batch : indirect_batches[m]) {
+				late_indirect_batches[m].emplace_back(IndirectBatch{
+					.material_index = batch.material_index,
+					.first = cull_commands,
+					.count = batch.count,
+					.slot = cull_late_batches + batch.slot,
+				});
+				cull_batch_first.emplace_back(cull_commands);
+				cull_commands += batch.count;
+			}
+		}
+
+		//boxes come from the culling items (one per instance):
+		assert(item_instances.size() == instance_count);
+		for (uint32_t item = 0; item < item_instances.size(); ++item) {
+			auto [m, index] = item_instances[item];
+			OBB const &obb = item_obbs[item];
+			CullPipeline::Instance &out = cull_instances[index_offset[m] + index];
+			out.CENTER = glm::vec4(obb.center, 1.0f);
+			for (uint32_t a = 0; a < 3; ++a) {
+				out.HALF_AXES[a] = glm::vec4(obb.extents[a] * obb.axes[a], 0.0f);
+			}
+		}
+	}
+
+	{//lay out this frame's blocks in the stream:
+		bool rewrite_descriptors = false;
+
+		VkDeviceSize transforms_bytes = (lambertian_instances.size() + environment_instances.size() + mirror_instances.size() + pbr_instances.size()) * sizeof(Transform);
+		if (transforms_bytes > workspace.Transforms_capacity) {
+			//round to next multiple of 64k to avoid rewriting descriptors continuously if the instance count grows slowly:
+			workspace.Transforms_capacity = ((transforms_bytes + 0xffff) / 0x10000) * 0x10000;
+			if (workspace.Transforms_capacity > rtg.device_properties.limits.maxStorageBufferRange) {
+				throw std::runtime_error("Object transforms (" + std::to_string(transforms_bytes) + " bytes) exceed maxStorageBufferRange.");
+			}
+			rewrite_descriptors = true;
+		}
+
+		VkDeviceSize lines_bytes = lines_vertices.size() * sizeof(lines_vertices[0]);
+		VkDeviceSize indirect_bytes = 0, counts_bytes = 0, cull_bytes = 0;
+		if (gpu_culling) {
+			indirect_bytes = cull_commands * sizeof(VkDrawIndexedIndirectCommand);
+			counts_bytes = cull_batch_first.size() * sizeof(uint32_t);
+			cull_bytes = workspace.stream.padded(cull_instances.size() * sizeof(CullPipeline::Instance))
+			           + workspace.stream.padded(cull_frustum_planes.size() * sizeof(glm::vec4))
+			           + workspace.stream.padded(cull_batch_first.size() * sizeof(uint32_t));
+		} else if (rtg.configuration.draw_mode == 1) {
+			indirect_bytes = indirect_commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+		}
+		VkDeviceSize extra_bytes = workspace.stream.padded(indirect_bytes) + workspace.stream.padded(counts_bytes) + cull_bytes;
+		if (view_count > 0) extra_bytes += workspace.Transforms_capacity; //View_Transforms (bound with the same descriptor)
+		if (cpu_light_binning) extra_bytes += workspace.stream.padded(light_binning.lists.size() * sizeof(uint32_t));
+
+		workspace.stream.rewind();
+		if (rtg.helpers.reserve_stream_buffer(workspace.stream, frame_stream_bytes(workspace, lines_bytes, extra_bytes))) {
+			std::cout << "Re-allocated stream buffer to " << workspace.stream.buffer.size << " bytes." << std::endl;
+			rewrite_descriptors = true;
+		}
+		if (rewrite_descriptors) write_stream_descriptors(workspace);
+
+		stream_offsets.Camera = workspace.stream.allocate(sizeof(LinesPipeline::Camera));
+		stream_offsets.World = workspace.stream.allocate(sizeof(LambertianPipeline::World));
+		stream_offsets.Cloud_World = workspace.stream.allocate(sizeof(CloudPipeline::CloudWorld));
+		stream_offsets.Lights = workspace.stream.allocate(light_info.sphere_light_alignment + light_info.spot_light_size);
+		if (lines_bytes) stream_offsets.lines_vertices = workspace.stream.allocate(lines_bytes);
+		if (gpu_culling && instance_count > 0) {
+			//the culling pass writes the commands; the CPU only zeroes the counts it appends with:
+			stream_offsets.indirect_commands = workspace.stream.allocate(indirect_bytes);
+			stream_offsets.indirect_counts = workspace.stream.allocate(counts_bytes);
+			std::memset(workspace.stream.data(stream_offsets.indirect_counts), 0, counts_bytes);
+			stream_offsets.Cull_Instances = workspace.stream.push(cull_instances.data(), cull_instances.size() * sizeof(CullPipeline::Instance));
+			stream_offsets.Cull_Planes = workspace.stream.push(cull_frustum_planes.data(), cull_frustum_planes.size() * sizeof(glm::vec4));
+			stream_offsets.Cull_Batch_First = workspace.stream.push(cull_batch_first.data(), cull_batch_first.size() * sizeof(uint32_t));
+		} else if (indirect_bytes) {
+			stream_offsets.indirect_commands = workspace.stream.push(indirect_commands.data(), indirect_bytes);
+		}
+		//(the Transforms descriptor's range is the whole capacity, so the block must be that big)
+		stream_offsets.Transforms = workspace.stream.allocate(workspace.Transforms_capacity);
+		if (view_count > 0) stream_offsets.View_Transforms = workspace.stream.allocate(workspace.Transforms_capacity);
+		if (cpu_light_binning) stream_offsets.Light_clusters = workspace.stream.push(light_binning.lists.data(), light_binning.lists.size() * sizeof(uint32_t));
+	}
+
 	//copy transforms, needed for both shadow atlas pass and render pass
 	if (!lambertian_instances.empty() || !environment_instances.empty() || !mirror_instances.empty() || !pbr_instances.empty()) { //upload object transforms:
-		size_t needed_bytes = (lambertian_instances.size() + environment_instances.size() + mirror_instances.size() + pbr_instances.size()) * sizeof(Transform);
-		if (workspace.Transforms_src.handle == VK_NULL_HANDLE || workspace.Transforms_src.size < needed_bytes) {
-			//round to next multiple of 4k to avoid re-allocating continuously if vertex count grows slowly:
-			size_t new_bytes = ((needed_bytes + 4096) / 4096) * 4096;
-			if (workspace.Transforms_src.handle) {
-				rtg.helpers.destroy_buffer(std::move(workspace.Transforms_src));
+		LambertianPipeline::Transform *out = reinterpret_cast< LambertianPipeline::Transform * >(workspace.stream.data(stream_offsets.Transforms)); // Strict aliasing violation, but it doesn't matter
+		for (ObjectInstance const &inst : lambertian_instances) {
+			*out = inst.transform;
+			++out;
+		}
+		for (ObjectInstance const &inst : environment_instances) {
+			*out = inst.transform;
+			++out;
+		}
+		for (ObjectInstance const &inst : mirror_instances) {
+			*out = inst.transform;
+			++out;
+		}
+		for (ObjectInstance const &inst : pbr_instances) {
+			*out = inst.transform;
+			++out;
+		}
+	}
+	if (view_count > 0) { //again in draw order for the main pass:
+		LambertianPipeline::Transform *out = reinterpret_cast< LambertianPipeline::Transform * >(workspace.stream.data(stream_offsets.View_Transforms));
+		for (uint32_t m = 0; m < 4; ++m) {
+			for (uint32_t index : in_view_instances[m]) {
+				*out = (*instances[m])[index].transform;
+				++out;
 			}
-			if (workspace.Transforms.handle) {
-				rtg.helpers.destroy_buffer(std::move(workspace.Transforms));
+		}
+	}
+
+	//--draw-mode indirect: submit a batch of the streamed draw commands (split to respect the device's limits):
+	auto draw_indirect = [&](VkCommandBuffer command_buffer, DrawStats &stats, IndirectBatch const &batch) {
+		if (gpu_culling && rtg.draw_indirect_count) {
+			//the culling pass compacted the visible commands to the front of the batch and counted them:
+			VkDeviceSize offset = stream_offsets.indirect_commands + batch.first * sizeof(VkDrawIndexedIndirectCommand);
+			VkDeviceSize count_offset = stream_offsets.indirect_counts + batch.slot * sizeof(uint32_t);
+			vkCmdDrawIndexedIndirectCount(command_buffer, workspace.stream.buffer.handle, offset, workspace.stream.buffer.handle, count_offset, batch.count, sizeof(VkDrawIndexedIndirectCommand));
+			++stats.draws;
+			return;
+		}
+		uint32_t max_draws = (rtg.enabled_features.multiDrawIndirect ? rtg.device_properties.limits.maxDrawIndirectCount : 1);
+		for (uint32_t done = 0; done < batch.count; ) {
+			uint32_t draws = std::min(batch.count - done, max_draws);
+			VkDeviceSize offset = stream_offsets.indirect_commands + (batch.first + done) * sizeof(VkDrawIndexedIndirectCommand);
+			vkCmdDrawIndexedIndirect(command_buffer, workspace.stream.buffer.handle, offset, draws, sizeof(VkDrawIndexedIndirectCommand));
+			++stats.draws;
+			done += draws;
+		}
+	};
+	//bind each material once and draw all of its instances in 'batches' with the pipeline at 'pipeline_index':
+	auto draw_material_batches = [&](VkCommandBuffer command_buffer, DrawStats &stats, uint32_t pipeline_index, VkPipelineLayout layout, std::array<std::vector<IndirectBatch>, 4> const &batches) {
+		for (IndirectBatch const &batch : batches[pipeline_index]) {
+			vkCmdBindDescriptorSets(
+				command_buffer, //command buffer
+				VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
+				layout, //pipeline layout
+				2, //second set
+				1, &material_descriptors[batch.material_index], //descriptor sets count, ptr
+				0, nullptr //dynamic offsets count, ptr
+			);
+			++stats.material_binds;
+			draw_indirect(command_buffer, stats, batch);
+		}
+	};
+	//direct draws of the view's instances with the pipeline at 'pipeline_index', one instanced draw per run of a mesh:
+	auto draw_view_instances = [&](VkCommandBuffer command_buffer, DrawStats &stats, uint32_t pipeline_index, VkPipelineLayout layout) {
+		std::vector<uint32_t> const &list = in_view_instances[pipeline_index];
+		uint32_t bound_material = -1U;
+		for (uint32_t i = 0; i < list.size(); ) {
+			ObjectInstance const &inst = (*instances[pipeline_index])[list[i]];
+			if (inst.material_index != bound_material) {//bind texture descriptor set (the list is sorted by material, so once per run):
+				vkCmdBindDescriptorSets(
+					command_buffer, //command buffer
+					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
+					layout, //pipeline layout
+					2, //second set
+					1, &material_descriptors[inst.material_index], //descriptor sets count, ptr
+					0, nullptr //dynamic offsets count, ptr
+				);
+				bound_material = inst.material_index;
+				++stats.material_binds;
 			}
-			workspace.Transforms_src = rtg.helpers.create_buffer(
-				new_bytes,
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT, //going to have GPU copy from this memory
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, //host-visible memory, coherent (no special sync needed)
-				Helpers::Mapped //get a pointer to the memory
+			uint32_t run = view_run(pipeline_index, i);
+			vkCmdDrawIndexed(command_buffer, inst.vertices.index_count, run, inst.vertices.first_index, inst.vertices.vertex_offset, view_offset[pipeline_index] + i);
+			++stats.draws;
+			i += run;
+		}
+	};
+
+	//the main pass's viewport (scene cameras keep their aspect ratio, centered in the swapchain):
+	VkRect2D view_rect{
+		.offset = {.x = 0, .y = 0},
+		.extent = rtg.swapchain_extent,
+	};
+	if (view_camera == SceneCamera) {
+		float camera_aspect = scene.cameras[scene.requested_camera_index].aspect; // W / H
+		float actual_aspect = rtg.swapchain_extent.width / float(rtg.swapchain_extent.height);
+		if (actual_aspect < camera_aspect) {
+			view_rect.extent.height = uint32_t(float(view_rect.extent.width) / camera_aspect);
+			view_rect.offset.y += (rtg.swapchain_extent.height - view_rect.extent.height) / 2;
+		}
+		else if (actual_aspect > camera_aspect) {
+			view_rect.extent.width = uint32_t(float(view_rect.extent.height) * camera_aspect);
+			view_rect.offset.x += (rtg.swapchain_extent.width - view_rect.extent.width) / 2;
+		}
+	}
+
+	//--culling occlusion: culling pass push constants, shared by the early and late phases:
+	CullPipeline::Push cull_push{
+		.CLIP_FROM_WORLD = CLIP_FROM_WORLD,
+		.VIEWPORT = glm::vec4(float(view_rect.offset.x), float(view_rect.offset.y), float(view_rect.extent.width), float(view_rect.extent.height)),
+		.PYRAMID_SCALE = glm::vec2(
+			float(depth_pyramid.extent.width) / float(std::max(swapchain_depth_image.extent.width, 1U)),
+			float(depth_pyramid.extent.height) / float(std::max(swapchain_depth_image.extent.height, 1U))
+		),
+		.INSTANCE_COUNT = instance_count,
+		.VIEW_BATCHES = cull_view_batches,
+		.LATE_BATCHES = cull_late_batches,
+		.COMPACT = (rtg.draw_indirect_count ? 1U : 0U),
+		.OCCLUSION = (occlusion_culling ? 1U : 0U),
+		.PHASE = 0,
+	};
+
+	//the draws read the culling pass's commands and counts:
+	auto cull_to_draw_barrier = [&]() {
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+		};
+		vkCmdPipelineBarrier(workspace.command_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, //dstStageMask
+			0, //dependencyFlags
+			1, &barrier, //memoryBarriers (count, data)
+			0, nullptr, //bufferMemoryBarriers (count, data)
+			0, nullptr //imageMemoryBarriers (count, data)
+		);
+	};
+
+	if (gpu_culling && instance_count > 0) {//cull every instance against the view and spot light frustums:
+		if (occlusion_visibility.size < instance_count * sizeof(uint32_t)) {
+			//grow the visibility buffer (rarely: only when instances are added); frames in flight may still use the old one,
+			// so it is retired through this workspace rather than destroyed here:
+			if (occlusion_visibility.handle != VK_NULL_HANDLE) {
+				workspace.retired_buffers.emplace_back(std::move(occlusion_visibility));
+				occlusion_visibility = Helpers::AllocatedBuffer{};
+			}
+			occlusion_visibility = rtg.helpers.create_buffer(
+				((instance_count + 0xfff) / 0x1000) * 0x1000 * sizeof(uint32_t),
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				Helpers::Unmapped
 			);
-			workspace.Transforms = rtg.helpers.create_buffer(
-				new_bytes,
-				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, //going to use as storage buffer, also going to have GPU into this memory
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //GPU-local memory
-				Helpers::Unmapped //don't get a pointer to the memory
+			//(nothing was visible "last frame", so the late phase draws everything this frame)
+			vkCmdFillBuffer(workspace.command_buffer, occlusion_visibility.handle, 0, VK_WHOLE_SIZE, 0);
+			VkMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			};
+			vkCmdPipelineBarrier(workspace.command_buffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, //srcStageMask
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //dstStageMask
+				0, //dependencyFlags
+				1, &barrier, //memoryBarriers (count, data)
+				0, nullptr, //bufferMemoryBarriers (count, data)
+				0, nullptr //imageMemoryBarriers (count, data)
 			);
+		}
 
-			//update the descriptor set:
-			VkDescriptorBufferInfo Transforms_info{
-				.buffer = workspace.Transforms.handle,
+		//the blocks move around the stream every frame, so the set is rewritten each time (the workspace's fence was waited on):
+		std::array<VkDescriptorBufferInfo, 6> buffer_infos{
+			VkDescriptorBufferInfo{
+				.buffer = workspace.stream.buffer.handle,
+				.offset = stream_offsets.Cull_Instances,
+				.range = cull_instances.size() * sizeof(CullPipeline::Instance),
+			},
+			VkDescriptorBufferInfo{
+				.buffer = workspace.stream.buffer.handle,
+				.offset = stream_offsets.Cull_Planes,
+				.range = cull_frustum_planes.size() * sizeof(glm::vec4),
+			},
+			VkDescriptorBufferInfo{
+				.buffer = workspace.stream.buffer.handle,
+				.offset = stream_offsets.Cull_Batch_First,
+				.range = cull_batch_first.size() * sizeof(uint32_t),
+			},
+			VkDescriptorBufferInfo{
+				.buffer = workspace.stream.buffer.handle,
+				.offset = stream_offsets.indirect_commands,
+				.range = cull_commands * sizeof(VkDrawIndexedIndirectCommand),
+			},
+			VkDescriptorBufferInfo{
+				.buffer = workspace.stream.buffer.handle,
+				.offset = stream_offsets.indirect_counts,
+				.range = cull_batch_first.size() * sizeof(uint32_t),
+			},
+			VkDescriptorBufferInfo{
+				.buffer = occlusion_visibility.handle,
 				.offset = 0,
-				.range = workspace.Transforms.size,
+				.range = VK_WHOLE_SIZE,
+			},
+		};
+		VkDescriptorImageInfo pyramid_info{
+			.sampler = depth_pyramid_sampler,
+			.imageView = depth_pyramid_view,
+			.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+		};
+		std::array<VkWriteDescriptorSet, 7> writes;
+		for (uint32_t b = 0; b < writes.size(); ++b) {
+			writes[b] = VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = workspace.Cull_descriptors,
+				.dstBinding = b,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = (b == 6 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER),
+				.pImageInfo = (b == 6 ? &pyramid_info : nullptr),
+				.pBufferInfo = (b == 6 ? nullptr : &buffer_infos[b]),
 			};
+		}
+		vkUpdateDescriptorSets(rtg.device, uint32_t(writes.size()), writes.data(), 0, nullptr);
 
-			std::array< VkWriteDescriptorSet, 1 > writes{
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.dstSet = workspace.Transforms_descriptors,
-					.dstBinding = 0,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-					.pBufferInfo = &Transforms_info,
+		{//the previous frame's late phase wrote the visibility buffer; the pyramid is sampled in GENERAL (and only read
+		 // with --culling occlusion, after this frame rebuilds it):
+			VkMemoryBarrier visibility_barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			};
+			VkImageMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = 0,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = depth_pyramid.handle,
+				.subresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = 0,
+					.levelCount = depth_pyramid_levels,
+					.baseArrayLayer = 0,
+					.layerCount = 1,
 				},
 			};
-
-			vkUpdateDescriptorSets(
-				rtg.device,
-				uint32_t(writes.size()), writes.data(), //descriptorWrites count, data
-				0, nullptr //descriptorCopies count, data
+			vkCmdPipelineBarrier(workspace.command_buffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask (the previous frame's culling)
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //dstStageMask
+				0, //dependencyFlags
+				1, &visibility_barrier, //memoryBarriers (count, data)
+				0, nullptr, //bufferMemoryBarriers (count, data)
+				1, &barrier //imageMemoryBarriers (count, data)
 			);
-
-			std::cout << "Re-allocated object transforms buffers to " << new_bytes << " bytes." << std::endl;
 		}
 
-		assert(workspace.Transforms_src.size == workspace.Transforms.size);
-		assert(workspace.Transforms_src.size >= needed_bytes);
+		vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline.handle);
+		vkCmdBindDescriptorSets(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline.layout, 0, 1, &workspace.Cull_descriptors, 0, nullptr);
 
-		{ //copy transforms into Transforms_src:
-			assert(workspace.Transforms_src.allocation.mapped);
-			LambertianPipeline::Transform *out = reinterpret_cast< LambertianPipeline::Transform * >(workspace.Transforms_src.allocation.data()); // Strict aliasing violation, but it doesn't matter
-			for (ObjectInstance const &inst : lambertian_instances) {
-				*out = inst.transform;
-				++out;
-			}
-			for (ObjectInstance const &inst : environment_instances) {
-				*out = inst.transform;
-				++out;
-			}
-			for (ObjectInstance const &inst : mirror_instances) {
-				*out = inst.transform;
-				++out;
-			}
-			for (ObjectInstance const &inst : pbr_instances) {
-				*out = inst.transform;
-				++out;
-			}
+		cull_push.PHASE = 0;
+		vkCmdPushConstants(workspace.command_buffer, cull_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cull_push), &cull_push);
+
+		uint32_t frustum_count = 1 + uint32_t(in_spot_light_instances.size());
+		vkCmdDispatch(workspace.command_buffer, (instance_count + CullPipeline::WorkgroupSize - 1) / CullPipeline::WorkgroupSize, frustum_count, 1);
+
+		cull_to_draw_barrier();
+	}
+
+	{//assign the sphere and spot lights to the view's clusters (always, since the fragment shaders read every cluster's counts):
+		if (cpu_light_binning) {
+			//(binned in update; copy the lists from the stream)
+			VkBufferCopy copy_region{
+				.srcOffset = stream_offsets.Light_clusters,
+				.dstOffset = 0,
+				.size = light_binning.lists.size() * sizeof(uint32_t),
+			};
+			vkCmdCopyBuffer(workspace.command_buffer, workspace.stream.buffer.handle, workspace.Light_clusters.handle, 1, &copy_region);
+		} else {
+			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, light_cluster_pipeline.handle);
+
+			//(World, lights, and the cluster lists, with the same dynamic offsets as the objects pipelines)
+			std::array< uint32_t, 4 > dynamic_offsets{
+				uint32_t(stream_offsets.World), //binding 0: World
+				uint32_t(stream_offsets.Lights), //binding 3: SunLights
+				uint32_t(stream_offsets.Lights), //binding 4: SphereLights
+				uint32_t(stream_offsets.Lights), //binding 5: SpotLights
+			};
+			vkCmdBindDescriptorSets(
+				workspace.command_buffer, //command buffer
+				VK_PIPELINE_BIND_POINT_COMPUTE, //pipeline bind point
+				light_cluster_pipeline.layout, //pipeline layout
+				0, //first set
+				1, &workspace.World_descriptors, //descriptor sets count, ptr
+				uint32_t(dynamic_offsets.size()), dynamic_offsets.data() //dynamic offsets count, ptr
+			);
+
+			glm::mat4x4 const &clip_from_camera = clip_from_view[view_camera];
+			LightClusterPipeline::Push push{
+				.VIEW_FROM_WORLD = view_from_world[view_camera],
+				.TAN_HALF_FOV = glm::vec2(1.0f / clip_from_camera[0][0], 1.0f / clip_from_camera[1][1]),
+			};
+			vkCmdPushConstants(workspace.command_buffer, light_cluster_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+
+			vkCmdDispatch(workspace.command_buffer, (LightClusterPipeline::ClusterCount + LightClusterPipeline::WorkgroupSize - 1) / LightClusterPipeline::WorkgroupSize, 1, 1);
 		}
 
-		//device-side copy from Transforms_src -> Transforms:
-		VkBufferCopy copy_region{
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = needed_bytes,
+		//the main pass's fragment shaders read the lists:
+		VkMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VkAccessFlags(cpu_light_binning ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_WRITE_BIT),
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
 		};
-		vkCmdCopyBuffer(workspace.command_buffer, workspace.Transforms_src.handle, workspace.Transforms.handle, 1, &copy_region);
+		vkCmdPipelineBarrier(workspace.command_buffer,
+			VkPipelineStageFlags(cpu_light_binning ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT), //srcStageMask
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, //dstStageMask
+			0, //dependencyFlags
+			1, &barrier, //memoryBarriers (count, data)
+			0, nullptr, //bufferMemoryBarriers (count, data)
+			0, nullptr //imageMemoryBarriers (count, data)
+		);
 	}
 
-	VkBufferMemoryBarrier buffer_memory_barrier{
-			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-			.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
-			.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-			.buffer = workspace.Transforms.handle,
-			.size = VK_WHOLE_SIZE, 
-	};
-	vkCmdPipelineBarrier( workspace.command_buffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT, //srcStageMask
-		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, //dstStageMask
-		0, //dependencyFlags
-		0, nullptr, //memoryBarriers (count, data)
-		1, &buffer_memory_barrier, //bufferMemoryBarriers (count, data)
-		0, nullptr //imageMemoryBarriers (count, data)
-	);
-
 	{//shadow atlas pass:
-		std::array<VkClearValue, 1> clear_values{
-			VkClearValue{.depthStencil{.depth = 1.0f, .stencil = 0}},
-		};
+		if (!shadow_atlas_initialized) {//the atlas starts out undefined; move it to the layout the pass starts from (every region gets drawn):
+			VkImageMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = 0,
+				.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+				.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				.image = shadow_atlas_image.handle,
+				.subresourceRange = {
+					.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1
+				},
+			};
+			vkCmdPipelineBarrier(workspace.command_buffer,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, //srcStageMask
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, //dstStageMask
+				0, //dependencyFlags
+				0, nullptr, //memoryBarriers (count, data)
+				0, nullptr, //bufferMemoryBarriers (count, data)
+				1, &barrier //imageMemoryBarriers (count, data)
+			);
+			shadow_hashes.assign(spot_lights.size() + cascades.size(), 0);
+			shadow_atlas_initialized = true;
+		}
+		shadow_hashes.resize(spot_lights.size() + cascades.size(), 0);
+
 		VkRenderPassBeginInfo begin_info{
 			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 			.renderPass = shadow_atlas_pass,
@@ -1893,46 +2842,104 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 				.offset = {.x = 0, .y = 0},
 				.extent = {.width = shadow_atlas_length, .height = shadow_atlas_length},
 			},
-			.clearValueCount = uint32_t(clear_values.size()),
-			.pClearValues = clear_values.data(),
+			.clearValueCount = 0, //(the atlas is loaded; redrawn regions are cleared one by one)
 		};
 
-		vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-		if (!lambertian_instances.empty() || !environment_instances.empty() || !mirror_instances.empty() || !pbr_instances.empty()) {
-			//bind Transforms descriptor set:
-			std::array< VkDescriptorSet, 1 > descriptor_sets{
-				workspace.Transforms_descriptors, //1: Transforms
-			};
-			vkCmdBindDescriptorSets(
-				workspace.command_buffer, //command buffer
-				VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-				shadow_pipeline.layout, //pipeline layout
-				0, //first set
-				uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
-				0, nullptr //dynamic offsets count, ptr
-			);
-		}
-		if (!spot_lights.empty()) {
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadow_pipeline.handle);
+		//the shadow views (spot lights, then sun cascades) are split into chunks, each recorded into its own secondary
+		// command buffer on the thread pool:
+		uint32_t light_count = (spot_lights.empty() ? 0 : uint32_t(scene.spot_lights_sorted_indices.size()));
+		uint32_t shadow_view_count = light_count + uint32_t(cascades.size());
+		uint32_t chunk_size = (shadow_view_count + 4 * (thread_pool.size() + 1) - 1) / (4 * (thread_pool.size() + 1)); //(a few chunks per thread, to even out the load)
+		uint32_t chunk_count = (shadow_view_count == 0 ? 0 : (shadow_view_count + chunk_size - 1) / chunk_size);
+		std::vector<VkCommandBuffer> secondaries(chunk_count);
+		std::vector<DrawStats> chunk_stats(chunk_count);
+		thread_pool.parallel_for(chunk_count, [&](uint32_t chunk) {
+			VkCommandBuffer command_buffer = begin_secondary(workspace, shadow_atlas_pass, shadow_framebuffer);
+			DrawStats &stats = chunk_stats[chunk];
+
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadow_pipeline.handle);
+
+			if (instance_count > 0) {//bind Transforms descriptor set:
+				std::array< VkDescriptorSet, 1 > descriptor_sets{
+					workspace.Transforms_descriptors, //1: Transforms
+				};
+				std::array< uint32_t, 1 > dynamic_offsets{
+					uint32_t(stream_offsets.Transforms),
+				};
+				vkCmdBindDescriptorSets(
+					command_buffer, //command buffer
+					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
+					shadow_pipeline.layout, //pipeline layout
+					0, //first set
+					uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
+					uint32_t(dynamic_offsets.size()), dynamic_offsets.data() //dynamic offsets count, ptr
+				);
+			}
 
-			{//use object_vertices (offset 0) as vertex buffer binding 0:
+			{//use object_vertices (offset 0) as vertex buffer binding 0, with object_indices:
 				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
 				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
-
+				vkCmdBindVertexBuffers(command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+				vkCmdBindIndexBuffer(command_buffer, object_indices.handle, 0, object_index_type);
 			}
-			for (uint32_t i = 0; i < scene.spot_lights_sorted_indices.size(); ++i) {
-				uint32_t light_index = scene.spot_lights_sorted_indices[i].spot_lights_index;
-				ShadowAtlas::Region& region = shadow_atlas.regions[light_index];
-				if (region.size == 0) continue; // skip shadow of size 0
-				spot_lights[light_index].LIGHT_FROM_WORLD = spot_light_from_world[i];
-				spot_lights[light_index].ATLAS_COORD_FROM_WORLD = ShadowAtlas::calculate_shadow_atlas_matrix(spot_light_from_world[i],region,shadow_atlas_length);
+			for (uint32_t i = chunk * chunk_size; i < std::min(shadow_view_count, (chunk + 1) * chunk_size); ++i) {
+				//shadow view i: spot light i, or sun cascade i - light_count (view scene.spot_lights_sorted_indices.size() + cascade):
+				uint32_t view = i;
+				glm::mat4x4 const *light_from_world;
+				ShadowAtlas::Region const *region_ptr;
+				uint32_t hash_index;
+				if (i < light_count) {
+					uint32_t light_index = scene.spot_lights_sorted_indices[i].spot_lights_index;
+					light_from_world = &spot_light_from_world[i];
+					region_ptr = &shadow_atlas.regions[light_index];
+					hash_index = light_index;
+					if (region_ptr->size == 0) { // skip shadow of size 0 (and forget its depth: the square goes to others)
+						shadow_hashes[hash_index] = 0;
+						continue;
+					}
+					//(each light is handled by exactly one chunk, so these writes don't race)
+					spot_lights[light_index].LIGHT_FROM_WORLD = spot_light_from_world[i];
+					spot_lights[light_index].ATLAS_COORD_FROM_WORLD = ShadowAtlas::calculate_shadow_atlas_matrix(spot_light_from_world[i],*region_ptr,shadow_atlas_length);
+				} else {
+					uint32_t cascade = i - light_count;
+					view = uint32_t(scene.spot_lights_sorted_indices.size()) + cascade;
+					light_from_world = &cascades[cascade].light_from_world;
+					region_ptr = &shadow_atlas.cascade_regions[cascade];
+					hash_index = uint32_t(spot_lights.size()) + cascade;
+					if (region_ptr->size == 0) {
+						shadow_hashes[hash_index] = 0;
+						continue;
+					}
+				}
+				ShadowAtlas::Region const &region = *region_ptr;
+
+				{//keep the region's depth if its light transform, region, or the instances it sees haven't changed:
+					uint64_t hash = hash_words(0x9e3779b97f4a7c15ull, light_from_world, sizeof(*light_from_world));
+					hash = hash_words(hash, &region, sizeof(region));
+					if (gpu_culling) {
+						hash = hash_words(hash, &shadow_view_instance_hashes[view], sizeof(shadow_view_instance_hashes[view]));
+					} else {
+						for (uint32_t m = 0; m < 4; ++m) {
+							for (uint32_t index : in_spot_light_instances[view][m]) {
+								hash = hash_instance(hash, m, index, (*instances[m])[index]);
+							}
+						}
+					}
+					if (hash == shadow_hashes[hash_index]) {
+						stats.shadows_cached += 1;
+						continue;
+					}
+					shadow_hashes[hash_index] = hash;
+					stats.shadows_drawn += 1;
+				}
+
 				{//push light:
 					ShadowAtlasPipeline::Light push{
-						.LIGHT_FROM_WORLD = spot_light_from_world[i],
+						.LIGHT_FROM_WORLD = *light_from_world,
 					};
-					vkCmdPushConstants(workspace.command_buffer, shadow_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+					vkCmdPushConstants(command_buffer, shadow_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
 				}
 				{// set viewport and scissors
 					VkExtent2D extent = {region.size, region.size};
@@ -1943,7 +2950,7 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 							.offset = offset,
 							.extent = extent,
 						};
-						vkCmdSetScissor(workspace.command_buffer, 0, 1, &scissor);
+						vkCmdSetScissor(command_buffer, 0, 1, &scissor);
 					}
 					{//configure viewport transform:
 						VkViewport viewport{
@@ -1954,37 +2961,50 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 							.minDepth = 0.0f,
 							.maxDepth = 1.0f,
 						};
-						vkCmdSetViewport(workspace.command_buffer, 0, 1, &viewport);
+						vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+					}
+					{//clear the region (the pass loads the whole atlas):
+						VkClearAttachment clear{
+							.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+							.clearValue{.depthStencil{.depth = 1.0f, .stencil = 0}},
+						};
+						VkClearRect clear_rect{
+							.rect{.offset = offset, .extent = extent},
+							.baseArrayLayer = 0,
+							.layerCount = 1,
+						};
+						vkCmdClearAttachments(command_buffer, 1, &clear, 1, &clear_rect);
 					}
 				}
 
-				//draw all instances:
-				for (uint32_t index : in_spot_light_instances[i][static_cast<uint32_t>(Scene::Material::Lambertian)]) {
-					ObjectInstance const &inst = lambertian_instances[index];
-
-					vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
+				if (indirect) {
+					draw_indirect(command_buffer, stats, shadow_indirect_batches[view]);
+					continue;
 				}
 
-				uint32_t index_offset = uint32_t(lambertian_instances.size());// account for lambertian size
-				for (uint32_t index : in_spot_light_instances[i][static_cast<uint32_t>(Scene::Material::Environment)]) {
-					ObjectInstance const &inst = environment_instances[index];
-					index += index_offset; 
-					vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-				}
-				index_offset = uint32_t(lambertian_instances.size() + environment_instances.size());// account for lambertian and environment size
-				for (uint32_t index : in_spot_light_instances[i][static_cast<uint32_t>(Scene::Material::Mirror)]) {
-					ObjectInstance const &inst = mirror_instances[index];
-					index += index_offset; 
-					vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-				}
-				index_offset = uint32_t(lambertian_instances.size() + environment_instances.size() + mirror_instances.size());// account for lambertian, environment, and mirror size
-				for (uint32_t index : in_spot_light_instances[i][static_cast<uint32_t>(Scene::Material::PBR)]) {
-					ObjectInstance const &inst = pbr_instances[index];
-					index += index_offset; 
-					vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
+				//draw all instances (one draw each):
+				for (uint32_t m = 0; m < 4; ++m) {
+					for (uint32_t index : in_spot_light_instances[view][m]) {
+						ObjectInstance const &inst = (*instances[m])[index];
+						vkCmdDrawIndexed(command_buffer, inst.vertices.index_count, 1, inst.vertices.first_index, inst.vertices.vertex_offset, index + index_offset[m]);
+					}
+					stats.draws += in_spot_light_instances[view][m].size();
 				}
 			}
+
+			VK(vkEndCommandBuffer(command_buffer));
+			secondaries[chunk] = command_buffer;
+		});
+
+		if (chunk_count > 0) {
+			vkCmdExecuteCommands(workspace.command_buffer, chunk_count, secondaries.data());
+		}
+		for (DrawStats const &stats : chunk_stats) {
+			draw_stats.draws += stats.draws;
+			draw_stats.shadows_drawn += stats.shadows_drawn;
+			draw_stats.shadows_cached += stats.shadows_cached;
 		}
+
 		vkCmdEndRenderPass(workspace.command_buffer);
 	}
 
@@ -2016,151 +3036,91 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 	);
 
 
-	if (!lines_vertices.empty()) { //upload lines vertices;
-		//[re-]allocate lines buffer if needed:
-		size_t needed_bytes = lines_vertices.size() * sizeof(lines_vertices[0]);
-		if (workspace.lines_vertices_src.handle == VK_NULL_HANDLE || workspace.lines_vertices_src.size < needed_bytes) {
-			//round to next multiple of 4k to avoid re-allocating continuously if vertex count grows slowly:
-			size_t new_bytes = ((needed_bytes + 4096) / 4096) * 4096;
-
-			if (workspace.lines_vertices_src.handle) {
-				rtg.helpers.destroy_buffer(std::move(workspace.lines_vertices_src));
-			}
-			if (workspace.lines_vertices.handle) {
-				rtg.helpers.destroy_buffer(std::move(workspace.lines_vertices));
-			}
-			
-			workspace.lines_vertices_src = rtg.helpers.create_buffer(
-				new_bytes,
-				VK_BUFFER_USAGE_TRANSFER_SRC_BIT, //going to have GPU copy from this memory
-				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, //host-visible memory, coherent (no special sync needed)
-				Helpers::Mapped //get a pointer to the memory
-			);
-			workspace.lines_vertices = rtg.helpers.create_buffer(
-				new_bytes,
-				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, //going to use as vertex buffer, also going to have GPU into this memory
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //GPU-local memory
-				Helpers::Unmapped //don't get a pointer to the memory
-			);
-
-			std::cout << "Re-allocated lines buffers to " << new_bytes << " bytes." << std::endl;
-
-		}
-
-		assert(workspace.lines_vertices_src.size == workspace.lines_vertices.size);
-		assert(workspace.lines_vertices_src.size >= needed_bytes);
-
-		// host-side copy into lines_vertices_src:
-		assert(workspace.lines_vertices_src.allocation.mapped);
-		std::memcpy(workspace.lines_vertices_src.allocation.data(), lines_vertices.data(), needed_bytes);
-
-		//device-side copy from lines_vertices_src -> lines_vertices:
-		VkBufferCopy copy_region{
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = needed_bytes,
-		};
-
-		vkCmdCopyBuffer(workspace.command_buffer, workspace.lines_vertices_src.handle, workspace.lines_vertices.handle, 1, &copy_region);
+	if (!lines_vertices.empty()) { //upload lines vertices:
+		std::memcpy(workspace.stream.data(stream_offsets.lines_vertices), lines_vertices.data(), lines_vertices.size() * sizeof(lines_vertices[0]));
 	}
 
 	{//upload camera info:
 		LinesPipeline::Camera camera{
 			.CLIP_FROM_WORLD = CLIP_FROM_WORLD
 		};
-		assert(workspace.Camera_src.size == sizeof(camera));
-
-		//host-side copy into Camera_src:
-		memcpy(workspace.Camera_src.allocation.data(), &camera, sizeof(camera));
-
-		//add device-side copy from Camera_src -> Camera:
-		assert(workspace.Camera_src.size == workspace.Camera.size);
-		VkBufferCopy copy_region{
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = workspace.Camera_src.size,
-		};
-		vkCmdCopyBuffer(workspace.command_buffer, workspace.Camera_src.handle, workspace.Camera.handle, 1, &copy_region);
+		std::memcpy(workspace.stream.data(stream_offsets.Camera), &camera, sizeof(camera));
 	}
 
 	{ //upload world info:
-		assert(workspace.World_src.size == sizeof(world));
-
-		//host-side copy into World_src:
-		memcpy(workspace.World_src.allocation.data(), &world, sizeof(world));
-
-		//add device-side copy from World_src -> World:
-		assert(workspace.World_src.size == workspace.World.size);
-		VkBufferCopy copy_region{
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = workspace.World_src.size,
-		};
-		vkCmdCopyBuffer(workspace.command_buffer, workspace.World_src.handle, workspace.World.handle, 1, &copy_region);
+		std::memcpy(workspace.stream.data(stream_offsets.World), &world, sizeof(world));
 	}
 
 	{// upload cloud world info
-		assert(workspace.Cloud_World_src.size == sizeof(cloud_world));
-
-		//host-side copy into Cloud_World_src:
-		memcpy(workspace.Cloud_World_src.allocation.data(), &cloud_world, sizeof(cloud_world));
+		std::memcpy(workspace.stream.data(stream_offsets.Cloud_World), &cloud_world, sizeof(cloud_world));
+	}
 
-		//add device-side copy from Cloud_World_src -> Cloud_World:
-		assert(workspace.Cloud_World_src.size == workspace.Cloud_World.size);
-		VkBufferCopy copy_region{
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = workspace.Cloud_World_src.size,
-		};
-		vkCmdCopyBuffer(workspace.command_buffer, workspace.Cloud_World_src.handle, workspace.Cloud_World.handle, 1, &copy_region);
+	if (!spot_lights.empty() || !sun_lights.empty() || !sphere_lights.empty()) { //upload lights:
+		char * lights_ptr = reinterpret_cast< char * >(workspace.stream.data(stream_offsets.Lights));
+		LambertianPipeline::SunLight *sun_out = reinterpret_cast< LambertianPipeline::SunLight * >(lights_ptr);
+		for (LambertianPipeline::SunLight const &inst : sun_lights) {
+			*sun_out = inst;
+			++sun_out;
+		}
+		LambertianPipeline::SphereLight *sphere_out = reinterpret_cast< LambertianPipeline::SphereLight * >(lights_ptr + light_info.sun_light_alignment);
+		for (LambertianPipeline::SphereLight const &inst : sphere_lights) {
+			*sphere_out = inst;
+			++sphere_out;
+		}
+		LambertianPipeline::SpotLight *spot_out = reinterpret_cast< LambertianPipeline::SpotLight * >(lights_ptr + light_info.sphere_light_alignment);
+		for (LambertianPipeline::SpotLight const &inst : spot_lights) {
+			*spot_out = inst;
+			++spot_out;
+		}
 	}
 
-	if (!spot_lights.empty() || !sun_lights.empty() || !sphere_lights.empty()) {
-		{ //copy lights into Light_src:
-			assert(workspace.Light_src.allocation.mapped);
-			char * lights_ptr = reinterpret_cast< char * >(workspace.Light_src.allocation.data());
-			LambertianPipeline::SunLight *sun_out = reinterpret_cast< LambertianPipeline::SunLight * >(lights_ptr);
-			for (LambertianPipeline::SunLight const &inst : sun_lights) {
-				*sun_out = inst;
-				++sun_out;
-			}
-			LambertianPipeline::SphereLight *sphere_out = reinterpret_cast< LambertianPipeline::SphereLight * >(lights_ptr + light_info.sun_light_alignment);
-			for (LambertianPipeline::SphereLight const &inst : sphere_lights) {
-				*sphere_out = inst;
-				++sphere_out;
-			}
-			LambertianPipeline::SpotLight *spot_out = reinterpret_cast< LambertianPipeline::SpotLight * >(lights_ptr + light_info.sphere_light_alignment);
-			for (LambertianPipeline::SpotLight const &inst : spot_lights) {
-				*spot_out = inst;
-				++spot_out;
-			}
+	//viewport and scissor for drawing the view (secondary command buffers don't inherit them, so each one sets its own):
+	auto set_view_rect = [&](VkCommandBuffer command_buffer) {
+		{//set scissor rectangle:
+			vkCmdSetScissor(command_buffer, 0, 1, &view_rect);
 		}
-
-		//device-side copy from Light_src -> Light:
-		VkBufferCopy copy_region{
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = light_info.sphere_light_alignment + light_info.spot_light_size,
+		{//configure viewport transform:
+			VkViewport viewport{
+				.x = float(view_rect.offset.x),
+				.y = float(view_rect.offset.y),
+				.width = float(view_rect.extent.width),
+				.height = float(view_rect.extent.height),
+				.minDepth = 0.0f,
+				.maxDepth = 1.0f,
+			};
+			vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+		}
+	};
+	//bind World and Transforms descriptor sets (shared by the objects pipelines' layouts):
+	auto bind_object_sets = [&](VkCommandBuffer command_buffer, VkPipelineLayout layout) {
+		std::array< VkDescriptorSet, 2 > descriptor_sets{
+			workspace.World_descriptors, //0: World
+			workspace.Transforms_descriptors, //1: Transforms
 		};
-		vkCmdCopyBuffer(workspace.command_buffer, workspace.Light_src.handle, workspace.Light.handle, 1, &copy_region);
-		
-	}
-
-	{//memory barrier to make sure copies complete before rendering happens:
-		VkMemoryBarrier memory_barrier{
-			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
-			.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
-			.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+		//one per dynamic binding, in set then binding order:
+		std::array< uint32_t, 5 > dynamic_offsets{
+			uint32_t(stream_offsets.World), //set 0, binding 0: World
+			uint32_t(stream_offsets.Lights), //set 0, binding 3: SunLights
+			uint32_t(stream_offsets.Lights), //set 0, binding 4: SphereLights
+			uint32_t(stream_offsets.Lights), //set 0, binding 5: SpotLights
+			uint32_t(gpu_culling ? stream_offsets.Transforms : stream_offsets.View_Transforms), //set 1, binding 0: Transforms (the culling pass's commands index all instances)
 		};
-		vkCmdPipelineBarrier( workspace.command_buffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, //srcStageMask
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, //dstStageMask
-			0, //dependencyFlags
-			1, &memory_barrier, //memoryBarriers (count, data)
-			0, nullptr, //bufferMemoryBarriers (count, data)
-			0, nullptr //imageMemoryBarriers (count, data)
+		vkCmdBindDescriptorSets(
+			command_buffer, //command buffer
+			VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
+			layout, //pipeline layout
+			0, //first set
+			uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
+			uint32_t(dynamic_offsets.size()), dynamic_offsets.data() //dynamic offsets count, ptr
 		);
-	}
+	};
+	//objects pipelines, in the same order as 'instances':
+	std::array<std::pair<VkPipeline, VkPipelineLayout>, 4> object_pipelines{
+		std::make_pair(lambertian_pipeline.handle, lambertian_pipeline.layout),
+		std::make_pair(environment_pipeline.handle, environment_pipeline.layout),
+		std::make_pair(mirror_pipeline.handle, mirror_pipeline.layout),
+		std::make_pair(pbr_pipeline.handle, pbr_pipeline.layout),
+	};
 
 	{//render pass:
 		std::array<VkClearValue, 2> clear_values{
@@ -2178,225 +3138,230 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 			.clearValueCount = uint32_t(clear_values.size()),
 			.pClearValues = clear_values.data(),
 		};
-		vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
-
-		{// set viewport and scissors
-			VkExtent2D extent = rtg.swapchain_extent;
-			VkOffset2D offset = {.x = 0, .y = 0};
-			if (view_camera == SceneCamera) {
-				float camera_aspect = scene.cameras[scene.requested_camera_index].aspect; // W / H
-				float actual_aspect = rtg.swapchain_extent.width / float(rtg.swapchain_extent.height);
-				if (actual_aspect < camera_aspect) {
-					extent.height = uint32_t(float(extent.width) / camera_aspect);
-					offset.y += (rtg.swapchain_extent.height - extent.height) / 2;
-				}
-				else if (actual_aspect > camera_aspect) {
-					extent.width = uint32_t(float(extent.height) * camera_aspect);
-					offset.x += (rtg.swapchain_extent.width - extent.width) / 2;
+		vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		//the lines and each objects pipeline are recorded into their own secondary command buffer on the thread pool
+		// (job 0: lines, job 1 + m: the objects pipeline for instances[m]):
+		std::array<VkCommandBuffer, 5> secondaries{};
+		std::array<DrawStats, 5> job_stats{};
+		thread_pool.parallel_for(uint32_t(secondaries.size()), [&](uint32_t job) {
+			if (job == 0 ? lines_vertices.empty() : instances[job - 1]->empty()) return;
+
+			VkCommandBuffer command_buffer = begin_secondary(workspace, render_pass, framebuffer);
+			set_view_rect(command_buffer);
+
+			if (job == 0) {
+				// {//draw with the background pipeline:
+				// 	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, background_pipeline.handle);
+
+				// 	{//push time:
+				// 		BackgroundPipeline::Push push{
+				// 			.time = float(time),
+				// 		};
+				// 		vkCmdPushConstants(command_buffer, background_pipeline.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push), &push);
+				// 	}
+
+				// 	vkCmdDraw(command_buffer, 3, 1, 0, 0);
+				// }
+
+				//draw with the lines pipeline:
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lines_pipeline.handle);
+
+				{//use lines vertices block of the stream as vertex buffer binding 0:
+					std::array< VkBuffer, 1 > vertex_buffers{ workspace.stream.buffer.handle };
+					std::array< VkDeviceSize, 1 > offsets{ stream_offsets.lines_vertices };
+					vkCmdBindVertexBuffers(command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
 				}
-			}
 
-			{//set scissor rectangle:
-				VkRect2D scissor{
-					.offset = offset,
-					.extent = extent,
-				};
-				vkCmdSetScissor(workspace.command_buffer, 0, 1, &scissor);
-			}
-			{//configure viewport transform:
-				VkViewport viewport{
-					.x = float(offset.x),
-					.y = float(offset.y),
-					.width = float(extent.width),
-					.height = float(extent.height),
-					.minDepth = 0.0f,
-					.maxDepth = 1.0f,
-				};
-				vkCmdSetViewport(workspace.command_buffer, 0, 1, &viewport);
-			}
-		}
+				{ //bind Camera descriptor set:
+					std::array< VkDescriptorSet, 1 > descriptor_sets{
+						workspace.Camera_descriptors, //0: Camera
+					};
+					std::array< uint32_t, 1 > dynamic_offsets{
+						uint32_t(stream_offsets.Camera),
+					};
 
-		// {//draw with the background pipeline:
-		// 	vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, background_pipeline.handle);
-			
-		// 	{//push time:
-		// 		BackgroundPipeline::Push push{
-		// 			.time = float(time),
-		// 		};
-		// 		vkCmdPushConstants(workspace.command_buffer, background_pipeline.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push), &push);
-		// 	}
-			
-		// 	vkCmdDraw(workspace.command_buffer, 3, 1, 0, 0);
-		// }
+					vkCmdBindDescriptorSets(
+						command_buffer, //command buffer
+						VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
+						lines_pipeline.layout, //pipeline layout
+						0, //first set
+						uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
+						uint32_t(dynamic_offsets.size()), dynamic_offsets.data() //dynamic offsets count, ptr
+					);
+				}
 
-		if (!lines_vertices.empty()) {//draw with the lines pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lines_pipeline.handle);
+				//draw lines vertices:
+				vkCmdDraw(command_buffer, uint32_t(lines_vertices.size()), 1, 0, 0);
+			} else {//draw with the objects pipeline:
+				uint32_t m = job - 1;
+				auto [pipeline, layout] = object_pipelines[m];
+				vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				bind_object_sets(command_buffer, layout);
+
+				{//use object_vertices (offset 0) as vertex buffer binding 0, with object_indices:
+					std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
+					std::array< VkDeviceSize, 1 > offsets{ 0 };
+					vkCmdBindVertexBuffers(command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+					vkCmdBindIndexBuffer(command_buffer, object_indices.handle, 0, object_index_type);
+				}
 
-			{//use lines_vertices (offset 0) as vertex buffer binding 0:
-				std::array< VkBuffer, 1 > vertex_buffers{ workspace.lines_vertices.handle };
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+				if (indirect) {
+					draw_material_batches(command_buffer, job_stats[job], m, layout, indirect_batches);
+				}
+				else {
+					draw_view_instances(command_buffer, job_stats[job], m, layout);
+				}
 			}
 
-			{ //bind Camera descriptor set:
-				std::array< VkDescriptorSet, 1 > descriptor_sets{
-					workspace.Camera_descriptors, //0: Camera
-				};
-		
-				vkCmdBindDescriptorSets(
-					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					lines_pipeline.layout, //pipeline layout
-					0, //first set
-					uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
-					0, nullptr //dynamic offsets count, ptr
-				);
-			}
+			VK(vkEndCommandBuffer(command_buffer));
+			secondaries[job] = command_buffer;
+		});
 
-			//draw lines vertices:
-			vkCmdDraw(workspace.command_buffer, uint32_t(lines_vertices.size()), 1, 0, 0);
+		//execute the recorded jobs in job order:
+		std::vector<VkCommandBuffer> recorded;
+		for (uint32_t job = 0; job < secondaries.size(); ++job) {
+			if (secondaries[job] != VK_NULL_HANDLE) recorded.emplace_back(secondaries[job]);
+			draw_stats.material_binds += job_stats[job].material_binds;
+			draw_stats.draws += job_stats[job].draws;
 		}
-
-		if (!lambertian_instances.empty() || !environment_instances.empty() || !mirror_instances.empty() || !pbr_instances.empty()) {
-			//bind World and Transforms descriptor set:
-			std::array< VkDescriptorSet, 2 > descriptor_sets{
-				workspace.World_descriptors, //0: World
-				workspace.Transforms_descriptors, //1: Transforms
-			};
-			vkCmdBindDescriptorSets(
-				workspace.command_buffer, //command buffer
-				VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-				lambertian_pipeline.layout, //pipeline layout
-				0, //first set
-				uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
-				0, nullptr //dynamic offsets count, ptr
-			);
+		if (!recorded.empty()) {
+			vkCmdExecuteCommands(workspace.command_buffer, uint32_t(recorded.size()), recorded.data());
 		}
 
-		if (!lambertian_instances.empty()){//draw with the objects pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lambertian_pipeline.handle);
-
-			{//use object_vertices (offset 0) as vertex buffer binding 0:
-				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
-
-			}
-
-			// set 1 and 2 still bound
-
-			//draw all instances:
-			for (uint32_t index : in_view_instances[static_cast<uint32_t>(Scene::Material::Lambertian)]) {
-				ObjectInstance const &inst = lambertian_instances[index];
-				//bind texture descriptor set:
-				vkCmdBindDescriptorSets(
-					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					lambertian_pipeline.layout, //pipeline layout
-					2, //second set
-					1, &material_descriptors[inst.material_index], //descriptor sets count, ptr
-					0, nullptr //dynamic offsets count, ptr
-				);
+		vkCmdEndRenderPass(workspace.command_buffer);
+	}
 
-				vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-			}
+	if (occlusion_culling && instance_count > 0) {//late phase: depth pyramid from the early phase, cull the rest against it, draw what it missed
+		VkImageSubresourceRange depth_range{
+			.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+			.baseMipLevel = 0,
+			.levelCount = 1,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		};
 
+		{//the pyramid build reads the depth image:
+			VkImageMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = swapchain_depth_image.handle,
+				.subresourceRange = depth_range,
+			};
+			vkCmdPipelineBarrier(workspace.command_buffer,
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, //srcStageMask
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //dstStageMask
+				0, //dependencyFlags
+				0, nullptr, //memoryBarriers (count, data)
+				0, nullptr, //bufferMemoryBarriers (count, data)
+				1, &barrier //imageMemoryBarriers (count, data)
+			);
 		}
-	
-		if (!environment_instances.empty()) {//draw with the objects pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, environment_pipeline.handle);
-
-			{//use object_vertices as vertex buffer binding 0:
-				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
-
-			}
-
-			//World descriptor still bound
 
-			//draw all instances:
-			uint32_t index_offset = uint32_t(lambertian_instances.size());// account for lambertian size
-			for (uint32_t index : in_view_instances[static_cast<uint32_t>(Scene::Material::Environment)]) {
-				ObjectInstance const &inst = environment_instances[index];
-				index += index_offset;
-				//bind texture descriptor set:
-				vkCmdBindDescriptorSets(
-					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					environment_pipeline.layout, //pipeline layout
-					2, //second set
-					1, &material_descriptors[inst.material_index], //descriptor sets count, ptr
-					0, nullptr //dynamic offsets count, ptr
-				);
-				vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-			}
+		//build the pyramid a level at a time, each from the one below:
+		vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, depth_pyramid_pipeline.handle);
+		glm::ivec2 src_size(swapchain_depth_image.extent.width, swapchain_depth_image.extent.height);
+		for (uint32_t level = 0; level < depth_pyramid_levels; ++level) {
+			glm::ivec2 dst_size(std::max(depth_pyramid.extent.width >> level, 1U), std::max(depth_pyramid.extent.height >> level, 1U));
+			vkCmdBindDescriptorSets(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, depth_pyramid_pipeline.layout, 0, 1, &DepthPyramid_descriptors[level], 0, nullptr);
+			DepthPyramidPipeline::Push push{
+				.SRC_SIZE = src_size,
+				.DST_SIZE = dst_size,
+			};
+			vkCmdPushConstants(workspace.command_buffer, depth_pyramid_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+			vkCmdDispatch(workspace.command_buffer,
+				(dst_size.x + DepthPyramidPipeline::WorkgroupSize - 1) / DepthPyramidPipeline::WorkgroupSize,
+				(dst_size.y + DepthPyramidPipeline::WorkgroupSize - 1) / DepthPyramidPipeline::WorkgroupSize,
+				1
+			);
 
+			//the next level (or the late phase) reads this one:
+			VkMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			};
+			vkCmdPipelineBarrier(workspace.command_buffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //dstStageMask
+				0, //dependencyFlags
+				1, &barrier, //memoryBarriers (count, data)
+				0, nullptr, //bufferMemoryBarriers (count, data)
+				0, nullptr //imageMemoryBarriers (count, data)
+			);
+			src_size = dst_size;
 		}
 
-		if (!mirror_instances.empty()) {//draw with the objects pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mirror_pipeline.handle);
+		{//the late pass keeps drawing into the depth image:
+			VkImageMemoryBarrier barrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = 0,
+				.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+				.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = swapchain_depth_image.handle,
+				.subresourceRange = depth_range,
+			};
+			vkCmdPipelineBarrier(workspace.command_buffer,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask
+				VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, //dstStageMask
+				0, //dependencyFlags
+				0, nullptr, //memoryBarriers (count, data)
+				0, nullptr, //bufferMemoryBarriers (count, data)
+				1, &barrier //imageMemoryBarriers (count, data)
+			);
+		}
 
-			{//use object_vertices as vertex buffer binding 0:
-				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
-			}
+		//late phase culling (view only):
+		vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline.handle);
+		vkCmdBindDescriptorSets(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline.layout, 0, 1, &workspace.Cull_descriptors, 0, nullptr);
+		cull_push.PHASE = 1;
+		vkCmdPushConstants(workspace.command_buffer, cull_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cull_push), &cull_push);
+		vkCmdDispatch(workspace.command_buffer, (instance_count + CullPipeline::WorkgroupSize - 1) / CullPipeline::WorkgroupSize, 1, 1);
 
-			//World descriptor still bound
+		cull_to_draw_barrier();
 
-			//draw all instances:
-			uint32_t index_offset = uint32_t(lambertian_instances.size() + environment_instances.size());// account for lambertian and environment size
-			for (uint32_t index : in_view_instances[static_cast<uint32_t>(Scene::Material::Mirror)]) {
-				ObjectInstance const &inst = mirror_instances[index];
-				index += index_offset;
-				//bind texture descriptor set:
-				vkCmdBindDescriptorSets(
-					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					mirror_pipeline.layout, //pipeline layout
-					2, //second set
-					1, &material_descriptors[inst.material_index], //descriptor sets count, ptr
-					0, nullptr //dynamic offsets count, ptr
-				);
-				vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-			}
+		VkRenderPassBeginInfo begin_info{
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+			.renderPass = render_pass_resume,
+			.framebuffer = framebuffer,
+			.renderArea{
+				.offset = {.x = 0, .y = 0},
+				.extent = rtg.swapchain_extent,
+			},
+		};
+		vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
-		}
-		if (!pbr_instances.empty()) {//draw with the objects pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pbr_pipeline.handle);
+		//(the early pass's state was set in its secondaries, so the primary sets it again)
+		set_view_rect(workspace.command_buffer);
+		bind_object_sets(workspace.command_buffer, lambertian_pipeline.layout);
+		for (uint32_t m = 0; m < 4; ++m) {
+			if (late_indirect_batches[m].empty()) continue;
+			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, object_pipelines[m].first);
 
-			{//use object_vertices as vertex buffer binding 0:
+			{//use object_vertices as vertex buffer binding 0, with object_indices:
 				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
 				std::array< VkDeviceSize, 1 > offsets{ 0 };
 				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+				vkCmdBindIndexBuffer(workspace.command_buffer, object_indices.handle, 0, object_index_type);
 			}
 
-			//World descriptor still bound
-
-			//draw all instances:
-			uint32_t index_offset = uint32_t(lambertian_instances.size() + environment_instances.size() + mirror_instances.size());// account for lambertian, environment, and mirror size
-			for (uint32_t index : in_view_instances[static_cast<uint32_t>(Scene::Material::PBR)]) {
-				ObjectInstance const &inst = pbr_instances[index];
-				index += index_offset;
-				//bind texture descriptor set:
-				vkCmdBindDescriptorSets(
-					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					pbr_pipeline.layout, //pipeline layout
-					2, //second set
-					1, &material_descriptors[inst.material_index], //descriptor sets count, ptr
-					0, nullptr //dynamic offsets count, ptr
-				);
-				vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-			}
-
+			draw_material_batches(workspace.command_buffer, draw_stats, m, object_pipelines[m].second, late_indirect_batches);
 		}
-	
+
 		vkCmdEndRenderPass(workspace.command_buffer);
 	}
 
 	if (scene.has_cloud){// cloud rendering
+		uint32_t cloud_world_offset = uint32_t(stream_offsets.Cloud_World); //dynamic offset for CloudWorld (set 0, binding 1)
+
 		VkImageSubresourceRange whole_image{
 			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
 			.baseMipLevel = 0,
@@ -2447,7 +3412,7 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 				cloud_pipeline.layout, //pipeline layout
 				0, //first set
 				1, &workspace.Cloud_LightGrid_World_descriptors, //descriptor sets count, ptr
-				0, nullptr //dynamic offsets count, ptr
+				1, &cloud_world_offset //dynamic offsets count, ptr
 			);
 
 			vkCmdBindDescriptorSets(
@@ -2612,7 +3577,7 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 			cloud_pipeline.layout, //pipeline layout
 			0, //first set
 			1, &workspace.Cloud_World_descriptors, //descriptor sets count, ptr
-			0, nullptr //dynamic offsets count, ptr
+			1, &cloud_world_offset //dynamic offsets count, ptr
 		);
 
 		const glm::ivec2 swapchain_dimensions(swapchain_depth_image.extent.width, swapchain_depth_image.extent.height);
@@ -2743,6 +3708,17 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 	
 
 
+	if (rtg.configuration.debug && ++draw_stats_frames == DrawStatsFrames) {
+		std::cout << "Per frame over the last " << DrawStatsFrames << " frames: "
+		          << double(draw_stats.material_binds) / DrawStatsFrames << " material binds, "
+		          << double(draw_stats.draws) / DrawStatsFrames << " draws, "
+		          << double(draw_stats.shadows_drawn) / DrawStatsFrames << " shadows drawn, "
+		          << double(draw_stats.shadows_cached) / DrawStatsFrames << " shadows cached, "
+		          << 100.0f * shadow_atlas.utilisation() << "% of the shadow atlas in use." << std::endl;
+		draw_stats = DrawStats();
+		draw_stats_frames = 0;
+	}
+
 	//end recording:
 	VK(vkEndCommandBuffer(workspace.command_buffer));
 
@@ -2784,6 +3760,9 @@ void RTGRenderer::update(float dt) {
 	{//update the animations according to the drivers
 		scene.animation_setting = rtg.configuration.animation_settings;
 		scene.update_drivers(dt);
+		//only subtrees under driven nodes get new world matrices (and new culling bounds):
+		scene.update_hierarchy();
+		update_instance_bvh();
 	}
 
 	// set scene camera for animation purposes
@@ -2853,6 +3832,20 @@ void RTGRenderer::update(float dt) {
 		world.CAMERA_POSITION = cur_camera.eye;
 	}
 
+	//the view's depth range (light clusters and sun cascades are spaced over it):
+	float view_near = 0.1f, view_far = 1000.0f; //(free cameras)
+	if (view_camera == InSceneCamera::SceneCamera) {
+		Scene::Camera const &cur_camera = scene.cameras[scene.requested_camera_index];
+		view_near = cur_camera.near;
+		//(infinite perspective: slices stay spaced for the free camera range; the last one reaches to infinity anyway)
+		view_far = (cur_camera.far > cur_camera.near ? cur_camera.far : view_near * 10000.0f);
+	}
+
+	{//light clusters slice the view's depth exponentially between its near and far planes (see LightClusterPipeline):
+		world.CLIP_FROM_WORLD = CLIP_FROM_WORLD;
+		world.CLUSTER_Z = LightBinning::depth_slicing(view_near, view_far, LightClusterPipeline::ClusterCountZ);
+	}
+
 	const std::array<glm::vec4, 8> clip_space_coordinates = {
 		glm::vec4(1.0f,  1.0f, 0.0f, 1.0f),   // Near top right
 		glm::vec4(-1.0f,  1.0f, 0.0f, 1.0f),  // Near top left
@@ -2871,7 +3864,6 @@ void RTGRenderer::update(float dt) {
 		for (uint32_t i = 0; i < scene.spot_lights_sorted_indices.size(); ++i) {
 			Scene::Light& cur_light = scene.lights[scene.spot_lights_sorted_indices[i].lights_index];
 			assert(cur_light.light_type == Scene::Light::LightType::Spot); // only support spot for now
-			total_shadow_size += cur_light.shadow * cur_light.shadow;
 			glm::mat4x4 cur_light_transform = scene.nodes[scene.spot_lights_sorted_indices[i].local_to_world[0]].transform.parent_from_local();
 			for (int j = 1; j < scene.spot_lights_sorted_indices[i].local_to_world.size(); ++j) {
 				cur_light_transform *= scene.nodes[scene.spot_lights_sorted_indices[i].local_to_world[j]].transform.parent_from_local();
@@ -2924,7 +3916,7 @@ void RTGRenderer::update(float dt) {
 	lines_vertices.clear();
 	std::array<glm::vec3, 8> frustum_vertices;
 
-	if (rtg.configuration.culling_settings == 1) { // frustum culling is on
+	if (rtg.configuration.culling_settings != 0) { // frustum culling is on (on the CPU or the GPU)
 		glm::mat4x4 world_from_clip = glm::inverse(culling_camera == SceneCamera ? clip_from_view[0] * view_from_world[0] : clip_from_view[1]* view_from_world[1]);
 		// Transform clip space to world space and apply perspective divide
 		for (int j = 0; j < 8; ++j) {
@@ -2934,7 +3926,7 @@ void RTGRenderer::update(float dt) {
 	}
 	{// render last active frustum if in debug mode
 		if (view_camera == DebugCamera) {
-			if (rtg.configuration.culling_settings != 1) {
+			if (rtg.configuration.culling_settings == 0) {
 				glm::mat4x4 world_from_clip = glm::inverse(culling_camera == SceneCamera ? clip_from_view[0] * view_from_world[0] : clip_from_view[1]* view_from_world[1]);
 				// Transform clip space to world space and apply perspective divide
 				for (int j = 0; j < 8; ++j) {
@@ -3043,41 +4035,15 @@ void RTGRenderer::update(float dt) {
 	}
 
 	{ //fill object instances with scene hiearchy, optionally draw debug lines when on debug camera, fill light information
-		for (uint32_t i = 0; i < in_view_instances.size(); ++i) {
-			in_view_instances[i].clear();
-		}
-		in_spot_light_instances.resize(scene.spot_lights_sorted_indices.size());
-		for (uint32_t i = 0; i < in_spot_light_instances.size(); ++i) {
-			for (uint32_t j = 0; j < in_spot_light_instances[0].size(); ++j) {
-				in_spot_light_instances[i][j].clear();
-			}
-		}
-		lambertian_instances.clear();
-		environment_instances.clear();
-		mirror_instances.clear();
-		pbr_instances.clear();
-		//clear lights
-		sun_lights.clear();
-		sphere_lights.clear();
-		spot_lights.clear();
-		spot_light_from_world.clear();
-		// culling resources
-		glm::mat4x4 frustum_view_from_world = culling_camera == SceneCamera ? view_from_world[0] : view_from_world[1];
-
-		std::deque<glm::mat4x4> transform_stack;
-		std::function<void(uint32_t)> collect_node_information = [&](uint32_t i) {
-			Scene::Node& cur_node = scene.nodes[i];
-			glm::mat4x4 cur_node_transform_in_parent = cur_node.transform.parent_from_local();
-			if (transform_stack.empty()) {
-				transform_stack.push_back(cur_node_transform_in_parent);
-			}
-			else {
-				glm::mat4x4 parent_node_transform_in_world = transform_stack.back();
-				transform_stack.push_back(parent_node_transform_in_world * cur_node_transform_in_parent);
-			}
+		Scene::Hierarchy const &hierarchy = scene.hierarchy;
+		uint32_t spot_frustums = uint32_t(scene.spot_lights_sorted_indices.size());
+
+		//gathers the lights, instances, visibility and debug lines of one hierarchy entry into a chunk's own lists:
+		auto collect_entry = [&](CollectChunk &out, uint32_t entry) {
+			Scene::Node const &cur_node = scene.nodes[hierarchy.node[entry]];
+			glm::mat4x4 const &WORLD_FROM_LOCAL = hierarchy.world[entry];
 			// gather light information
 			if (uint32_t cur_light_index = cur_node.light_index; cur_light_index != -1) {
-				glm::mat4x4 WORLD_FROM_LOCAL = transform_stack.back();
 				Scene::Light& cur_light = scene.lights[cur_light_index];
 				
 				glm::vec3 tint = cur_light.tint;
@@ -3085,8 +4051,9 @@ void RTGRenderer::update(float dt) {
 
 					glm::vec3 light_direction = glm::mat3x3(WORLD_FROM_LOCAL) * glm::vec3(0.0f,0.0f,1.0f);
 					Scene::Light::ParamSun sun_param = std::get<Scene::Light::ParamSun>(cur_light.additional_params);
-					sun_lights.emplace_back(LambertianPipeline::SunLight{
-						.DIRECTION = glm::vec4(light_direction, 0.0f),
+					out.sun_lights.emplace_back(LambertianPipeline::SunLight{
+						.DIRECTION = light_direction,
+						.shadow_size = cur_light.shadow,
 						.ENERGY = sun_param.strength * tint / float(M_PI),
 						.SIN_ANGLE = sin(sun_param.angle/2.0f)
 					});
@@ -3095,7 +4062,7 @@ void RTGRenderer::update(float dt) {
 
 					glm::vec3 light_position = WORLD_FROM_LOCAL * glm::vec4(0.0f,0.0f,0.0f,1.0f);
 					Scene::Light::ParamSphere sphere_param = std::get<Scene::Light::ParamSphere>(cur_light.additional_params);
-					sphere_lights.emplace_back(LambertianPipeline::SphereLight{
+					out.sphere_lights.emplace_back(LambertianPipeline::SphereLight{
 						.POSITION = glm::vec4(light_position, 0.0f),
 						.RADIUS = sphere_param.radius,
 						.ENERGY = sphere_param.power * tint / float(M_PI),
@@ -3110,7 +4077,7 @@ void RTGRenderer::update(float dt) {
 					
 					float outer_angle = spot_param.fov / 2.0f;
 					float inner_angle = (1.0f - spot_param.blend) * outer_angle;
-					spot_lights.emplace_back(LambertianPipeline::SpotLight{
+					out.spot_lights.emplace_back(LambertianPipeline::SpotLight{
 						.POSITION = glm::vec4(light_position, 0.0f),
 						.shadow_size = cur_light.shadow,
 						.DIRECTION = light_direction,
@@ -3122,14 +4089,10 @@ void RTGRenderer::update(float dt) {
 				}
 			}
 
-			for (uint32_t child_index : cur_node.children) {
-				collect_node_information(child_index);
-			}
 			// draw own mesh
 			if (int32_t cur_mesh_index = cur_node.mesh_index; cur_mesh_index != -1) {
-				glm::mat4x4 WORLD_FROM_LOCAL = transform_stack.back();
-				glm::mat4x4 WORLD_FROM_LOCAL_NORMAL = glm::mat4x4(glm::inverse(glm::transpose(glm::mat3(WORLD_FROM_LOCAL))));
-				OBB obb = AABB_transform_to_OBB(WORLD_FROM_LOCAL, mesh_AABBs[cur_mesh_index]);
+				glm::mat4x4 const &WORLD_FROM_LOCAL_NORMAL = hierarchy.world_normal[entry];
+				OBB const &obb = item_obbs[entry_item[entry]];
 				{//draw debug obb and frustum
 					
 					if (view_camera == DebugCamera) {//debug draw the OBBs
@@ -3144,99 +4107,99 @@ void RTGRenderer::update(float dt) {
 							obb.center - obb.extents[0] * obb.axes[0] - obb.extents[1]*obb.axes[1] - obb.extents[2]*obb.axes[2]
 						};
 
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[0].x, .y = vertices[0].y, .z = vertices[0].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[1].x, .y = vertices[1].y, .z = vertices[1].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[0].x, .y = vertices[0].y, .z = vertices[0].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[2].x, .y = vertices[2].y, .z = vertices[2].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[2].x, .y = vertices[2].y, .z = vertices[2].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[3].x, .y = vertices[3].y, .z = vertices[3].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[3].x, .y = vertices[3].y, .z = vertices[3].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[1].x, .y = vertices[1].y, .z = vertices[1].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[0].x, .y = vertices[0].y, .z = vertices[0].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[4].x, .y = vertices[4].y, .z = vertices[4].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[4].x, .y = vertices[4].y, .z = vertices[4].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[6].x, .y = vertices[6].y, .z = vertices[6].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[2].x, .y = vertices[2].y, .z = vertices[2].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[6].x, .y = vertices[6].y, .z = vertices[6].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[4].x, .y = vertices[4].y, .z = vertices[4].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[5].x, .y = vertices[5].y, .z = vertices[5].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[6].x, .y = vertices[6].y, .z = vertices[6].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[7].x, .y = vertices[7].y, .z = vertices[7].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[1].x, .y = vertices[1].y, .z = vertices[1].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[5].x, .y = vertices[5].y, .z = vertices[5].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[3].x, .y = vertices[3].y, .z = vertices[3].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[7].x, .y = vertices[7].y, .z = vertices[7].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[5].x, .y = vertices[5].y, .z = vertices[5].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
-						lines_vertices.emplace_back(PosColVertex{
+						out.lines_vertices.emplace_back(PosColVertex{
 							.Position{.x = vertices[7].x, .y = vertices[7].y, .z = vertices[7].z},
 							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 						});
@@ -3244,109 +4207,311 @@ void RTGRenderer::update(float dt) {
 					
 				}
 
-				if (uint32_t cur_material_index = scene.meshes[cur_mesh_index].material_index; cur_material_index != -1) { /// has some material
-					const Scene::Material& cur_material = scene.materials[scene.meshes[cur_mesh_index].material_index];
-					uint32_t instance_index = 0;
-					if (cur_material.material_type == Scene::Material::MaterialType::Lambertian) {
-						instance_index = uint32_t(lambertian_instances.size());
-						lambertian_instances.emplace_back(ObjectInstance{
-							.vertices = mesh_vertices[cur_mesh_index],
-							.transform{
-								.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-							},
-							.material_index = cur_material_index,
-						});
-					}
-					else if (cur_material.material_type == Scene::Material::MaterialType::Environment) {
-						instance_index = uint32_t(environment_instances.size());
-						environment_instances.emplace_back(ObjectInstance{
-							.vertices = mesh_vertices[cur_mesh_index],
-							.transform{
-								.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-							},
-							.material_index = cur_material_index,
-						});
-					}
-					else if (cur_material.material_type == Scene::Material::MaterialType::Mirror) {
-						instance_index = uint32_t(mirror_instances.size());
-						mirror_instances.emplace_back(ObjectInstance{
-							.vertices = mesh_vertices[cur_mesh_index],
-							.transform{
-								.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-							},
-							.material_index = cur_material_index,
-						});
-					}
-					else if (cur_material.material_type == Scene::Material::MaterialType::PBR) {
-						instance_index = uint32_t(pbr_instances.size());
-						pbr_instances.emplace_back(ObjectInstance{
-							.vertices = mesh_vertices[cur_mesh_index],
-							.transform{
-								.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-							},
-							.material_index = cur_material_index,
-						});
-					}
-					if (rtg.configuration.culling_settings == 1 && check_frustum_obb_intersection(frustum_vertices, obb)) {
-						in_view_instances[static_cast<uint32_t>(cur_material.material_type)].push_back(instance_index);
-					}
-					for (uint32_t frustum_i = 0; frustum_i < in_spot_light_instances.size(); ++frustum_i) {
-						if (check_frustum_obb_intersection(light_frustums[frustum_i], obb)) {
-							in_spot_light_instances[frustum_i][static_cast<uint32_t>(cur_material.material_type)].push_back(instance_index);
-						}
-					}
+				//the material picks the pipeline; meshes without one use the lambertian pipeline to render the default albedo, displacement and normal maps:
+				uint32_t material_index = scene.meshes[cur_mesh_index].material_index;
+				uint32_t pipeline_index = static_cast<uint32_t>(Scene::Material::Lambertian);
+				if (material_index != -1) {
+					pipeline_index = static_cast<uint32_t>(scene.materials[material_index].material_type);
 				}
 				else {
-					if (rtg.configuration.culling_settings == 1 && check_frustum_obb_intersection(frustum_vertices, obb)) {
-						in_view_instances[0].push_back(uint32_t(lambertian_instances.size()));
-					}
-					for (uint32_t frustum_i = 0; frustum_i < in_spot_light_instances.size(); ++frustum_i) {
-						if (check_frustum_obb_intersection(light_frustums[i], obb)) {
-							in_spot_light_instances[frustum_i][0].push_back(uint32_t(lambertian_instances.size()));
-						}
+					material_index = 0; //default material
+				}
+
+				//packed vertices are decoded from the mesh box by the same matrices that place them (normals need no decoding):
+				glm::mat4x4 WORLD_FROM_VERTEX = (mesh_position_decode.empty() ? WORLD_FROM_LOCAL : WORLD_FROM_LOCAL * mesh_position_decode[cur_mesh_index]);
+
+				uint32_t instance_index = uint32_t(out.instances[pipeline_index].size());
+				out.instances[pipeline_index].emplace_back(ObjectInstance{
+					.vertices = mesh_vertices[cur_mesh_index],
+					.transform{
+						.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_VERTEX,
+						.WORLD_FROM_LOCAL = WORLD_FROM_VERTEX,
+						.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
+					},
+					.material_index = material_index,
+					.mesh_index = cur_mesh_index,
+				});
+				out.item_instances.emplace_back(pipeline_index, instance_index);
+			}
+		};
+
+		//walk the flattened hierarchy in fixed-size chunks of entries; idle workers pull the next chunk, so uneven chunks balance out:
+		uint32_t entry_count = uint32_t(hierarchy.node.size());
+		uint32_t chunk_count = (entry_count + CollectChunkSize - 1) / CollectChunkSize;
+		if (collect_chunks.size() < chunk_count) collect_chunks.resize(chunk_count);
+		thread_pool.parallel_for(chunk_count, [&](uint32_t c) {
+			CollectChunk &out = collect_chunks[c];
+			out.clear();
+			uint32_t end = std::min(entry_count, (c + 1) * CollectChunkSize);
+			for (uint32_t entry = c * CollectChunkSize; entry < end; ++entry) {
+				collect_entry(out, entry);
+			}
+		});
+
+		//exclusive prefix sums of the per-chunk counts place every chunk's lists in the merged lists,
+		// so the result (including light order) is the same as a serial depth-first walk:
+		std::array<std::vector<ObjectInstance> *, 4> instances{&lambertian_instances, &environment_instances, &mirror_instances, &pbr_instances};
+		std::array<uint32_t, 4> instances_total{};
+		uint32_t item_instances_total = 0;
+		uint32_t sun_lights_total = 0, sphere_lights_total = 0, spot_lights_total = 0;
+		uint32_t lines_vertices_total = uint32_t(lines_vertices.size()); //(after the frustum lines added above)
+		for (uint32_t c = 0; c < chunk_count; ++c) {
+			CollectChunk &chunk = collect_chunks[c];
+			for (uint32_t m = 0; m < 4; ++m) {
+				chunk.instances_base[m] = instances_total[m];
+				instances_total[m] += uint32_t(chunk.instances[m].size());
+			}
+			chunk.item_instances_base = item_instances_total;
+			item_instances_total += uint32_t(chunk.item_instances.size());
+			chunk.sun_lights_base = sun_lights_total;
+			sun_lights_total += uint32_t(chunk.sun_lights.size());
+			chunk.sphere_lights_base = sphere_lights_total;
+			sphere_lights_total += uint32_t(chunk.sphere_lights.size());
+			chunk.spot_lights_base = spot_lights_total;
+			spot_lights_total += uint32_t(chunk.spot_lights.size());
+			chunk.lines_vertices_base = lines_vertices_total;
+			lines_vertices_total += uint32_t(chunk.lines_vertices.size());
+		}
+
+		//size the merged lists, then copy the chunks into place in parallel:
+		for (uint32_t m = 0; m < 4; ++m) {
+			instances[m]->resize(instances_total[m]);
+		}
+		assert(item_instances_total == item_obbs.size());
+		item_instances.resize(item_instances_total);
+		sun_lights.resize(sun_lights_total);
+		sphere_lights.resize(sphere_lights_total);
+		spot_lights.resize(spot_lights_total);
+		lines_vertices.resize(lines_vertices_total);
+
+		thread_pool.parallel_for(chunk_count, [&](uint32_t c) {
+			CollectChunk const &chunk = collect_chunks[c];
+			for (uint32_t m = 0; m < 4; ++m) {
+				std::copy(chunk.instances[m].begin(), chunk.instances[m].end(), instances[m]->begin() + chunk.instances_base[m]);
+			}
+			//item instance indices are chunk-local; shift them by the chunk's place in the merged instances:
+			std::transform(chunk.item_instances.begin(), chunk.item_instances.end(), item_instances.begin() + chunk.item_instances_base,
+				[&chunk](std::pair<uint32_t, uint32_t> item) { return std::make_pair(item.first, item.second + chunk.instances_base[item.first]); });
+			std::copy(chunk.sun_lights.begin(), chunk.sun_lights.end(), sun_lights.begin() + chunk.sun_lights_base);
+			std::copy(chunk.sphere_lights.begin(), chunk.sphere_lights.end(), sphere_lights.begin() + chunk.sphere_lights_base);
+			std::copy(chunk.spot_lights.begin(), chunk.spot_lights.end(), spot_lights.begin() + chunk.spot_lights_base);
+			std::copy(chunk.lines_vertices.begin(), chunk.lines_vertices.end(), lines_vertices.begin() + chunk.lines_vertices_base);
+		});
+
+		{//sun cascades (see Cascade), culled and drawn as shadow views after the spot lights:
+			cascades.clear();
+			glm::mat4x4 world_from_view = glm::inverse(view_from_world[view_camera]);
+			glm::mat4x4 const &clip_from_camera = clip_from_view[view_camera];
+			//distance from the view axis to a corner of the view frustum, per unit of depth:
+			float corner_slope = glm::length(glm::vec2(1.0f / clip_from_camera[0][0], 1.0f / clip_from_camera[1][1]));
+			//weight of logarithmic (vs uniform) split depths; mostly logarithmic keeps texels about the same size on screen:
+			constexpr float LogSplitWeight = 0.9f;
+
+			uint32_t shadowed = 0;
+			uint64_t cascade_texels = shadow_atlas.texel_budget / ShadowAtlas::CascadeShare; //(left for the suns' cascades)
+			for (uint32_t s = 0; s < sun_lights.size() && shadowed < rtg.configuration.sun_shadows; ++s) {
+				LambertianPipeline::SunLight &sun = sun_lights[s];
+				if (rtg.configuration.cascade_size != 0) sun.shadow_size = rtg.configuration.cascade_size;
+				if (sun.shadow_size == 0) continue;
+				//(the sizes the atlas will hand out)
+				std::vector<uint32_t> resolutions = shadow_atlas.fit_cascades(sun.shadow_size, rtg.configuration.cascades, cascade_texels);
+				if (resolutions.empty()) {
+					sun.shadow_size = 0;
+					continue;
+				}
+				shadowed += 1; //(only suns that actually get cascades count toward --sun-shadows)
+				sun.shadow_size = resolutions[0];
+
+				//the light looks along the sunlight (DIRECTION points toward the sun):
+				glm::vec3 forward = -glm::normalize(sun.DIRECTION);
+				glm::vec3 world_up = glm::vec3(0.0f, 0.0f, 1.0f);
+				if (glm::abs(glm::dot(forward, world_up)) > 0.999f) {
+					world_up = glm::vec3(0.0f, 1.0f, 0.0f);
+				}
+				glm::mat4x4 light_from_world = glm::make_mat4(look_at(
+					0.0f, 0.0f, 0.0f, //eye
+					forward.x, forward.y, forward.z, //target
+					world_up.x, world_up.y, world_up.z //up
+				).data());
+
+				//the scene's nearest point to the sun (casters between the sun and a slice can be anywhere in it):
+				float scene_top = -std::numeric_limits<float>::infinity();
+				if (!instance_bvh.nodes.empty()) {
+					AABB const &bounds = instance_bvh.nodes[0].bounds;
+					for (uint32_t c = 0; c < 8; ++c) {
+						glm::vec3 corner((c & 1) ? bounds.max.x : bounds.min.x, (c & 2) ? bounds.max.y : bounds.min.y, (c & 4) ? bounds.max.z : bounds.min.z);
+						scene_top = std::max(scene_top, (light_from_world * glm::vec4(corner, 1.0f)).z);
 					}
-					// use lambertian pipeline to render the default albedo, displacement and normal maps
-					lambertian_instances.emplace_back(ObjectInstance{
-						.vertices = mesh_vertices[cur_mesh_index],
-						.transform{
-							.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-							.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-							.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-						},
-						.material_index = 0,//default material
+				}
+
+				float split_near = view_near;
+				for (uint32_t c = 0; c < rtg.configuration.cascades; ++c) {
+					float t = float(c + 1) / float(rtg.configuration.cascades);
+					float split_far = LogSplitWeight * view_near * std::pow(view_far / view_near, t) + (1.0f - LogSplitWeight) * (view_near + (view_far - view_near) * t);
+					sun.CASCADE_SPLITS[c] = split_far;
+
+					//bounding sphere of the slice, centered on the view axis (so it doesn't change as the view turns):
+					float near_corner = corner_slope * split_near, far_corner = corner_slope * split_far;
+					float center_depth = (split_far * split_far + far_corner * far_corner - split_near * split_near - near_corner * near_corner) / (2.0f * (split_far - split_near));
+					center_depth = std::clamp(center_depth, split_near, split_far);
+					float radius = std::max(
+						glm::length(glm::vec2(center_depth - split_near, near_corner)),
+						glm::length(glm::vec2(split_far - center_depth, far_corner))
+					);
+					glm::vec3 center = glm::vec3(world_from_view * glm::vec4(0.0f, 0.0f, -center_depth, 1.0f));
+
+					//snap the center to whole texels in light space (with a texel of margin around the sphere for the snapping):
+					float texel = 2.0f * radius / float(resolutions[c] - 2);
+					float half_extent = 0.5f * texel * float(resolutions[c]);
+					glm::vec3 light_center = glm::vec3(light_from_world * glm::vec4(center, 1.0f));
+					light_center = glm::floor(light_center / texel) * texel;
+
+					//depth runs from the nearest caster (or the front of the sphere) to the back of the sphere:
+					float top = std::max(light_center.z + half_extent, scene_top);
+					glm::mat4x4 projection = glm::make_mat4(orthographic(
+						light_center.x - half_extent, light_center.x + half_extent, //left, right
+						light_center.y - half_extent, light_center.y + half_extent, //bottom, top
+						-top, half_extent - light_center.z //near, far
+					).data());
+					cascades.emplace_back(Cascade{
+						.sun_light = s,
+						.index = c,
+						.resolution = resolutions[c],
+						.light_from_world = projection * light_from_world,
 					});
+
+					//its box, for culling:
+					glm::mat4x4 world_from_clip = glm::inverse(cascades.back().light_from_world);
+					std::array<glm::vec3, 8> &frustum = light_frustums.emplace_back();
+					for (int j = 0; j < 8; ++j) {
+						glm::vec4 world_space_vertex = world_from_clip * clip_space_coordinates[j];
+						frustum[j] = glm::vec3(world_space_vertex) / world_space_vertex.w;
+					}
+
+					split_near = split_far;
 				}
 			}
-			
-			transform_stack.pop_back();
-		};
+		}
+
+		uint32_t shadow_frustums = spot_frustums + uint32_t(cascades.size());
+		uint32_t frustum_count = 1 + shadow_frustums;
+		in_spot_light_instances.resize(shadow_frustums);
+		if (rtg.configuration.culling_settings >= 2) {
+			//the compute pass in render() culls; it only needs the planes of every frustum:
+			for (std::vector<uint32_t> &list : in_view_instances) {
+				list.clear();
+			}
+			for (auto &per_material : in_spot_light_instances) {
+				for (std::vector<uint32_t> &list : per_material) {
+					list.clear();
+				}
+			}
+			cull_frustum_planes.clear();
+			for (uint32_t f = 0; f < frustum_count; ++f) {
+				FrustumPlanes planes = make_frustum_planes(f == 0 ? frustum_vertices : light_frustums[f - 1]);
+				for (uint32_t p = 0; p < 6; ++p) {
+					//(a missing degenerate plane is replaced by one that everything is in front of)
+					cull_frustum_planes.emplace_back(p < planes.count ? planes.planes[p] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+				}
+			}
+			//shadow caching still needs to know what each shadow view might see: every instance whose bounds reach its
+			// frustum in instance_bvh (no exact box test; a few extra instances only cost an occasional redraw):
+			shadow_view_instance_hashes.resize(shadow_frustums);
+			if (cull_scratch.size() < shadow_frustums) cull_scratch.resize(shadow_frustums);
+			thread_pool.parallel_for(shadow_frustums, [&](uint32_t f) {
+				CullScratch &scratch = cull_scratch[f];
+				instance_bvh.cull(make_frustum_planes(light_frustums[f]), scratch.inside, scratch.intersecting);
+				scratch.inside.insert(scratch.inside.end(), scratch.intersecting.begin(), scratch.intersecting.end());
+				//(the tree's order shifts as items move between inside and intersecting, so hash in item order)
+				std::sort(scratch.inside.begin(), scratch.inside.end());
+				uint64_t hash = 0;
+				for (uint32_t item : scratch.inside) {
+					auto [pipeline_index, instance_index] = item_instances[item];
+					hash = hash_instance(hash, pipeline_index, instance_index, (*instances[pipeline_index])[instance_index]);
+				}
+				shadow_view_instance_hashes[f] = hash;
+			});
+		} else {
+			//cull the view and every spot light frustum in parallel (one frustum per job) by descending instance_bvh;
+			// items whose bounds only cross a frustum's planes get the exact box test, a batch per frustum:
+			if (cull_scratch.size() < frustum_count) cull_scratch.resize(frustum_count);
+			thread_pool.parallel_for(frustum_count, [&](uint32_t f) {
+				std::array<std::vector<uint32_t>, 4> &lists = (f == 0 ? in_view_instances : in_spot_light_instances[f - 1]);
+				for (std::vector<uint32_t> &list : lists) {
+					list.clear();
+				}
+				if (f == 0 && rtg.configuration.culling_settings != 1) return;
+				std::array<glm::vec3, 8> const &frustum = (f == 0 ? frustum_vertices : light_frustums[f - 1]);
+
+				CullScratch &scratch = cull_scratch[f];
+				instance_bvh.cull(make_frustum_planes(frustum), scratch.inside, scratch.intersecting);
+				scratch.obbs.clear();
+				for (uint32_t item : scratch.intersecting) {
+					scratch.obbs.push_back(item_obbs[item]);
+				}
+				cull_obbs(frustum, scratch.obbs, scratch.visible);
 
-		//traverse the scene hiearchy:
-		for (uint32_t i = 0; i < scene.root_nodes.size(); ++i) {
-			transform_stack.clear();
-			collect_node_information(scene.root_nodes[i]);
+				auto add = [&](uint32_t item) {
+					auto [pipeline_index, instance_index] = item_instances[item];
+					lists[pipeline_index].push_back(instance_index);
+				};
+				for (uint32_t item : scratch.inside) {
+					add(item);
+				}
+				for (uint32_t word = 0; word < scratch.visible.size(); ++word) {
+					for (uint64_t bits = scratch.visible[word]; bits != 0; bits &= bits - 1) {
+						add(scratch.intersecting[word * 64 + std::countr_zero(bits)]);
+					}
+				}
+				if (f == 0) {
+					//the view draws in draw_sort_key order (pipeline is implied by the list):
+					for (uint32_t m = 0; m < 4; ++m) {
+						scratch.sort_keys.clear();
+						for (uint32_t index : lists[m]) {
+							scratch.sort_keys.emplace_back(draw_sort_key((*instances[m])[index]));
+						}
+						radix_sort_by_key(scratch.sort_keys, lists[m], scratch.sort_keys_tmp, scratch.sort_values_tmp);
+					}
+				} else {
+					//the tree hands items out in its own order; shadows draw in hierarchy order as before:
+					for (std::vector<uint32_t> &list : lists) {
+						std::sort(list.begin(), list.end());
+					}
+				}
+			});
 		}
 	}
 
-	{// shadow map atlas organization
+	if (rtg.configuration.light_binning == 1) {//bin the sphere and spot lights into the view's clusters here instead of in a compute pass:
+		LightBinning::View view = LightBinning::make_view(view_from_world[view_camera], clip_from_view[view_camera], world.CLUSTER_Z);
+		light_binning.bin(sphere_lights, spot_lights, view, &thread_pool);
+	}
 
-		// reduce shadow map size if requesting too many
-		uint8_t reduction = 0;
-		while (total_shadow_size > shadow_atlas_length * shadow_atlas_length) {
-			total_shadow_size/= 4;
-			++reduction;
+	{// shadow map atlas organization: resolution by each light's size on the view's screen, stable regions between frames
+		float pixels_per_unit = 0.5f * float(rtg.swapchain_extent.height) * std::abs(clip_from_view[view_camera][1][1]);
+		std::vector<uint32_t> cascade_sizes;
+		for (Cascade const &cascade : cascades) {
+			cascade_sizes.emplace_back(cascade.resolution);
+		}
+		uint32_t dropped_before = shadow_atlas.dropped;
+		shadow_atlas.update_regions(spot_lights, scene.spot_lights_sorted_indices, cascade_sizes, world.CAMERA_POSITION, pixels_per_unit);
+		if (rtg.configuration.debug && shadow_atlas.dropped != dropped_before) {
+			std::cout << "Shadow atlas: " << shadow_atlas.dropped << " of " << spot_lights.size() << " spot lights get no shadow region (drawn unshadowed)." << std::endl;
+		}
+		//lights the budget left without a region draw unshadowed this frame (the shaders test SHADOW_SIZE):
+		for (uint32_t i = 0; i < spot_lights.size(); ++i) {
+			if (shadow_atlas.regions[i].size == 0) spot_lights[i].shadow_size = 0;
+		}
+		//(and suns only get shadows when all of their cascades fit)
+		for (Cascade const &cascade : cascades) {
+			sun_lights[cascade.sun_light].CASCADE_COUNT = cascade.index + 1;
+		}
+		for (uint32_t c = 0; c < cascades.size(); ++c) {
+			LambertianPipeline::SunLight &sun = sun_lights[cascades[c].sun_light];
+			ShadowAtlas::Region const &region = shadow_atlas.cascade_regions[c];
+			if (region.size == 0) sun.CASCADE_COUNT = 0;
+			sun.ATLAS_COORD_FROM_WORLD[cascades[c].index] = ShadowAtlas::calculate_shadow_atlas_matrix(cascades[c].light_from_world, region, shadow_atlas_length);
 		}
-		shadow_atlas.update_regions(spot_lights, scene.spot_lights_sorted_indices, reduction);
-		//reset total_shadow_size
-		total_shadow_size = 0;
 	}
 
 	{ // cloud world information
@@ -3366,6 +4531,50 @@ void RTGRenderer::update(float dt) {
 }
 
 
+void RTGRenderer::CollectChunk::clear() {
+	for (uint32_t m = 0; m < 4; ++m) {
+		instances[m].clear();
+	}
+	item_instances.clear();
+	sun_lights.clear();
+	sphere_lights.clear();
+	spot_lights.clear();
+	lines_vertices.clear();
+}
+
+void RTGRenderer::update_instance_bvh() {
+	Scene::Hierarchy const &hierarchy = scene.hierarchy;
+	auto entry_obb = [&](uint32_t entry) {
+		return AABB_transform_to_OBB(hierarchy.world[entry], mesh_AABBs[scene.nodes[hierarchy.node[entry]].mesh_index]);
+	};
+
+	if (entry_item.size() != hierarchy.node.size()) {
+		//(first frame) number the entries that have meshes and build the tree over all of them:
+		entry_item.assign(hierarchy.node.size(), -1);
+		item_obbs.clear();
+		std::vector<AABB> bounds;
+		for (uint32_t entry = 0; entry < hierarchy.node.size(); ++entry) {
+			if (scene.nodes[hierarchy.node[entry]].mesh_index == -1) continue;
+			entry_item[entry] = int32_t(item_obbs.size());
+			item_obbs.emplace_back(entry_obb(entry));
+			bounds.emplace_back(OBB_to_AABB(item_obbs.back()));
+		}
+		instance_bvh.build(bounds);
+		return;
+	}
+
+	//otherwise only the subtrees that got new world matrices move:
+	for (auto [first, end] : hierarchy.updated) {
+		for (uint32_t entry = first; entry < end; ++entry) {
+			int32_t item = entry_item[entry];
+			if (item == -1) continue;
+			item_obbs[item] = entry_obb(entry);
+			instance_bvh.update(item, OBB_to_AABB(item_obbs[item]));
+		}
+	}
+	instance_bvh.refit();
+}
+
 void RTGRenderer::on_input(InputEvent const &event) {
 	bool update_camera = false;
 
@@ -2,12 +2,16 @@
 
 #include "PosColVertex.hpp"
 #include "PosNorTanTexVertex.hpp"
+#include "PosNorTanTexPackedVertex.hpp"
 
 #include "RTG.hpp"
 #include "Scene.hpp"
 #include "Cloud.hpp"
 #include "mat4.hpp"
 #include "frustum_culling.hpp"
+#include "BVH.hpp"
+#include "ThreadPool.hpp"
+#include "light_binning.hpp"
 
 #include "GLM.hpp"
 
@@ -22,6 +26,9 @@ struct RTGRenderer : RTG::Application {
 
 	//scene that contains nodes, camera, light, material and texture information
 	Scene &scene;
+
+	//worker threads for loading and per-frame CPU work:
+	ThreadPool thread_pool;
 	//--------------------------------------------------------------------
 	//Resources that last the lifetime of the application:
 
@@ -85,6 +92,7 @@ struct RTGRenderer : RTG::Application {
 		VkPipelineLayout layout = VK_NULL_HANDLE;
 
 		using Vertex = PosNorTanTexVertex;
+		using PackedVertex = PosNorTanTexPackedVertex; //with --vertex-format packed
 
 		VkPipeline handle = VK_NULL_HANDLE;
 
@@ -109,15 +117,23 @@ struct RTGRenderer : RTG::Application {
 			uint32_t SPHERE_LIGHT_COUNT;
 			uint32_t SPOT_LIGHT_COUNT;
 			uint32_t SHADOW_ATLAS_SIZE = shadow_atlas_length;
+			glm::mat4x4 CLIP_FROM_WORLD; //the view camera (fragments find their light cluster with it)
+			glm::vec2 CLUSTER_Z; //light cluster slice of view depth d is log(d) * x + y (see LightClusterPipeline)
+			glm::vec2 PADDING;
         };
-        static_assert(sizeof(World) == 4*3 + 4 + 4 + 4 + 4 + 4, "World is the expected size.");
+        static_assert(sizeof(World) == 4*3 + 4 + 4 + 4 + 4 + 4 + 16*4 + 2*4 + 2*4, "World is the expected size.");
 
 		struct SunLight {
-			glm::vec4 DIRECTION; // w padding
+			glm::vec3 DIRECTION;
+			uint32_t shadow_size = 0; //nearest cascade's resolution; each farther one has half as many texels on a side (0: no shadow)
 			glm::vec3 ENERGY;
 			float SIN_ANGLE;
+			glm::vec4 CASCADE_SPLITS = glm::vec4(0.0f); //view depth where each cascade ends
+			uint32_t CASCADE_COUNT = 0; //0: unshadowed
+			uint32_t PADDING[3] = {};
+			glm::mat4x4 ATLAS_COORD_FROM_WORLD[4]; //per cascade (see Cascade)
 		};
-		static_assert(sizeof(SunLight) == 4*4 + 4*3 + 4, "SunLight is the expected size.");
+		static_assert(sizeof(SunLight) == 4*3 + 4 + 4*3 + 4 + 4*4 + 4 + 4*3 + 4 * 16*4, "SunLight is the expected size.");
 
 		struct SphereLight {
 			glm::vec3 POSITION;
@@ -153,6 +169,7 @@ struct RTGRenderer : RTG::Application {
 		VkPipelineLayout layout = VK_NULL_HANDLE;
 
 		using Vertex = PosNorTanTexVertex;
+		using PackedVertex = PosNorTanTexPackedVertex; //with --vertex-format packed
 
 		VkPipeline handle = VK_NULL_HANDLE;
 
@@ -173,6 +190,7 @@ struct RTGRenderer : RTG::Application {
 		VkPipelineLayout layout = VK_NULL_HANDLE;
 
 		using Vertex = PosNorTanTexVertex;
+		using PackedVertex = PosNorTanTexPackedVertex; //with --vertex-format packed
 
 		VkPipeline handle = VK_NULL_HANDLE;
 
@@ -193,6 +211,7 @@ struct RTGRenderer : RTG::Application {
 		VkPipelineLayout layout = VK_NULL_HANDLE;
 
 		using Vertex = PosNorTanTexVertex;
+		using PackedVertex = PosNorTanTexPackedVertex; //with --vertex-format packed
 
 		VkPipeline handle = VK_NULL_HANDLE;
 
@@ -213,6 +232,7 @@ struct RTGRenderer : RTG::Application {
 		VkPipelineLayout layout = VK_NULL_HANDLE;
 
 		using Vertex = PosNorTanTexVertex;
+		using PackedVertex = PosNorTanTexPackedVertex; //with --vertex-format packed
 
 		VkPipeline handle = VK_NULL_HANDLE;
 
@@ -268,6 +288,95 @@ struct RTGRenderer : RTG::Application {
 		void destroy(RTG &);
 	} cloud_lightgrid_pipeline;
 
+	//GPU frustum culling (--culling gpu): tests every instance's box against the view and spot light frustums and
+	// writes the survivors' draw commands into the indirect batches (see IndirectBatch):
+	struct CullPipeline {
+		//descriptor set layouts:
+		VkDescriptorSetLayout set0_Cull = VK_NULL_HANDLE; //instances, frustum planes, batch offsets (read); commands, counts (written); visibility, depth pyramid
+
+		//types for descriptors:
+		struct Instance {
+			glm::vec4 CENTER; //xyz: world-space box center
+			glm::vec4 HALF_AXES[3]; //xyz: box axes scaled by the half extents
+			uint32_t FIRST_INDEX; //the mesh's indices (see ObjectVertices)
+			uint32_t INDEX_COUNT;
+			int32_t VERTEX_OFFSET;
+			uint32_t BATCH; //batch in the view frustum
+			uint32_t VIEW_SLOT; //command within BATCH when not compacting
+			uint32_t PADDING[3]; //(std430 rounds the struct up to a multiple of its vec4 alignment)
+		};
+		static_assert(sizeof(Instance) == 16*4 + 8*4, "cull instance structure is packed");
+
+		struct Push {
+			glm::mat4 CLIP_FROM_WORLD; //(occlusion) the view's camera
+			glm::vec4 VIEWPORT; //(occlusion) xy: offset, zw: extent of the view's viewport, in depth buffer pixels
+			glm::vec2 PYRAMID_SCALE; //(occlusion) depth pyramid level 0 texels per depth buffer pixel
+			uint32_t INSTANCE_COUNT;
+			uint32_t VIEW_BATCHES; //light frustum f (counting from 1) writes to batch VIEW_BATCHES + f - 1
+			uint32_t LATE_BATCHES; //(occlusion) the late phase writes to batch LATE_BATCHES + Instance::BATCH
+			uint32_t COMPACT; //1: append visible instances and count them (for vkCmdDrawIndexedIndirectCount), 0: culled instances draw nothing
+			uint32_t OCCLUSION; //1: cull the view in an early and a late phase (--culling occlusion, see cull.comp)
+			uint32_t PHASE; //0: view (early phase) and spot light frustums, 1: late phase
+		};
+		static_assert(sizeof(Push) == 16*4 + 4*4 + 2*4 + 6*4, "cull push constants are packed");
+		static constexpr uint32_t WorkgroupSize = 64; //matches cull.comp
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+
+		VkPipeline handle = VK_NULL_HANDLE;
+
+		void create(RTG &);
+		void destroy(RTG &);
+	} cull_pipeline;
+
+	//builds the depth pyramid for --culling occlusion, one level per dispatch:
+	struct DepthPyramidPipeline {
+		//descriptor set layouts:
+		VkDescriptorSetLayout set0_Level = VK_NULL_HANDLE; //level below (read), level being built (written)
+
+		struct Push {
+			glm::ivec2 SRC_SIZE;
+			glm::ivec2 DST_SIZE;
+		};
+		static constexpr uint32_t WorkgroupSize = 8; //matches depth_pyramid.comp (in x and y)
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+
+		VkPipeline handle = VK_NULL_HANDLE;
+
+		void create(RTG &);
+		void destroy(RTG &);
+	} depth_pyramid_pipeline;
+
+	//clustered light assignment: the view frustum is split into ClusterCountX x ClusterCountY screen tiles by ClusterCountZ
+	// slices of view depth (exponentially spaced between the near and far planes); this compute pass lists the sphere
+	// and spot lights whose range reaches each cluster, so lambertian.frag and pbr.frag only loop over their cluster's lights:
+	struct LightClusterPipeline {
+		//set 0 is the objects pipelines' set0_World (World, lights; cluster lists at binding 7, written here)
+
+		struct Push {
+			glm::mat4 VIEW_FROM_WORLD; //the view camera
+			glm::vec2 TAN_HALF_FOV; //view-space x and y at unit depth on the screen edge at ndc +1 (y is negative: Vulkan's y points down)
+			glm::vec2 PADDING;
+		};
+		static_assert(sizeof(Push) == 16*4 + 2*4 + 2*4, "light cluster push constants are packed");
+		static constexpr uint32_t WorkgroupSize = 64; //matches light_clusters.comp
+
+		static constexpr uint32_t ClusterCountX = 16, ClusterCountY = 9, ClusterCountZ = 24; //match clusters.glsl
+		static constexpr uint32_t ClusterCount = ClusterCountX * ClusterCountY * ClusterCountZ;
+		//each cluster's list: a word with the sphere light count (low 16 bits) and spot light count (high 16 bits),
+		// then the sphere light indices, then the spot light indices. Sphere and spot lights share ClusterStride - 1
+		// slots (a combined cap, not one per kind); sphere lights are listed first and lights past the cap are dropped:
+		static constexpr uint32_t ClusterStride = 256; //uints, matches clusters.glsl
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+
+		VkPipeline handle = VK_NULL_HANDLE;
+
+		void create(RTG &, VkDescriptorSetLayout set0_World);
+		void destroy(RTG &);
+	} light_cluster_pipeline;
+
 	//pools from which per-workspace things are allocated:
 	VkCommandPool command_pool = VK_NULL_HANDLE;
 	
@@ -277,27 +386,29 @@ struct RTGRenderer : RTG::Application {
 	//workspaces hold per-render resources:
 	struct Workspace {
 		VkCommandBuffer command_buffer = VK_NULL_HANDLE; //from the command pool above; reset at the start of every render.
+
+		//render() records the shadow atlas and main pass draws into secondary command buffers on the thread pool; a command
+		// pool may only be used by one thread at a time, so each recording thread has its own (indexed by ThreadPool::thread_index()):
+		struct RecordingPool {
+			VkCommandPool handle = VK_NULL_HANDLE; //reset at the start of every render
+			std::vector< VkCommandBuffer > secondaries; //allocated as needed and reused every frame
+			uint32_t used = 0; //secondaries handed out since the last reset
+		};
+		std::vector< RecordingPool > recording_pools;
 		
-		//location for lines data: (streamed to GPU per-frame)
-		Helpers::AllocatedBuffer lines_vertices_src; //host coherent; mapped
-		Helpers::AllocatedBuffer lines_vertices; //device-local
-
-		//location for LinesPipeline::Camera data: (streamed to GPU per-frame)
-		Helpers::AllocatedBuffer Camera_src; //host coherent; mapped
-		Helpers::AllocatedBuffer Camera; //device-local
-		VkDescriptorSet Camera_descriptors; //references Camera
-
-        //location for LambertianPipeline::World data: (streamed to GPU per-frame)
-        Helpers::AllocatedBuffer World_src; //host coherent; mapped
-        Helpers::AllocatedBuffer World; //device-local
-		Helpers::AllocatedBuffer Light_src; //host coherent; mapped
-        Helpers::AllocatedBuffer Light; //device-local
-        VkDescriptorSet World_descriptors; //references World
-
-        // locations for LambertianPipeline::Transforms data: (streamed to GPU per-frame):
-        Helpers::AllocatedBuffer Transforms_src; //host coherent; mapped
-        Helpers::AllocatedBuffer Transforms; //device-local
-        VkDescriptorSet Transforms_descriptors; //references Transforms
+		//per-frame data (lines vertices, Camera, World, lights, Transforms, Cloud_World) is pushed here every render
+		// and bound at dynamic offsets, so nothing is copied on the GPU and the descriptors below stay valid:
+		Helpers::StreamBuffer stream;
+
+		VkDescriptorSet Camera_descriptors; //references LinesPipeline::Camera in stream
+		VkDescriptorSet World_descriptors; //references LambertianPipeline::World and the lights in stream, and Light_clusters
+		Helpers::AllocatedBuffer Light_clusters; //cluster light lists, written every frame by light_cluster_pipeline (or copied from stream with --light-binning cpu)
+		VkDescriptorSet Transforms_descriptors; //references LambertianPipeline::Transforms in stream
+		VkDeviceSize Transforms_capacity = 0; //bytes of Transform the Transforms descriptor covers (grows with the instance count)
+		VkDescriptorSet Cull_descriptors; //references the GPU culling blocks in stream (rewritten every frame, as their sizes change)
+		//buffers replaced while earlier frames may still read them; destroyed the next time this workspace renders, since
+		// by then RTG has waited on this workspace's fence and every earlier frame's fence:
+		std::vector< Helpers::AllocatedBuffer > retired_buffers;
 
 		// Storage Image for Cloud Rendering Result
 		Helpers::AllocatedImage Cloud_target;
@@ -305,23 +416,36 @@ struct RTGRenderer : RTG::Application {
 		// Storage Image for Cloud Rendering Light Grid
 		Helpers::AllocatedImage3D Cloud_lightgrid;
 		VkImageView Cloud_lightgrid_view;
-		Helpers::AllocatedBuffer Cloud_World_src; //host coherent; mapped
-		Helpers::AllocatedBuffer Cloud_World; //device-local
-		VkDescriptorSet Cloud_World_descriptors; //references the target image for the compute shader
+		VkDescriptorSet Cloud_World_descriptors; //references the target image for the compute shader and CloudWorld in stream
 		VkDescriptorSet Cloud_LightGrid_World_descriptors; // used as world descriptor in light grid compute
 	};
 	std::vector< Workspace > workspaces;
+	//begin a secondary command buffer from the calling thread's recording pool, to be executed inside subpass 0 of 'render_pass':
+	VkCommandBuffer begin_secondary(Workspace &workspace, VkRenderPass render_pass, VkFramebuffer framebuffer);
+	//(re)write every descriptor that references workspace.stream (at creation and whenever the stream grows):
+	void write_stream_descriptors(Workspace &workspace);
+	//bytes of stream a frame with 'lines_bytes' of lines vertices and 'extra_bytes' of other blocks (indirect draws, GPU culling;
+	// each block already padded) needs, including alignment padding:
+	VkDeviceSize frame_stream_bytes(Workspace const &workspace, VkDeviceSize lines_bytes, VkDeviceSize extra_bytes) const;
 
 	//-------------------------------------------------------------------
 	//static scene resources:
 
     Helpers::AllocatedBuffer object_vertices;
-    struct ObjectVertices {
-		uint32_t first = 0;
-		uint32_t count = 0;
+	//the meshes' triangle lists are welded into indexed form at load (see mesh_indexing.hpp); each mesh's indices count
+	// from its own first vertex, so 16-bit indices are used whenever every mesh has at most 65536 distinct vertices:
+	Helpers::AllocatedBuffer object_indices;
+	VkIndexType object_index_type = VK_INDEX_TYPE_UINT32;
+    struct ObjectVertices { //arguments for vkCmdDrawIndexed
+		uint32_t first_index = 0; //in object_indices
+		uint32_t index_count = 0;
+		int32_t vertex_offset = 0; //the mesh's first vertex in object_vertices
 	};
 	std::vector<ObjectVertices> mesh_vertices; // indexed the same as scene.meshes
 	std::vector<AABB> mesh_AABBs; // also indexed the same as scene.meshes
+	//with --vertex-format packed, positions are stored within each mesh's box; this maps them back to the mesh's
+	// local space and is folded into the instance transforms (empty otherwise):
+	std::vector<glm::mat4x4> mesh_position_decode; // also indexed the same as scene.meshes
 
 	Helpers::AllocatedImage World_environment;
 	VkImageView World_environment_view = VK_NULL_HANDLE;
@@ -363,6 +487,17 @@ struct RTGRenderer : RTG::Application {
 
 	Helpers::AllocatedImage swapchain_depth_image;
 	VkImageView swapchain_depth_image_view = VK_NULL_HANDLE;
+
+	//--culling gpu/occlusion: farthest depth of the early phase, halved per level (level 0 is the largest power of two
+	// size that fits in the depth image); created with the depth image, rebuilt by every frame that culls for occlusion:
+	static constexpr uint32_t DepthPyramidMaxLevels = 16;
+	Helpers::AllocatedImage depth_pyramid;
+	uint32_t depth_pyramid_levels = 0;
+	VkImageView depth_pyramid_view = VK_NULL_HANDLE; //all levels (sampled by the culling pass)
+	std::array<VkImageView, DepthPyramidMaxLevels> depth_pyramid_level_views{}; //one level each (written by the build)
+	std::array<VkDescriptorSet, DepthPyramidMaxLevels> DepthPyramid_descriptors{}; //level l reads level l-1 (or the depth image) and writes l
+	VkSampler depth_pyramid_sampler = VK_NULL_HANDLE; //(only read with texelFetch)
+	VkRenderPass render_pass_resume = VK_NULL_HANDLE; //continues the main render pass after the depth pyramid build
 	std::vector< VkFramebuffer > swapchain_framebuffers;
 	//used from on_swapchain and the destructor: (framebuffers are created in on_swapchain)
 	void destroy_framebuffers();
@@ -392,13 +527,86 @@ struct RTGRenderer : RTG::Application {
 		ObjectVertices vertices;
 		Transform transform;
 		uint32_t material_index;
+		uint32_t mesh_index; //(part of the draw sort key; the view draws each run of one mesh as a single instanced draw)
 	};
+	//order for drawing instances of one pipeline: by material (so each is bound once per run), then mesh, then front to back:
+	static uint64_t draw_sort_key(ObjectInstance const &inst);
 	std::vector< ObjectInstance > lambertian_instances, environment_instances, mirror_instances, pbr_instances;
 
-	std::array<std::vector<uint32_t>, 4> in_view_instances; // order of array is lambertian, environment, mirror, pbr
+	std::array<std::vector<uint32_t>, 4> in_view_instances; // order of array is lambertian, environment, mirror, pbr; each sorted by draw_sort_key
 
+	//per shadow view: the spot lights (in spot_lights_sorted_indices order), then the sun cascades:
 	std::vector<std::array<std::vector<uint32_t>, 4>> in_spot_light_instances;
 
+	//counted by render(), reported with --debug every DrawStatsFrames frames:
+	struct DrawStats {
+		uint64_t material_binds = 0; //material descriptor set binds in the main pass
+		uint64_t draws = 0; //draw commands issued for instances (direct draws and indirect draw calls), all passes
+		uint64_t shadows_drawn = 0; //spot light atlas regions redrawn
+		uint64_t shadows_cached = 0; //spot light atlas regions kept from an earlier frame
+	};
+	static constexpr uint32_t DrawStatsFrames = 300;
+	DrawStats draw_stats; //summed since the last report
+	uint32_t draw_stats_frames = 0;
+
+	//--draw-mode indirect: render() turns the lists above into draw commands, streamed with the rest of the per-frame data:
+	struct IndirectBatch {
+		uint32_t material_index = 0; //material descriptor set bound for the whole batch (unused for shadows)
+		uint32_t first = 0; //first command in indirect_commands
+		uint32_t count = 0; //commands (with --culling gpu: room for commands; the GPU counts how many it wrote)
+		uint32_t slot = 0; //(--culling gpu) index of the batch in the culling pass's batch and count arrays
+	};
+	std::vector<VkDrawIndexedIndirectCommand> indirect_commands;
+	std::array<std::vector<IndirectBatch>, 4> indirect_batches; //one per material in view, same order as in_view_instances
+	std::vector<IndirectBatch> shadow_indirect_batches; //one per spot light frustum
+
+	//--culling gpu: update() leaves the lists above empty and fills the frustum planes; render() lays out the batches:
+	std::vector<glm::vec4> cull_frustum_planes; //six per frustum: view, then each spot light frustum
+	std::vector<CullPipeline::Instance> cull_instances; //same order as Transforms
+	std::vector<uint32_t> cull_batch_first; //first command of each batch, by slot
+	std::vector<uint32_t> cull_material_batch; //scratch: material index -> batch of the pipeline being laid out
+	std::array<std::vector<IndirectBatch>, 4> late_indirect_batches; //(--culling occlusion) late phase batches, same materials as indirect_batches
+	//(--culling occlusion) per instance, whether it passed the late phase last frame (read by the early phase); shared by all workspaces:
+	Helpers::AllocatedBuffer occlusion_visibility;
+
+	//update() collects the lists above on the thread pool: each chunk of hierarchy entries fills its own CollectChunk,
+	// then the chunks are concatenated in order (prefix sums of their counts give every chunk's offsets):
+	static constexpr uint32_t CollectChunkSize = 1024; //hierarchy entries per chunk
+	struct CollectChunk {
+		std::array<std::vector<ObjectInstance>, 4> instances; //same order as in_view_instances
+		std::vector<std::pair<uint32_t, uint32_t>> item_instances; //(pipeline index, index into instances[pipeline]) per culling item
+		std::vector<LambertianPipeline::SunLight> sun_lights;
+		std::vector<LambertianPipeline::SphereLight> sphere_lights;
+		std::vector<LambertianPipeline::SpotLight> spot_lights;
+		std::vector<LinesPipeline::Vertex> lines_vertices; //debug OBBs
+
+		//offsets of the lists above in the merged lists:
+		std::array<uint32_t, 4> instances_base{};
+		uint32_t item_instances_base = 0;
+		uint32_t sun_lights_base = 0, sphere_lights_base = 0, spot_lights_base = 0, lines_vertices_base = 0;
+
+		void clear(); //empty the lists (keeping their capacity)
+	};
+	std::vector<CollectChunk> collect_chunks; //kept between frames so the lists don't re-allocate
+
+	//culling works on "items", the hierarchy entries that have a mesh (in entry order). instance_bvh holds their
+	// world-space bounds; it is built once and then refit only for entries that update_hierarchy() recomputed:
+	BVH instance_bvh;
+	std::vector<int32_t> entry_item; //hierarchy entry -> item, -1 if the entry has no mesh
+	std::vector<OBB> item_obbs; //item -> world-space box
+	std::vector<std::pair<uint32_t, uint32_t>> item_instances; //item -> (pipeline index, index into that pipeline's instances), this frame
+	void update_instance_bvh();
+
+	//per-frustum culling scratch (0 is the view frustum, then one per spot light), kept between frames:
+	struct CullScratch {
+		std::vector<uint32_t> inside, intersecting; //items from instance_bvh.cull()
+		OBBBatch obbs; //boxes of 'intersecting', for the exact test
+		std::vector<uint64_t> visible;
+		std::vector<uint64_t> sort_keys, sort_keys_tmp; //(view only) draw_sort_key of each listed instance
+		std::vector<uint32_t> sort_values_tmp;
+	};
+	std::vector<CullScratch> cull_scratch;
+
 	struct ObjectLightInstance {
 		ObjectVertices vertices;
 		Transform transform;
@@ -408,8 +616,22 @@ struct RTGRenderer : RTG::Application {
 	std::vector<LambertianPipeline::SunLight> sun_lights;
 	std::vector<LambertianPipeline::SphereLight> sphere_lights;
 	std::vector<LambertianPipeline::SpotLight> spot_lights;
+	//(--light-binning cpu) the view's light cluster lists, binned on the worker threads in update and uploaded by render:
+	LightBinning light_binning{LightClusterPipeline::ClusterCountX, LightClusterPipeline::ClusterCountY, LightClusterPipeline::ClusterCountZ, LightClusterPipeline::ClusterStride};
 	std::vector<glm::mat4x4> spot_light_from_world;
-	uint64_t total_shadow_size = 0;
+
+	//cascaded shadow maps for the first --sun-shadows sun lights: each shadowed sun splits the view's depth range into
+	// --cascades slices, and each slice gets a square orthographic shadow map in the atlas. A cascade bounds its slice
+	// with a sphere (so its size doesn't change as the view turns) and its center snaps to whole texels (so its
+	// texels don't crawl as the view moves); its depth range reaches back to the scene bounds for casters behind it:
+	static constexpr uint32_t MaxCascades = 4; //(LambertianPipeline::SunLight::ATLAS_COORD_FROM_WORLD)
+	struct Cascade {
+		uint32_t sun_light; //in sun_lights
+		uint32_t index; //within the sun's cascades
+		uint32_t resolution; //texels on a side of its atlas region (see ShadowAtlas::fit_cascades)
+		glm::mat4x4 light_from_world; //orthographic, drawn into shadow_atlas.cascade_regions[cascade]
+	};
+	std::vector<Cascade> cascades; //shadow views after the spot lights (in_spot_light_instances, shadow_indirect_batches)
 	
 	Helpers::AllocatedImage shadow_atlas_image;
 
@@ -419,16 +641,72 @@ struct RTGRenderer : RTG::Application {
 			uint32_t x;
 			uint32_t y;
 			uint32_t size;
+			uint32_t serial = 0; //the quadtree allocation that produced it: changes whenever the square is (re)assigned
 		} ;
-		std::vector<Region> regions;
-
-		//spot lights must be sorted
-		void update_regions(std::vector<RTGRenderer::LambertianPipeline::SpotLight> &, std::vector<Scene::LightInstance> &, uint8_t reduction);
-		void debug();
+		std::vector<Region> regions; //per spot light, in spot_lights order (size 0: no shadow this frame)
+
+		static constexpr uint32_t MinRegionSize = 32; //smallest region handed out (texels on a side)
+		static constexpr uint32_t CascadeOwner = 0x80000000; //quadtree owners from here up are sun cascades
+		static constexpr uint32_t CascadeShare = 4; //all sun cascades together get at most 1/CascadeShare of texel_budget
+		uint64_t texel_budget; //total region area the lights may use (defaults to the whole atlas)
+		uint32_t dropped = 0; //shadowed spot lights the last update_regions left without a region
+
+		//Regions come from a persistent quadtree: each node is a square that is free, holds one light's region, or is
+		// split into four quarter-size children. A light keeps its node for as long as its resolution doesn't change,
+		// so its region (and its cached shadow) stays put between frames.
+		struct Quadtree {
+			struct Node {
+				uint32_t x = 0, y = 0, size = 0;
+				uint32_t parent = -1U;
+				uint32_t first_child = -1U; //children are four consecutive nodes; -1U for a leaf
+				uint32_t owner = -1U; //light (or CascadeOwner + cascade) using this leaf, -1U if free
+				uint32_t largest_free = 0; //side of the largest free square in the subtree
+				uint32_t serial = 0; //value of 'allocations' when this leaf was last handed out
+			};
+			std::vector<Node> nodes; //nodes[0] is the whole atlas
+			std::vector<uint32_t> free_blocks; //first nodes of released groups of four children, for reuse
+			uint32_t allocations = 0; //squares handed out so far (never reset, so serials stay unique across repacks)
+
+			void reset(uint32_t size);
+			//a free square of side 'size' (a power of two) for 'owner', taken from the tightest subtree it fits in;
+			// returns its node, or -1U if no free square is big enough:
+			uint32_t allocate(uint32_t size, uint32_t owner);
+			//free 'node' again, merging any four children that are all free:
+			void release(uint32_t node);
+		} quadtree;
+		std::vector<uint32_t> light_nodes; //per spot light, its quadtree node (-1U if none)
+		std::vector<Region> cascade_regions; //per sun cascade (size 0: didn't fit)
+		std::vector<uint32_t> cascade_nodes; //per sun cascade, its quadtree node (-1U if none)
+
+		//pick each shadowed spot light's resolution and place it. Resolution follows screen-space importance: the size
+		// on screen of the light's reach seen from 'eye' (at 'pixels_per_unit' pixels per world unit at unit distance),
+		// capped at the light's requested shadow size; when the total exceeds texel_budget, the lights with the most
+		// texels for their importance are halved first. Lights whose resolution didn't change keep their regions.
+		// Sun cascades ('cascade_sizes', one per cascade, from fit_cascades) are placed first at their full size, and
+		// their area comes out of the budget before the spot lights':
+		void update_regions(std::vector<RTGRenderer::LambertianPipeline::SpotLight> const &, std::vector<Scene::LightInstance> const &, std::vector<uint32_t> const &cascade_sizes, glm::vec3 eye, float pixels_per_unit);
+		//resolutions of one sun's 'count' cascades, nearest first: 'requested' halved for each farther cascade (they are
+		// smaller on screen), and the whole set halved again until it fits in 'texels', which it is then taken out of.
+		// Empty if even the smallest set doesn't fit. Start 'texels' at texel_budget / CascadeShare, so that however many
+		// suns are shadowed, the spot lights keep most of the atlas:
+		std::vector<uint32_t> fit_cascades(uint32_t requested, uint32_t count, uint64_t &texels) const;
+		//area used by regions over atlas area:
+		float utilisation() const;
+		//print the utilisation, the quadtree's free space, and every region:
+		void debug() const;
 		static glm::mat4 calculate_shadow_atlas_matrix(const glm::mat4& light_from_world, const Region& region, const int atlas_size);
 
-		ShadowAtlas(uint32_t size_) : size(size_) {};
+		ShadowAtlas(uint32_t size_) : size(size_), texel_budget(uint64_t(size_) * size_) {};
 	} shadow_atlas;
+	//shadow caching: the atlas keeps its depth between frames, and a spot light's region is only cleared and redrawn when
+	// the hash of its inputs (light transform, region, and the meshes and world transforms of the instances in its
+	// frustum) differs from the one it was last drawn with. The region includes its quadtree serial, so a square that
+	// another light used in between is always redrawn, even if it comes back to the same place:
+	std::vector<uint64_t> shadow_hashes; //per spot light, in spot_lights order, then per sun cascade (0: not drawn yet)
+	//(--culling gpu) per shadow view, the hash of the instances whose bounds reach its frustum: only the GPU knows
+	// exactly what each light sees, so update() hashes a conservative set from instance_bvh:
+	std::vector<uint64_t> shadow_view_instance_hashes;
+	bool shadow_atlas_initialized = false; //the atlas has been moved out of VK_IMAGE_LAYOUT_UNDEFINED (so its contents can be kept)
 	
 	enum InSceneCamera{
 		SceneCamera = 0,
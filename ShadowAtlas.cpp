@@ -1,51 +1,312 @@
 #include "RTGRenderer.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
 #include <iostream>
+#include <limits>
+#include <queue>
 #include <utility>
 
-//referenced https://lisyarus.github.io/blog/posts/texture-packing.html
-void RTGRenderer::ShadowAtlas::update_regions(std::vector<RTGRenderer::LambertianPipeline::SpotLight> & spot_lights, std::vector<Scene::LightInstance> &sorted_indices, uint8_t reduction)
+void RTGRenderer::ShadowAtlas::Quadtree::reset(uint32_t size)
 {
-    regions.clear();
-    regions.resize(spot_lights.size());
-    struct point { uint32_t x, y; } pen = {0,0};
-    std::vector<point> ladder;
-    for (Scene::LightInstance pair : sorted_indices) {
-        uint32_t i = pair.spot_lights_index;
-        const uint32_t texture_size = spot_lights[i].shadow_size >> reduction;
-
-        // allocate a texture region
-        regions[i] = {pen.x, pen.y, texture_size};
-        // shift the pen to the right
-        pen.x += texture_size;
-
-        // update the ladder
-        if (!ladder.empty() && ladder.back().y == pen.y + texture_size)
-            ladder.back().x = pen.x;
-        else
-            ladder.push_back({pen.x, pen.y + texture_size});
-
-        if (pen.x == size)
-        {
-            // the pen hit the right edge of the atlas
-            ladder.pop_back();
-            pen.y += texture_size;
-            if (!ladder.empty())
-                pen.x = ladder.back().x;
-            else
-                pen.x = 0;
+    nodes.assign(1, Node{ .x = 0, .y = 0, .size = size, .largest_free = size });
+    free_blocks.clear();
+}
+
+uint32_t RTGRenderer::ShadowAtlas::Quadtree::allocate(uint32_t size, uint32_t owner)
+{
+    if (nodes.empty() || nodes[0].largest_free < size) return -1U;
+
+    uint32_t n = 0;
+    while (nodes[n].size > size) {
+        if (nodes[n].first_child == -1U) {
+            // split the free square into four
+            uint32_t first;
+            if (!free_blocks.empty()) {
+                first = free_blocks.back();
+                free_blocks.pop_back();
+            } else {
+                first = uint32_t(nodes.size());
+                nodes.resize(nodes.size() + 4);
+            }
+            uint32_t half = nodes[n].size / 2;
+            for (uint32_t c = 0; c < 4; ++c) {
+                nodes[first + c] = Node{
+                    .x = nodes[n].x + (c & 1) * half,
+                    .y = nodes[n].y + (c >> 1) * half,
+                    .size = half,
+                    .parent = n,
+                    .largest_free = half,
+                };
+            }
+            nodes[n].first_child = first;
+        }
+        // best fit: the child with the smallest free square that is still big enough
+        uint32_t best = -1U;
+        for (uint32_t c = nodes[n].first_child; c < nodes[n].first_child + 4; ++c) {
+            if (nodes[c].largest_free < size) continue;
+            if (best == -1U || nodes[c].largest_free < nodes[best].largest_free) best = c;
         }
+        n = best;
     }
+
+    nodes[n].owner = owner;
+    nodes[n].largest_free = 0;
+    nodes[n].serial = ++allocations;
+    for (uint32_t p = nodes[n].parent; p != -1U; p = nodes[p].parent) {
+        uint32_t first = nodes[p].first_child;
+        nodes[p].largest_free = std::max(std::max(nodes[first].largest_free, nodes[first + 1].largest_free),
+                                         std::max(nodes[first + 2].largest_free, nodes[first + 3].largest_free));
+    }
+    return n;
 }
 
-void RTGRenderer::ShadowAtlas::debug()
+void RTGRenderer::ShadowAtlas::Quadtree::release(uint32_t node)
 {
-    std::cout<<"\nShadow Atlas, Size: " <<size<<std::endl;
+    nodes[node].owner = -1U;
+    nodes[node].largest_free = nodes[node].size;
+    for (uint32_t p = nodes[node].parent; p != -1U; p = nodes[p].parent) {
+        uint32_t first = nodes[p].first_child;
+        bool all_free = true;
+        for (uint32_t c = first; c < first + 4; ++c) {
+            if (nodes[c].first_child != -1U || nodes[c].owner != -1U) all_free = false;
+        }
+        if (all_free) {
+            // merge the four back into one free square
+            free_blocks.push_back(first);
+            nodes[p].first_child = -1U;
+            nodes[p].largest_free = nodes[p].size;
+        } else {
+            nodes[p].largest_free = std::max(std::max(nodes[first].largest_free, nodes[first + 1].largest_free),
+                                             std::max(nodes[first + 2].largest_free, nodes[first + 3].largest_free));
+        }
+    }
+}
+
+void RTGRenderer::ShadowAtlas::update_regions(std::vector<RTGRenderer::LambertianPipeline::SpotLight> const &spot_lights, std::vector<Scene::LightInstance> const &sorted_indices, std::vector<uint32_t> const &cascade_sizes, glm::vec3 eye, float pixels_per_unit)
+{
+    if (quadtree.nodes.empty()) quadtree.reset(size);
+
+    // lights and cascades that no longer exist (or cascades that change resolution) give their squares back
+    for (uint32_t i = uint32_t(spot_lights.size()); i < light_nodes.size(); ++i) {
+        if (light_nodes[i] != -1U) quadtree.release(light_nodes[i]);
+    }
+    light_nodes.resize(spot_lights.size(), -1U);
+    std::vector<uint32_t> cascade_target(cascade_sizes.size());
+    uint64_t cascade_texels = 0;
+    for (uint32_t c = 0; c < cascade_sizes.size(); ++c) {
+        cascade_target[c] = std::clamp(std::bit_floor(cascade_sizes[c]), MinRegionSize, size);
+        cascade_texels += uint64_t(cascade_target[c]) * cascade_target[c];
+    }
+    for (uint32_t c = 0; c < cascade_nodes.size(); ++c) {
+        if (cascade_nodes[c] == -1U) continue;
+        if (c >= cascade_sizes.size() || quadtree.nodes[cascade_nodes[c]].size != cascade_target[c]) {
+            quadtree.release(cascade_nodes[c]);
+            cascade_nodes[c] = -1U;
+        }
+    }
+    cascade_nodes.resize(cascade_sizes.size(), -1U);
+    uint64_t budget = (texel_budget > cascade_texels ? texel_budget - cascade_texels : 0);
+
+    // the resolution each shadowed light would like
+    struct Want {
+        uint32_t light;
+        float importance; // screen-space diameter of the light's reach, in pixels (infinite when the camera is inside it)
+        uint32_t size;
+    };
+    std::vector<Want> wants;
+    wants.reserve(sorted_indices.size());
+    uint64_t total = 0;
+    for (Scene::LightInstance const &instance : sorted_indices) {
+        uint32_t i = instance.spot_lights_index;
+        RTGRenderer::LambertianPipeline::SpotLight const &light = spot_lights[i];
+        if (light.shadow_size == 0) continue;
+        uint32_t requested = std::clamp(std::bit_floor(light.shadow_size), MinRegionSize, size);
+
+        float importance = std::numeric_limits<float>::infinity();
+        float distance = glm::length(light.POSITION - eye);
+        if (light.LIMIT != 0.0f && distance > light.LIMIT) {
+            importance = 2.0f * light.LIMIT / std::sqrt(distance * distance - light.LIMIT * light.LIMIT) * pixels_per_unit;
+        }
+        float ideal = std::min(importance, float(requested));
+
+        // nearest power of two; a light only changes resolution once well past the halfway point between sizes,
+        // so importance hovering around a boundary doesn't move its region back and forth
+        uint32_t current = (light_nodes[i] != -1U ? quadtree.nodes[light_nodes[i]].size : 0);
+        uint32_t want;
+        if (current != 0 && std::abs(std::log2(ideal / float(current))) < 0.75f) {
+            want = current;
+        } else {
+            want = std::bit_floor(uint32_t(ideal * 1.41421356f));
+        }
+        want = std::clamp(want, MinRegionSize, requested);
+
+        wants.push_back(Want{ .light = i, .importance = importance, .size = want });
+        total += uint64_t(want) * want;
+    }
+
+    // over budget: halve the light with the most texels for its importance until everything fits
+    if (total > budget) {
+        auto cost = [&](uint32_t w) {
+            return double(wants[w].size) * wants[w].size / double(wants[w].importance);
+        };
+        std::priority_queue<std::pair<double, uint32_t>> most_costly;
+        for (uint32_t w = 0; w < wants.size(); ++w) {
+            most_costly.emplace(cost(w), w);
+        }
+        while (total > budget && !most_costly.empty()) {
+            uint32_t w = most_costly.top().second;
+            most_costly.pop();
+            if (wants[w].size <= MinRegionSize) continue;
+            total -= uint64_t(wants[w].size) * wants[w].size * 3 / 4;
+            wants[w].size /= 2;
+            most_costly.emplace(cost(w), w);
+        }
+        // even the smallest regions don't fit: the least important lights go without
+        if (total > budget) {
+            std::vector<uint32_t> by_importance(wants.size());
+            for (uint32_t w = 0; w < wants.size(); ++w) by_importance[w] = w;
+            std::stable_sort(by_importance.begin(), by_importance.end(), [&](uint32_t a, uint32_t b) {
+                return wants[a].importance < wants[b].importance;
+            });
+            for (uint32_t w : by_importance) {
+                if (total <= budget) break;
+                total -= uint64_t(wants[w].size) * wants[w].size;
+                wants[w].size = 0;
+            }
+        }
+    }
+
+    std::vector<uint32_t> target(spot_lights.size(), 0);
+    for (Want const &want : wants) {
+        target[want.light] = want.size;
+    }
+
+    // lights that go without, or shrink, give their squares back
+    for (uint32_t i = 0; i < spot_lights.size(); ++i) {
+        if (light_nodes[i] != -1U && quadtree.nodes[light_nodes[i]].size > target[i]) {
+            quadtree.release(light_nodes[i]);
+            light_nodes[i] = -1U;
+        }
+    }
+
+    // place the rest, largest first. A light that doesn't fit takes the largest smaller square that does
+    // (a growing light keeps its old square unless it finds a bigger one), so fragmentation costs resolution
+    // before it costs a repack:
+    auto place = [&]() {
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < spot_lights.size(); ++i) {
+            if (target[i] == 0) continue;
+            if (light_nodes[i] == -1U || quadtree.nodes[light_nodes[i]].size != target[i]) order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return target[a] > target[b]; });
+        for (uint32_t i : order) {
+            uint32_t old = light_nodes[i];
+            uint32_t smallest = (old == -1U ? MinRegionSize : 2 * quadtree.nodes[old].size);
+            uint32_t node = -1U;
+            for (uint32_t want = target[i]; node == -1U && want >= smallest; want /= 2) {
+                node = quadtree.allocate(want, i);
+            }
+            if (node != -1U) {
+                if (old != -1U) quadtree.release(old);
+                light_nodes[i] = node;
+            } else if (old == -1U) {
+                return false;
+            }
+        }
+        return true;
+    };
+    // the cascades go first (they never change size, so they only move on a repack):
+    auto place_cascades = [&]() {
+        for (uint32_t c = 0; c < cascade_nodes.size(); ++c) {
+            if (cascade_nodes[c] != -1U) continue;
+            cascade_nodes[c] = quadtree.allocate(cascade_target[c], CascadeOwner + c);
+            if (cascade_nodes[c] == -1U) return false;
+        }
+        return true;
+    };
+    if (!place_cascades() || !place()) {
+        // not even the smallest square is free: repack everything (power-of-two squares within the atlas's
+        // area always fit when placed largest first, so only a budget bigger than the atlas leaves lights out)
+        quadtree.reset(size);
+        light_nodes.assign(spot_lights.size(), -1U);
+        cascade_nodes.assign(cascade_sizes.size(), -1U);
+        place_cascades();
+        place();
+    }
+
+    // (lights the budget or the repack left out)
+    dropped = 0;
+    for (Want const &want : wants) {
+        if (light_nodes[want.light] == -1U) dropped += 1;
+    }
+
+    regions.assign(spot_lights.size(), Region{ 0, 0, 0 });
+    for (uint32_t i = 0; i < spot_lights.size(); ++i) {
+        if (light_nodes[i] == -1U) continue;
+        Quadtree::Node const &node = quadtree.nodes[light_nodes[i]];
+        regions[i] = Region{ node.x, node.y, node.size, node.serial };
+    }
+    cascade_regions.assign(cascade_sizes.size(), Region{ 0, 0, 0 });
+    for (uint32_t c = 0; c < cascade_sizes.size(); ++c) {
+        if (cascade_nodes[c] == -1U) continue;
+        Quadtree::Node const &node = quadtree.nodes[cascade_nodes[c]];
+        cascade_regions[c] = Region{ node.x, node.y, node.size, node.serial };
+    }
+}
+
+std::vector<uint32_t> RTGRenderer::ShadowAtlas::fit_cascades(uint32_t requested, uint32_t count, uint64_t &texels) const
+{
+    uint32_t nearest = std::clamp(std::bit_floor(requested), MinRegionSize, size);
+    std::vector<uint32_t> sizes(count);
+    while (true) {
+        uint64_t total = 0;
+        for (uint32_t c = 0; c < count; ++c) {
+            sizes[c] = std::max(nearest >> c, MinRegionSize);
+            total += uint64_t(sizes[c]) * sizes[c];
+        }
+        if (total <= texels) {
+            texels -= total;
+            return sizes;
+        }
+        if (nearest == MinRegionSize) return {};
+        nearest /= 2;
+    }
+}
+
+float RTGRenderer::ShadowAtlas::utilisation() const
+{
+    uint64_t used = 0;
+    for (const auto& region : regions) {
+        used += uint64_t(region.size) * region.size;
+    }
+    for (const auto& region : cascade_regions) {
+        used += uint64_t(region.size) * region.size;
+    }
+    return float(double(used) / (double(size) * size));
+}
+
+void RTGRenderer::ShadowAtlas::debug() const
+{
+    uint32_t region_count = 0;
+    for (const auto& region : regions) {
+        if (region.size != 0) ++region_count;
+    }
+    std::cout << "\nShadow Atlas, Size: " << size << ", " << region_count << " regions, " << cascade_regions.size() << " cascades, "
+              << 100.0f * utilisation() << "% used (budget " << 100.0 * double(texel_budget) / (double(size) * size) << "%), "
+              << "largest free square " << (quadtree.nodes.empty() ? size : quadtree.nodes[0].largest_free) << ", "
+              << quadtree.nodes.size() - 4 * quadtree.free_blocks.size() << " quadtree nodes" << std::endl;
     for (const auto& region : regions) {
         std::cout << "Region(x: " << region.x 
                   << ", y: " << region.y 
                   << ", size: " << region.size << ")\n";
     
     }
+    for (const auto& region : cascade_regions) {
+        std::cout << "Cascade(x: " << region.x 
+                  << ", y: " << region.y 
+                  << ", size: " << region.size << ")\n";
+    }
 }
 
 glm::mat4 RTGRenderer::ShadowAtlas::calculate_shadow_atlas_matrix(const glm::mat4& light_from_world, const Region& region, const int atlas_size) {
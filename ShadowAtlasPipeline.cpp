@@ -8,12 +8,17 @@ static uint32_t vert_code[] =
 #include "spv/shadow.vert.inl"
 ;
 
+static uint32_t vert_packed_code[] = 
+#include "spv/shadow.packed.vert.inl"
+;
+
 static uint32_t frag_code[] = 
 #include "spv/shadow.frag.inl"
 ;
 
 void RTGRenderer::ShadowAtlasPipeline::create(RTG &rtg, VkRenderPass render_pass, uint32_t subpass) {
-    VkShaderModule vert_module = rtg.helpers.create_shader_module(vert_code);
+    bool packed = (rtg.configuration.vertex_format == 1); //(PosNorTanTexPackedVertex inputs)
+    VkShaderModule vert_module = (packed ? rtg.helpers.create_shader_module(vert_packed_code) : rtg.helpers.create_shader_module(vert_code));
     VkShaderModule frag_module = rtg.helpers.create_shader_module(frag_code);
 
 
@@ -21,7 +26,7 @@ void RTGRenderer::ShadowAtlasPipeline::create(RTG &rtg, VkRenderPass render_pass
 		std::array<VkDescriptorSetLayoutBinding, 1> bindings{
 			VkDescriptorSetLayoutBinding{
 				.binding = 0,
-				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT
 			},
@@ -135,7 +140,7 @@ void RTGRenderer::ShadowAtlasPipeline::create(RTG &rtg, VkRenderPass render_pass
             .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
             .stageCount = uint32_t(stages.size()),
             .pStages = stages.data(),
-            .pVertexInputState = &Vertex::array_input_state,
+            .pVertexInputState = (packed ? &PackedVertex::array_input_state : &Vertex::array_input_state),
             .pInputAssemblyState = &input_assembly_state,
             .pViewportState = &viewport_state,
             .pRasterizationState = &rasterization_state,
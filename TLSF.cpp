@@ -0,0 +1,191 @@
+#include "TLSF.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+//size -> (first level, second level) size class:
+// sizes below SLCount get one class each; above that, fl is the power of two and sl the next SLBits bits
+static void mapping(uint64_t size, uint32_t SLBits, uint32_t &fl, uint32_t &sl) {
+	uint32_t SLCount = 1u << SLBits;
+	if (size < SLCount) {
+		fl = 0;
+		sl = uint32_t(size);
+	} else {
+		uint32_t msb = uint32_t(std::bit_width(size)) - 1;
+		fl = msb - SLBits + 1;
+		sl = uint32_t(size >> (msb - SLBits)) - SLCount;
+	}
+}
+
+TLSF::TLSF(uint64_t size) : total_size(size) {
+	for (uint32_t fl = 0; fl < FLCount; ++fl) {
+		for (uint32_t sl = 0; sl < SLCount; ++sl) {
+			heads[fl][sl] = Null;
+		}
+	}
+	if (size > 0) {
+		insert_free(new_range(0, size));
+	}
+}
+
+std::optional< uint64_t > TLSF::allocate(uint64_t size, uint64_t alignment) {
+	size = std::max< uint64_t >(size, 1);
+	alignment = std::max< uint64_t >(alignment, 1);
+
+	//any free range at least this big can hold an aligned block of 'size' bytes:
+	uint64_t needed = size + alignment - 1;
+	if (needed > total_size - used_size) return std::nullopt;
+
+	//round up to the next size class so that every range in the class found below is big enough:
+	uint64_t rounded = needed;
+	if (rounded >= SLCount) rounded += (uint64_t(1) << (std::bit_width(rounded) - 1 - SLBits)) - 1;
+
+	uint32_t fl, sl;
+	mapping(rounded, SLBits, fl, sl);
+	uint32_t index = Null;
+	if (fl < FLCount) {
+		uint32_t sl_map = sl_bitmap[fl] & (~0u << sl);
+		if (sl_map == 0) {
+			uint64_t fl_map = (fl + 1 < 64 ? fl_bitmap & (~uint64_t(0) << (fl + 1)) : 0);
+			if (fl_map != 0) {
+				fl = uint32_t(std::countr_zero(fl_map));
+				sl_map = sl_bitmap[fl];
+			}
+		}
+		if (sl_map != 0) {
+			sl = uint32_t(std::countr_zero(sl_map));
+			index = heads[fl][sl];
+		}
+	}
+	if (index == Null) {
+		//rounding up skips the class 'needed' itself, which may still hold a range that fits:
+		mapping(needed, SLBits, fl, sl);
+		for (uint32_t i = heads[fl][sl]; i != Null; i = ranges[i].next_free) {
+			if (ranges[i].size >= needed) {
+				index = i;
+				break;
+			}
+		}
+		if (index == Null) return std::nullopt;
+	}
+
+	remove_free(index);
+
+	//give any padding in front of the aligned offset back as its own free range:
+	uint64_t offset = ranges[index].offset;
+	uint64_t aligned = (offset + alignment - 1) / alignment * alignment;
+	if (aligned != offset) {
+		uint32_t back = split(index, aligned - offset);
+		insert_free(index);
+		index = back;
+	}
+	//...and likewise anything past the end:
+	if (ranges[index].size > size) {
+		insert_free(split(index, size));
+	}
+
+	allocated.emplace(aligned, index);
+	used_size += size;
+	return aligned;
+}
+
+void TLSF::free(uint64_t offset) {
+	auto f = allocated.find(offset);
+	if (f == allocated.end()) {
+		throw std::runtime_error("TLSF::free of offset " + std::to_string(offset) + ", which isn't allocated.");
+	}
+	uint32_t index = f->second;
+	allocated.erase(f);
+	used_size -= ranges[index].size;
+
+	//coalesce with free neighbours:
+	uint32_t prev = ranges[index].prev_phys;
+	if (prev != Null && ranges[prev].free) {
+		remove_free(prev);
+		merge(prev, index);
+		index = prev;
+	}
+	uint32_t next = ranges[index].next_phys;
+	if (next != Null && ranges[next].free) {
+		remove_free(next);
+		merge(index, next);
+	}
+	insert_free(index);
+}
+
+uint64_t TLSF::largest_free() const {
+	uint64_t largest = 0;
+	for (Range const &range : ranges) {
+		if (range.free) largest = std::max(largest, range.size);
+	}
+	return largest;
+}
+
+uint32_t TLSF::free_range_count() const {
+	uint32_t count = 0;
+	for (Range const &range : ranges) {
+		if (range.free) count += 1;
+	}
+	return count;
+}
+
+uint32_t TLSF::new_range(uint64_t offset, uint64_t size) {
+	uint32_t index;
+	if (!unused_ranges.empty()) {
+		index = unused_ranges.back();
+		unused_ranges.pop_back();
+	} else {
+		index = uint32_t(ranges.size());
+		ranges.emplace_back();
+	}
+	ranges[index] = Range{ .offset = offset, .size = size };
+	return index;
+}
+
+void TLSF::insert_free(uint32_t index) {
+	uint32_t fl, sl;
+	mapping(ranges[index].size, SLBits, fl, sl);
+	ranges[index].free = true;
+	ranges[index].prev_free = Null;
+	ranges[index].next_free = heads[fl][sl];
+	if (heads[fl][sl] != Null) ranges[heads[fl][sl]].prev_free = index;
+	heads[fl][sl] = index;
+	fl_bitmap |= uint64_t(1) << fl;
+	sl_bitmap[fl] |= 1u << sl;
+}
+
+void TLSF::remove_free(uint32_t index) {
+	uint32_t fl, sl;
+	mapping(ranges[index].size, SLBits, fl, sl);
+	Range &range = ranges[index];
+	if (range.prev_free != Null) ranges[range.prev_free].next_free = range.next_free;
+	else heads[fl][sl] = range.next_free;
+	if (range.next_free != Null) ranges[range.next_free].prev_free = range.prev_free;
+	range.prev_free = range.next_free = Null;
+	range.free = false;
+	if (heads[fl][sl] == Null) {
+		sl_bitmap[fl] &= ~(1u << sl);
+		if (sl_bitmap[fl] == 0) fl_bitmap &= ~(uint64_t(1) << fl);
+	}
+}
+
+uint32_t TLSF::split(uint32_t index, uint64_t size) {
+	uint32_t back = new_range(ranges[index].offset + size, ranges[index].size - size); //(may reallocate 'ranges')
+	Range &front = ranges[index];
+	ranges[back].prev_phys = index;
+	ranges[back].next_phys = front.next_phys;
+	if (front.next_phys != Null) ranges[front.next_phys].prev_phys = back;
+	front.next_phys = back;
+	front.size = size;
+	return back;
+}
+
+void TLSF::merge(uint32_t a, uint32_t b) {
+	ranges[a].size += ranges[b].size;
+	ranges[a].next_phys = ranges[b].next_phys;
+	if (ranges[b].next_phys != Null) ranges[ranges[b].next_phys].prev_phys = a;
+	ranges[b] = Range();
+	unused_ranges.emplace_back(b);
+}
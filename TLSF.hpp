@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ *  Two-level segregated fit (TLSF) placement over an abstract range [0, size).
+ *
+ *  Only offsets are managed (nothing is read or written at them), so this can place sub-allocations
+ *  inside device memory that the CPU can't touch. Free ranges are kept in size-class lists indexed by
+ *  (log2(size), next 4 bits of size); allocate and free are O(1) apart from the offset -> range lookup.
+ *  Neighbouring free ranges are merged on free.
+ */
+
+struct TLSF {
+	explicit TLSF(uint64_t size = 0);
+
+	//returns the offset of a range of 'size' bytes aligned to a multiple of 'alignment', or nullopt if it doesn't fit:
+	std::optional< uint64_t > allocate(uint64_t size, uint64_t alignment = 1);
+	//release the range that allocate() returned at 'offset':
+	void free(uint64_t offset);
+
+	uint64_t size() const { return total_size; }
+	uint64_t used() const { return used_size; }
+	uint32_t allocation_count() const { return uint32_t(allocated.size()); }
+	bool empty() const { return allocated.empty(); }
+
+	//fragmentation helpers (walk all ranges; meant for stats, not hot paths):
+	uint64_t largest_free() const;
+	uint32_t free_range_count() const;
+
+private:
+	static constexpr uint32_t SLBits = 4;
+	static constexpr uint32_t SLCount = 1u << SLBits;
+	static constexpr uint32_t FLCount = 64 - SLBits + 1;
+	static constexpr uint32_t Null = ~0u;
+
+	struct Range {
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		uint32_t prev_phys = Null, next_phys = Null; //address-order neighbours
+		uint32_t prev_free = Null, next_free = Null; //size-class list links (free ranges only)
+		bool free = false;
+	};
+	std::vector< Range > ranges;
+	std::vector< uint32_t > unused_ranges; //recycled slots in 'ranges'
+	std::unordered_map< uint64_t, uint32_t > allocated; //offset -> range
+
+	uint64_t fl_bitmap = 0;
+	uint32_t sl_bitmap[FLCount] = {};
+	uint32_t heads[FLCount][SLCount];
+
+	uint64_t total_size = 0;
+	uint64_t used_size = 0;
+
+	uint32_t new_range(uint64_t offset, uint64_t size);
+	void insert_free(uint32_t index);
+	void remove_free(uint32_t index);
+	//splits 'size' bytes off the front of range 'index' (which must be larger); returns the new back range:
+	uint32_t split(uint32_t index, uint64_t size);
+	//absorbs range 'b' (which must follow 'a' and be out of the free lists) into 'a':
+	void merge(uint32_t a, uint32_t b);
+};
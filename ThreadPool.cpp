@@ -0,0 +1,96 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+ThreadPool::ThreadPool(uint32_t threads) {
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		threads = std::max(1u, threads);
+	}
+	workers.reserve(threads);
+	for (uint32_t i = 0; i < threads; ++i) {
+		workers.emplace_back(&ThreadPool::worker_main, this, i);
+	}
+}
+
+static thread_local uint32_t current_thread_index = 0;
+
+uint32_t ThreadPool::thread_index() {
+	return current_thread_index;
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock< std::mutex > lock(jobs_mutex);
+		quit = true;
+	}
+	jobs_cv.notify_all();
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+}
+
+std::future< void > ThreadPool::submit(std::function< void() > job) {
+	auto task = std::make_shared< std::packaged_task< void() > >(std::move(job));
+	std::future< void > ret = task->get_future();
+	{
+		std::unique_lock< std::mutex > lock(jobs_mutex);
+		jobs.emplace_back([task](){ (*task)(); });
+	}
+	jobs_cv.notify_one();
+	return ret;
+}
+
+void ThreadPool::parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn, uint32_t grain) {
+	if (count == 0) return;
+	grain = std::max(1u, grain);
+	uint32_t chunks = (count + grain - 1) / grain;
+
+	//every participant (workers + caller) pulls chunks from a shared counter until they run out:
+	std::atomic< uint32_t > next_chunk(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto run_chunks = [&]() {
+		for (uint32_t chunk = next_chunk++; chunk < chunks; chunk = next_chunk++) {
+			try {
+				uint32_t end = std::min(count, (chunk + 1) * grain);
+				for (uint32_t i = chunk * grain; i < end; ++i) {
+					fn(i);
+				}
+			} catch (...) {
+				std::unique_lock< std::mutex > lock(error_mutex);
+				if (!error) error = std::current_exception();
+			}
+		}
+	};
+
+	uint32_t helpers = std::min(size(), chunks - 1);
+	std::vector< std::future< void > > pending;
+	pending.reserve(helpers);
+	for (uint32_t i = 0; i < helpers; ++i) {
+		pending.emplace_back(submit(run_chunks));
+	}
+	run_chunks();
+	for (std::future< void > &done : pending) {
+		done.wait();
+	}
+
+	if (error) std::rethrow_exception(error);
+}
+
+void ThreadPool::worker_main(uint32_t index) {
+	current_thread_index = 1 + index;
+	for (;;) {
+		std::function< void() > job;
+		{
+			std::unique_lock< std::mutex > lock(jobs_mutex);
+			jobs_cv.wait(lock, [this](){ return quit || !jobs.empty(); });
+			if (quit && jobs.empty()) return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
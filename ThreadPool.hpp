@@ -0,0 +1,48 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ *  Fixed-size pool of worker threads used for loading and per-frame CPU work.
+ *
+ *  submit() queues a single job; parallel_for() splits an index range across the workers
+ *  (the calling thread helps too) and blocks until every index has run, rethrowing the
+ *  first exception thrown by a job.
+ *  NOTE: don't call parallel_for from inside a pool job; the waiting worker could starve its own helpers.
+ */
+
+struct ThreadPool {
+	//threads == 0 picks hardware_concurrency() - 1 (at least one worker):
+	explicit ThreadPool(uint32_t threads = 0);
+	ThreadPool(ThreadPool const &) = delete;
+	ThreadPool &operator=(ThreadPool const &) = delete;
+	~ThreadPool();
+
+	//number of worker threads (not counting the caller of parallel_for):
+	uint32_t size() const { return uint32_t(workers.size()); }
+
+	//index of the calling thread: 1 + i on worker i, 0 on any thread outside the pool (so in [0, size()]);
+	// lets jobs pick per-thread resources, e.g. command pools:
+	static uint32_t thread_index();
+
+	std::future< void > submit(std::function< void() > job);
+
+	//calls fn(i) for every i in [0, count), 'grain' consecutive indices per job:
+	void parallel_for(uint32_t count, std::function< void(uint32_t) > const &fn, uint32_t grain = 1);
+
+private:
+	std::vector< std::thread > workers;
+	std::deque< std::function< void() > > jobs;
+	std::mutex jobs_mutex;
+	std::condition_variable jobs_cv;
+	bool quit = false;
+
+	void worker_main(uint32_t index);
+};
@@ -0,0 +1,155 @@
+//Times CPU light binning (LightBinning::bin) on random sphere and spot lights scattered in front of the camera,
+// for 1k to 64k lights, on the thread pool and on one thread. The smallest case is checked against a brute force binning.
+//  usage: bin/light_binning_bench [repeats, default 10] [count_x count_y count_z, default 16 9 24]
+
+#include "../light_binning.hpp"
+#include "../mat4.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+
+//the fields of RTGRenderer::LambertianPipeline::SphereLight and SpotLight that binning reads:
+struct SphereLight {
+	glm::vec3 POSITION;
+	float LIMIT;
+};
+struct SpotLight {
+	glm::vec3 POSITION;
+	glm::vec3 DIRECTION; //(points back from the light)
+	float LIMIT;
+	glm::vec4 CONE_ANGLES;
+};
+
+//lights in a 200 x 200 x 40 box in front of a camera at the origin looking along +y; every 32nd is unlimited:
+static void make_lights(uint32_t count, std::vector< SphereLight > &spheres, std::vector< SpotLight > &spots) {
+	std::mt19937 mt(0x1234);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+	spheres.clear();
+	spots.clear();
+	for (uint32_t i = 0; i < count; ++i) {
+		glm::vec3 position(unit(mt) * 200.0f - 100.0f, unit(mt) * 200.0f, unit(mt) * 40.0f - 10.0f);
+		float limit = (i % 32 == 31 ? 0.0f : 1.0f + 9.0f * unit(mt));
+		if (i % 2 == 0) {
+			spheres.emplace_back(SphereLight{ .POSITION = position, .LIMIT = limit });
+		} else {
+			glm::vec3 direction = glm::normalize(glm::vec3(unit(mt), unit(mt), unit(mt)) - 0.5f);
+			float outer = 0.2f + 0.8f * unit(mt);
+			spots.emplace_back(SpotLight{ .POSITION = position, .DIRECTION = direction, .LIMIT = limit, .CONE_ANGLES = glm::vec4(0.8f * outer, outer, 0.0f, 0.0f) });
+		}
+	}
+}
+
+//the lists again, one cluster and one light at a time (same tests as light_clusters.comp):
+static std::vector< uint32_t > brute_force(LightBinning const &binning, LightBinning::View const &view) {
+	std::vector< uint32_t > lists(binning.lists.size(), 0);
+	LightBinning::Lights const &lights = binning.lights;
+	auto slice_depth = [&](uint32_t k) { return std::exp((float(k) - view.cluster_z.y) / view.cluster_z.x); };
+	for (uint32_t k = 0; k < binning.count_z; ++k) {
+		for (uint32_t y = 0; y < binning.count_y; ++y) {
+			for (uint32_t x = 0; x < binning.count_x; ++x) {
+				float near = (k == 0 ? 0.0f : slice_depth(k));
+				float far = (k + 1 >= binning.count_z ? 1.0e15f : slice_depth(k + 1));
+				glm::vec2 count_xy = glm::vec2(binning.count_x, binning.count_y);
+				glm::vec2 a = (glm::vec2(x, y) / count_xy * 2.0f - 1.0f) * view.tan_half_fov;
+				glm::vec2 b = (glm::vec2(x + 1, y + 1) / count_xy * 2.0f - 1.0f) * view.tan_half_fov;
+				glm::vec2 per_lo = glm::min(a, b), per_hi = glm::max(a, b);
+				glm::vec3 lo(glm::min(per_lo * near, per_lo * far), -far);
+				glm::vec3 hi(glm::max(per_hi * near, per_hi * far), -near);
+				glm::vec3 center = 0.5f * (lo + hi);
+				float radius = glm::length(hi - center);
+
+				auto reaches_box = [&](glm::vec4 const &light, glm::vec3 &position) {
+					position = glm::vec3(view.view_from_world * glm::vec4(glm::vec3(light), 1.0f));
+					if (light.w == 0.0f) return true;
+					glm::vec3 d = glm::max(glm::max(lo - position, position - hi), glm::vec3(0.0f));
+					return !(light.w * light.w < d.x * d.x + d.y * d.y + d.z * d.z);
+				};
+
+				uint32_t *list = &lists[((size_t(k) * binning.count_y + y) * binning.count_x + x) * binning.stride];
+				uint32_t sphere_count = 0, spot_count = 0;
+				for (uint32_t i = 0; i < lights.spheres.size() && sphere_count + 1 < binning.stride; ++i) {
+					glm::vec3 position;
+					if (reaches_box(lights.spheres[i], position)) list[1 + sphere_count++] = i;
+				}
+				for (uint32_t i = 0; i < lights.spots.size() && sphere_count + spot_count + 1 < binning.stride; ++i) {
+					glm::vec3 position;
+					if (!reaches_box(lights.spots[i], position)) continue;
+					glm::vec3 axis = glm::normalize(glm::mat3(view.view_from_world) * glm::vec3(lights.spot_cones[i]));
+					float angle = lights.spot_cones[i].w;
+					glm::vec3 v = center - position;
+					float along = v.x * axis.x + v.y * axis.y + v.z * axis.z;
+					if (along < -radius) continue;
+					if (angle < 1.5707963f) {
+						float across = std::sqrt(std::max(v.x * v.x + v.y * v.y + v.z * v.z - along * along, 0.0f));
+						if (radius < std::cos(angle) * across - std::sin(angle) * along) continue;
+					}
+					list[1 + sphere_count + spot_count++] = i;
+				}
+				list[0] = sphere_count | (spot_count << 16);
+			}
+		}
+	}
+	return lists;
+}
+
+//best-of-'repeats' wall time in milliseconds:
+static double time_ms(uint32_t repeats, std::function< void() > const &fn) {
+	double best = 1e30;
+	for (uint32_t r = 0; r < repeats; ++r) {
+		auto before = std::chrono::high_resolution_clock::now();
+		fn();
+		auto after = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration< double, std::milli >(after - before).count());
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	uint32_t repeats = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 10);
+	LightBinning binning;
+	if (argc > 4) {
+		binning.count_x = uint32_t(std::stoul(argv[2]));
+		binning.count_y = uint32_t(std::stoul(argv[3]));
+		binning.count_z = uint32_t(std::stoul(argv[4]));
+	}
+
+	//the renderer's free camera projection, at 16:9:
+	float near = 0.1f, far = 1000.0f;
+	glm::mat4x4 view_from_world = glm::make_mat4(look_at(0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f).data());
+	glm::mat4x4 clip_from_view = glm::make_mat4(perspective(60.0f * float(M_PI) / 180.0f, 16.0f / 9.0f, near, far).data());
+	LightBinning::View view = LightBinning::make_view(view_from_world, clip_from_view, LightBinning::depth_slicing(near, far, binning.count_z));
+
+	ThreadPool pool;
+	std::cout << "Grid " << binning.count_x << " x " << binning.count_y << " x " << binning.count_z
+	          << ", " << binning.stride << " uints per list, " << (pool.size() + 1) << " threads" << std::endl;
+
+	std::vector< SphereLight > spheres;
+	std::vector< SpotLight > spots;
+	for (uint32_t count = 1024; count <= 65536; count *= 2) {
+		make_lights(count, spheres, spots);
+
+		double single = time_ms(repeats, [&]() { binning.bin(spheres, spots, view); });
+		if (count == 1024 && binning.lists != brute_force(binning, view)) {
+			std::cerr << "Binned lists differ from the brute force lists." << std::endl;
+			return 1;
+		}
+		double pooled = time_ms(repeats, [&]() { binning.bin(spheres, spots, view, &pool); });
+
+		uint64_t total = 0;
+		uint32_t full = 0;
+		for (size_t c = 0; c < binning.lists.size(); c += binning.stride) {
+			uint32_t listed = (binning.lists[c] & 0xffff) + (binning.lists[c] >> 16);
+			total += listed;
+			if (listed + 1 >= binning.stride) full += 1;
+		}
+		uint32_t clusters = binning.count_x * binning.count_y * binning.count_z;
+		std::cout << "  " << count << " lights: " << pooled << " ms (" << single << " ms on one thread), "
+		          << double(total) / clusters << " lights per cluster, " << full << " clusters full" << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+//Compares the stream (sejp::load) and zero-copy (sejp::load_mapped) parsers on a synthetic s72 scene.
+//  usage: bin/sejp_bench [node count, default 100000] [repeats, default 5]
+
+#include "../sejp.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+
+//writes an s72-v2 file with one root node whose children are 'count' nodes, each with a mesh, a transform, and every 16th with a driver:
+static void write_scene(std::string const &filename, uint32_t count) {
+	std::ofstream out(filename, std::ios::binary);
+	out << "[\"s72-v2\",\n";
+	out << "{\"type\":\"SCENE\",\"name\":\"bench\",\"roots\":[\"root\"]},\n";
+	out << "{\"type\":\"NODE\",\"name\":\"root\",\"children\":[";
+	for (uint32_t i = 0; i < count; ++i) {
+		out << (i ? "," : "") << "\"node" << i << "\"";
+	}
+	out << "]},\n";
+	out << "{\"type\":\"MESH\",\"name\":\"mesh\",\"topology\":\"TRIANGLE_LIST\",\"count\":36,\"attributes\":{"
+	    << "\"POSITION\":{\"src\":\"mesh.b72\",\"offset\":0,\"stride\":48,\"format\":\"R32G32B32_SFLOAT\"},"
+	    << "\"NORMAL\":{\"src\":\"mesh.b72\",\"offset\":12,\"stride\":48,\"format\":\"R32G32B32_SFLOAT\"},"
+	    << "\"TANGENT\":{\"src\":\"mesh.b72\",\"offset\":24,\"stride\":48,\"format\":\"R32G32B32A32_SFLOAT\"},"
+	    << "\"TEXCOORD\":{\"src\":\"mesh.b72\",\"offset\":40,\"stride\":48,\"format\":\"R32G32_SFLOAT\"}}}";
+	for (uint32_t i = 0; i < count; ++i) {
+		float f = float(i) * 0.001f;
+		out << ",\n{\"type\":\"NODE\",\"name\":\"node" << i << "\","
+		    << "\"translation\":[" << f << "," << -f << "," << f * 2.0f << "],"
+		    << "\"rotation\":[0,0,0,1],"
+		    << "\"scale\":[1,1,1],"
+		    << "\"mesh\":\"mesh\"}";
+		if (i % 16 == 0) {
+			out << ",\n{\"type\":\"DRIVER\",\"name\":\"driver" << i << "\",\"node\":\"node" << i << "\",\"channel\":\"translation\","
+			    << "\"times\":[0,0.5,1,1.5],\"values\":[0,0,0,1,0,0,1,1,0,0,1,1],\"interpolation\":\"LINEAR\"}";
+		}
+	}
+	out << "\n]\n";
+}
+
+//touches every object's type, name and translation, the way Scene::load does:
+static double walk_legacy(sejp::value const &root) {
+	double sum = 0.0;
+	std::vector< sejp::value > const &objects = root.as_array().value();
+	for (size_t i = 1; i < objects.size(); ++i) {
+		auto const &object = objects[i].as_object().value();
+		sum += double(object.find("type")->second.as_string()->size());
+		sum += double(object.find("name")->second.as_string()->size());
+		if (auto t = object.find("translation"); t != object.end()) {
+			for (sejp::value const &v : t->second.as_array().value()) sum += v.as_number().value();
+		}
+	}
+	return sum;
+}
+
+static double walk_view(sejp::value const &root) {
+	double sum = 0.0;
+	for (size_t i = 1; i < root.size(); ++i) {
+		sejp::value object = root[i];
+		sum += double(object.find("type")->as_string_view()->size());
+		sum += double(object.find("name")->as_string_view()->size());
+		if (auto t = object.find("translation")) {
+			for (size_t j = 0; j < t->size(); ++j) sum += (*t)[j].as_number().value();
+		}
+	}
+	return sum;
+}
+
+//best-of-'repeats' wall time in milliseconds:
+static double time_ms(uint32_t repeats, std::function< void() > const &fn) {
+	double best = 1e30;
+	for (uint32_t r = 0; r < repeats; ++r) {
+		auto before = std::chrono::high_resolution_clock::now();
+		fn();
+		auto after = std::chrono::high_resolution_clock::now();
+		best = std::min(best, std::chrono::duration< double, std::milli >(after - before).count());
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	uint32_t count = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 100000);
+	uint32_t repeats = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 5);
+
+	std::string filename = "sejp_bench_scene.s72";
+	write_scene(filename, count);
+	std::cout << "Synthetic scene: " << count << " nodes, " << filename << std::endl;
+
+	double check_a = 0.0, check_b = 0.0, check_c = 0.0;
+	double stream_parse = time_ms(repeats, [&]() { sejp::load(filename); });
+	double stream_walk = time_ms(repeats, [&]() { check_a = walk_legacy(sejp::load(filename)); });
+	double mapped_parse = time_ms(repeats, [&]() { sejp::load_mapped(filename); });
+	double mapped_legacy_walk = time_ms(repeats, [&]() { check_b = walk_legacy(sejp::load_mapped(filename)); });
+	double mapped_view_walk = time_ms(repeats, [&]() { check_c = walk_view(sejp::load_mapped(filename)); });
+
+	if (check_a != check_b || check_a != check_c) {
+		std::cerr << "Parsers disagree: " << check_a << " vs " << check_b << " vs " << check_c << std::endl;
+		return 1;
+	}
+
+	std::cout << "  sejp::load                          " << stream_parse << " ms\n";
+	std::cout << "  sejp::load + as_object walk         " << stream_walk << " ms\n";
+	std::cout << "  sejp::load_mapped                   " << mapped_parse << " ms\n";
+	std::cout << "  sejp::load_mapped + as_object walk  " << mapped_legacy_walk << " ms\n";
+	std::cout << "  sejp::load_mapped + find walk       " << mapped_view_walk << " ms\n";
+
+	std::remove(filename.c_str());
+	return 0;
+}
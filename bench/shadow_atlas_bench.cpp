@@ -0,0 +1,98 @@
+//Times RTGRenderer::ShadowAtlas::update_regions on random spot lights as the camera flies through them,
+// for 64 to 4096 lights. Reports the atlas utilisation and how many regions move per frame (a moved region
+// has to redraw its shadow). Every frame of the smaller cases is checked for overlapping regions.
+//  usage: bin/shadow_atlas_bench [frames, default 600] [sun cascades placed alongside (sized by fit_cascades from 1024 texels), default 0]
+
+#include "../RTGRenderer.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+using SpotLight = RTGRenderer::LambertianPipeline::SpotLight;
+
+//lights in a 400 x 400 x 40 box around the origin, requesting 256 to 2048 texel shadows; every 32nd is unlimited:
+static void make_lights(uint32_t count, std::vector< SpotLight > &spot_lights, std::vector< Scene::LightInstance > &sorted_indices) {
+	std::mt19937 mt(0x1234);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+	spot_lights.clear();
+	sorted_indices.clear();
+	for (uint32_t i = 0; i < count; ++i) {
+		SpotLight light{};
+		light.POSITION = glm::vec3(unit(mt) * 400.0f - 200.0f, unit(mt) * 400.0f - 200.0f, unit(mt) * 40.0f - 10.0f);
+		light.LIMIT = (i % 32 == 31 ? 0.0f : 5.0f + 15.0f * unit(mt));
+		light.shadow_size = 256u << (mt() % 4);
+		spot_lights.emplace_back(light);
+		sorted_indices.emplace_back(Scene::LightInstance{ .spot_lights_index = i, .lights_index = i });
+	}
+}
+
+static bool overlapping(std::vector< RTGRenderer::ShadowAtlas::Region > const &regions, uint32_t size) {
+	for (size_t a = 0; a < regions.size(); ++a) {
+		auto const &ra = regions[a];
+		if (ra.size == 0) continue;
+		if (ra.x + ra.size > size || ra.y + ra.size > size) return true;
+		for (size_t b = a + 1; b < regions.size(); ++b) {
+			auto const &rb = regions[b];
+			if (rb.size == 0) continue;
+			if (ra.x < rb.x + rb.size && rb.x < ra.x + ra.size && ra.y < rb.y + rb.size && rb.y < ra.y + ra.size) return true;
+		}
+	}
+	return false;
+}
+
+int main(int argc, char **argv) {
+	uint32_t frames = (argc > 1 ? uint32_t(std::stoul(argv[1])) : 600);
+	uint32_t cascades = (argc > 2 ? uint32_t(std::stoul(argv[2])) : 0);
+
+	//the renderer's free camera at 1080p (60 degree vertical field of view):
+	float pixels_per_unit = 0.5f * 1080.0f / std::tan(0.5f * 60.0f * float(M_PI) / 180.0f);
+
+	std::vector< SpotLight > spot_lights;
+	std::vector< Scene::LightInstance > sorted_indices;
+	for (uint32_t count = 64; count <= 4096; count *= 4) {
+		make_lights(count, spot_lights, sorted_indices);
+		RTGRenderer::ShadowAtlas atlas(RTGRenderer::shadow_atlas_length);
+		uint64_t cascade_texels = atlas.texel_budget / RTGRenderer::ShadowAtlas::CascadeShare;
+		std::vector< uint32_t > cascade_sizes = atlas.fit_cascades(1024, cascades, cascade_texels);
+
+		double total_ms = 0.0, worst_ms = 0.0, utilisation = 0.0;
+		uint64_t moved = 0;
+		for (uint32_t frame = 0; frame < frames; ++frame) {
+			//a slow circle through the lights:
+			float t = float(frame) / float(frames) * 2.0f * float(M_PI);
+			glm::vec3 eye(150.0f * std::cos(t), 150.0f * std::sin(t), 5.0f);
+
+			std::vector< RTGRenderer::ShadowAtlas::Region > before = atlas.regions;
+			auto start = std::chrono::high_resolution_clock::now();
+			atlas.update_regions(spot_lights, sorted_indices, cascade_sizes, eye, pixels_per_unit);
+			auto end = std::chrono::high_resolution_clock::now();
+			double ms = std::chrono::duration< double, std::milli >(end - start).count();
+			total_ms += ms;
+			worst_ms = std::max(worst_ms, ms);
+			utilisation += atlas.utilisation();
+
+			if (frame != 0) {
+				for (size_t i = 0; i < before.size(); ++i) {
+					auto const &a = before[i], &b = atlas.regions[i];
+					if (b.size != 0 && a.serial != b.serial) moved += 1; //(a new serial: the square was reassigned)
+				}
+			}
+			std::vector< RTGRenderer::ShadowAtlas::Region > all = atlas.regions;
+			all.insert(all.end(), atlas.cascade_regions.begin(), atlas.cascade_regions.end());
+			if (count <= 256 && overlapping(all, atlas.size)) {
+				std::cerr << "Regions overlap at frame " << frame << " with " << count << " lights." << std::endl;
+				return 1;
+			}
+		}
+
+		std::cout << "  " << count << " lights: " << total_ms / frames << " ms per frame (worst " << worst_ms << " ms), "
+		          << 100.0 * utilisation / frames << "% of the atlas used, "
+		          << double(moved) / (frames > 1 ? frames - 1 : 1) << " regions moved per frame, "
+		          << atlas.dropped << " lights without a region at the end" << std::endl;
+	}
+
+	return 0;
+}
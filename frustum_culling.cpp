@@ -1,4 +1,5 @@
 #include "frustum_culling.hpp"
+#include "simd.hpp"
 #include <iostream>
 
 
@@ -156,3 +157,213 @@ bool check_frustum_obb_intersection(const std::array<glm::vec3, 8>& frustum_vert
     // If no separating axis is found, the OBB and frustum intersect
     return true;
 }
+
+FrustumPlanes make_frustum_planes(const std::array<glm::vec3, 8>& v)
+{
+    // faces as three of their corners: near, far, top, bottom, right, left
+    static const int faces[6][3] = { {0, 1, 2}, {4, 5, 6}, {0, 1, 4}, {2, 3, 6}, {0, 2, 4}, {1, 3, 5} };
+    glm::vec3 centroid = glm::vec3(0.0f);
+    for (const glm::vec3& p : v) centroid += p;
+    centroid *= 1.0f / 8.0f;
+
+    FrustumPlanes frustum;
+    for (const auto& face : faces) {
+        glm::vec3 n = glm::cross(v[face[1]] - v[face[0]], v[face[2]] - v[face[0]]);
+        float len = glm::length(n);
+        if (!(len > 0.0f)) continue;
+        n /= len;
+        if (glm::dot(n, centroid - v[face[0]]) < 0.0f) n = -n;
+        frustum.planes[frustum.count++] = glm::vec4(n, -glm::dot(n, v[face[0]]));
+    }
+    return frustum;
+}
+
+Containment classify_aabb(const FrustumPlanes& frustum, const AABB& aabb)
+{
+    glm::vec3 center = 0.5f * (aabb.max + aabb.min);
+    glm::vec3 half = 0.5f * (aabb.max - aabb.min);
+    Containment result = Containment::Inside;
+    for (uint32_t i = 0; i < frustum.count; ++i) {
+        glm::vec3 n = glm::vec3(frustum.planes[i]);
+        float dist = glm::dot(n, center) + frustum.planes[i].w;
+        float radius = glm::dot(glm::abs(n), half);
+        if (dist + radius < 0.0f) return Containment::Outside;
+        if (dist - radius < 0.0f) result = Containment::Intersecting;
+    }
+    return result;
+}
+
+AABB OBB_to_AABB(const OBB& obb)
+{
+    glm::vec3 half = obb.extents.x * glm::abs(obb.axes[0]) + obb.extents.y * glm::abs(obb.axes[1]) + obb.extents.z * glm::abs(obb.axes[2]);
+    return AABB{ .min = obb.center - half, .max = obb.center + half };
+}
+
+void OBBBatch::clear()
+{
+    for (int c = 0; c < 3; ++c) {
+        center[c].clear();
+        extents[c].clear();
+        for (int a = 0; a < 3; ++a) axes[a][c].clear();
+    }
+    radius.clear();
+}
+
+void OBBBatch::push_back(const OBB& obb)
+{
+    for (int c = 0; c < 3; ++c) {
+        center[c].push_back(obb.center[c]);
+        extents[c].push_back(obb.extents[c]);
+        for (int a = 0; a < 3; ++a) axes[a][c].push_back(obb.axes[a][c]);
+    }
+    radius.push_back(glm::length(obb.extents));
+}
+
+namespace {
+
+// Everything about one frustum that cull_obbs needs, computed once per call instead of once per box
+struct FrustumSAT
+{
+    std::array<glm::vec3, 8> vertices;
+    std::array<glm::vec3, 6> edges; // the distinct edge directions (frustum_edges 0,1,2,4,6,7 above)
+    std::array<glm::vec3, 5> normals; // face normals, as in check_frustum_obb_intersection
+    std::array<float, 5> normal_min, normal_max; // frustum projected onto each face normal
+    FrustumPlanes planes; // for the sphere pre-reject
+};
+
+FrustumSAT make_frustum_sat(const std::array<glm::vec3, 8>& v)
+{
+    FrustumSAT f;
+    f.vertices = v;
+    glm::vec3 e0 = v[4] - v[0], e1 = v[2] - v[0], e2 = v[1] - v[0];
+    glm::vec3 e3 = v[2] - v[3], e4 = v[1] - v[3], e5 = v[7] - v[3];
+    f.edges = { e0, e1, e2, e4, v[5] - v[1], v[6] - v[2] };
+    f.normals = {
+        glm::cross(e1, e0),
+        glm::cross(e0, e2),
+        glm::cross(e2, e1),
+        glm::cross(e5, e3),
+        glm::cross(e4, e5)
+    };
+    // projections don't need unit axes as long as both shapes use the same one
+    for (int i = 0; i < 5; ++i) {
+        f.normal_min[i] = f.normal_max[i] = glm::dot(v[0], f.normals[i]);
+        for (int k = 1; k < 8; ++k) {
+            float proj = glm::dot(v[k], f.normals[i]);
+            f.normal_min[i] = std::min(f.normal_min[i], proj);
+            f.normal_max[i] = std::max(f.normal_max[i], proj);
+        }
+    }
+    f.planes = make_frustum_planes(v);
+    return f;
+}
+
+template<typename F>
+struct Vec3Pack
+{
+    F x, y, z;
+    static Vec3Pack set(const glm::vec3& v) { return { F::set(v.x), F::set(v.y), F::set(v.z) }; }
+};
+
+template<typename F>
+F dot(const Vec3Pack<F>& a, const Vec3Pack<F>& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+template<typename F>
+Vec3Pack<F> cross(const Vec3Pack<F>& a, const Vec3Pack<F>& b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+// Returns a bitmask of the boxes [first, first + F::Width) that are separated from the frustum
+// NOTE: a NaN projection (zero-length axis) compares false everywhere, so it never separates, like the scalar test
+template<typename F>
+uint32_t separated_lanes(const FrustumSAT& f, const OBBBatch& b, size_t first)
+{
+    constexpr uint32_t all = (1u << F::Width) - 1u;
+    uint32_t separated = 0;
+
+    Vec3Pack<F> c = { F::load(&b.center[0][first]), F::load(&b.center[1][first]), F::load(&b.center[2][first]) };
+
+    // bounding sphere entirely outside one of the frustum planes
+    F neg_radius = F::set(0.0f) - F::load(&b.radius[first]);
+    for (uint32_t p = 0; p < f.planes.count; ++p) {
+        const glm::vec4& plane = f.planes.planes[p];
+        F dist = dot(c, Vec3Pack<F>::set(glm::vec3(plane))) + F::set(plane.w);
+        separated |= less_mask(dist, neg_radius);
+    }
+    if (separated == all) return all;
+
+    F e[3] = { F::load(&b.extents[0][first]), F::load(&b.extents[1][first]), F::load(&b.extents[2][first]) };
+    Vec3Pack<F> a[3];
+    for (int i = 0; i < 3; ++i) {
+        a[i] = { F::load(&b.axes[i][0][first]), F::load(&b.axes[i][1][first]), F::load(&b.axes[i][2][first]) };
+    }
+
+    // box projection is center +/- sum of |extent * axis . L| (exact for the 8 corners)
+    auto test_axis = [&](const Vec3Pack<F>& L, F frustum_min, F frustum_max) {
+        F center = dot(c, L);
+        F half = e[0] * abs(dot(a[0], L)) + e[1] * abs(dot(a[1], L)) + e[2] * abs(dot(a[2], L));
+        separated |= less_mask(center + half, frustum_min) | less_mask(frustum_max, center - half);
+    };
+    auto test_axis_per_box = [&](const Vec3Pack<F>& L) {
+        F proj = dot(Vec3Pack<F>::set(f.vertices[0]), L);
+        F frustum_min = proj, frustum_max = proj;
+        for (int k = 1; k < 8; ++k) {
+            proj = dot(Vec3Pack<F>::set(f.vertices[k]), L);
+            frustum_min = min(frustum_min, proj);
+            frustum_max = max(frustum_max, proj);
+        }
+        test_axis(L, frustum_min, frustum_max);
+    };
+
+    // frustum face normals (frustum side precomputed)
+    for (int i = 0; i < 5; ++i) {
+        test_axis(Vec3Pack<F>::set(f.normals[i]), F::set(f.normal_min[i]), F::set(f.normal_max[i]));
+    }
+    if (separated == all) return all;
+
+    // box axes
+    for (int i = 0; i < 3; ++i) test_axis_per_box(a[i]);
+    if (separated == all) return all;
+
+    // cross products of box axes and frustum edges
+    for (int i = 0; i < 3; ++i) {
+        for (const glm::vec3& edge : f.edges) {
+            test_axis_per_box(cross(a[i], Vec3Pack<F>::set(edge)));
+        }
+        if (separated == all) return all;
+    }
+    return separated;
+}
+
+// Culls whole packs of F::Width boxes from index i onwards; returns the index of the first box left over
+// NOTE: packs never straddle a 64-bit word of visible because every width divides 64
+template<typename F>
+size_t cull_packs(const FrustumSAT& f, const OBBBatch& batch, size_t i, std::vector<uint64_t>& visible)
+{
+    constexpr uint32_t all = (1u << F::Width) - 1u;
+    for (; i + F::Width <= batch.size(); i += F::Width) {
+        uint32_t inside = ~separated_lanes<F>(f, batch, i) & all;
+        visible[i / 64] |= uint64_t(inside) << (i % 64);
+    }
+    return i;
+}
+
+} // namespace
+
+void cull_obbs(const std::array<glm::vec3, 8>& frustum_vertices, const OBBBatch& batch, std::vector<uint64_t>& visible)
+{
+    visible.assign((batch.size() + 63) / 64, 0);
+    if (batch.size() == 0) return;
+
+    FrustumSAT f = make_frustum_sat(frustum_vertices);
+
+    size_t i = 0;
+#ifdef RTG_AVX2
+    i = cull_packs<Pack8>(f, batch, i, visible);
+#endif
+#ifdef RTG_SSE
+    i = cull_packs<Pack4>(f, batch, i, visible);
+#endif
+    cull_packs<Pack1>(f, batch, i, visible);
+}
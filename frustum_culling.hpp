@@ -3,6 +3,8 @@
 #include "GLM.hpp"
 #include <limits>
 #include <array>
+#include <cstdint>
+#include <vector>
 // concept and code adapted from https://bruop.github.io/improved_frustum_culling/
 
 struct AABB // axis aligned bounding box
@@ -47,4 +49,42 @@ bool overlap_on_axis(const std::array<glm::vec3, 8>& frustum_vertices, const OBB
 // Far top left,
 // Far bottom right,
 // Far bottom left
-bool check_frustum_obb_intersection(const std::array<glm::vec3, 8>& frustum_vertices, const OBB& obb);
\ No newline at end of file
+bool check_frustum_obb_intersection(const std::array<glm::vec3, 8>& frustum_vertices, const OBB& obb);
+
+// Unit inward-facing planes of a frustum (xyz = normal, w = offset: dot(normal, p) + w >= 0 inside); degenerate faces are left out
+struct FrustumPlanes
+{
+    std::array<glm::vec4, 6> planes;
+    uint32_t count = 0;
+};
+
+// frustum_vertices in the same order as for check_frustum_obb_intersection
+FrustumPlanes make_frustum_planes(const std::array<glm::vec3, 8>& frustum_vertices);
+
+enum class Containment { Outside, Intersecting, Inside };
+
+// Outside only when the box is entirely behind one plane (so boxes near the frustum's corners may report Intersecting);
+// Inside when it is in front of all of them
+Containment classify_aabb(const FrustumPlanes& frustum, const AABB& aabb);
+
+// Smallest AABB containing the OBB
+AABB OBB_to_AABB(const OBB& obb);
+
+// Structure-of-arrays storage of many OBBs for cull_obbs (one array per scalar component):
+struct OBBBatch
+{
+    std::vector<float> center[3]; // [component][box]
+    std::vector<float> extents[3]; // [component][box]
+    std::vector<float> axes[3][3]; // [axis][component][box]
+    std::vector<float> radius; // bounding sphere radius, length(extents)
+
+    size_t size() const { return radius.size(); }
+    void clear();
+    void push_back(const OBB& obb);
+};
+
+// Tests every OBB in the batch against the frustum (vertices ordered as for check_frustum_obb_intersection),
+// 8 (AVX2) or 4 (SSE) boxes at a time with a scalar fallback: a bounding-sphere-vs-frustum-plane pre-reject
+// first, then the separating axis test for packs that survive it.
+// visible is resized to (batch.size() + 63) / 64 words; bit (i % 64) of word (i / 64) is set if box i intersects.
+void cull_obbs(const std::array<glm::vec3, 8>& frustum_vertices, const OBBBatch& batch, std::vector<uint64_t>& visible);
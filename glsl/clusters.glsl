@@ -0,0 +1,23 @@
+#define CLUSTERS
+
+//light cluster grid (matches RTGRenderer::LightClusterPipeline): CLUSTER_COUNT_X x CLUSTER_COUNT_Y screen tiles by
+// CLUSTER_COUNT_Z slices of view depth, exponentially spaced between the view camera's near and far planes.
+//Each cluster's list takes CLUSTER_STRIDE uints: the sphere light count (low 16 bits) and spot light count
+// (high 16 bits), then the sphere light indices, then the spot light indices. Both kinds share the
+// CLUSTER_STRIDE - 1 index slots (at most 255 lights in all, not per kind); sphere lights are listed first, so
+// once a cluster is full its remaining spot lights are the ones dropped.
+#define CLUSTER_COUNT_X 16
+#define CLUSTER_COUNT_Y 9
+#define CLUSTER_COUNT_Z 24
+#define CLUSTER_STRIDE 256
+
+//first uint of the list of the cluster holding a point at 'clip' in the view camera's clip space
+// (slice of view depth d is log(d) * cluster_z.x + cluster_z.y):
+uint cluster_base(vec4 clip, vec2 cluster_z) {
+	vec2 tile = (clip.xy / clip.w * 0.5 + 0.5) * vec2(CLUSTER_COUNT_X, CLUSTER_COUNT_Y);
+	float slice = log(max(clip.w, 1.0e-6)) * cluster_z.x + cluster_z.y;
+	uint x = uint(clamp(floor(tile.x), 0.0, float(CLUSTER_COUNT_X - 1)));
+	uint y = uint(clamp(floor(tile.y), 0.0, float(CLUSTER_COUNT_Y - 1)));
+	uint z = uint(clamp(floor(slice), 0.0, float(CLUSTER_COUNT_Z - 1)));
+	return ((z * CLUSTER_COUNT_Y + y) * CLUSTER_COUNT_X + x) * CLUSTER_STRIDE;
+}
@@ -8,12 +8,19 @@
 	#include "light.glsl"
 #endif
 
+#ifndef CLUSTERS
+	#include "clusters.glsl"
+#endif
+
 layout(set=0,binding=0,std140) uniform World {
 	vec3 CAMERA_POSITION;
 	uint ENVIRONMENT_MIPS;
 	uint SUN_LIGHT_COUNT;
 	uint SPHERE_LIGHT_COUNT;
 	uint SPOT_LIGHT_COUNT;
+	uint SHADOW_ATLAS_SIZE;
+	mat4 CLIP_FROM_WORLD;
+	vec2 CLUSTER_Z;
 };
 layout(set=0, binding=1) uniform samplerCube ENVIRONMENT;
 
@@ -31,6 +38,10 @@ layout(set=0, binding=5, std140) readonly buffer SpotLights {
 
 layout(set=0, binding=6) uniform sampler2DShadow SHADOW_ATLAS;
 
+layout(set=0, binding=7, std430) readonly buffer Clusters {
+	uint CLUSTER_LIGHTS[]; //light lists of the view's clusters (see clusters.glsl)
+};
+
 layout(set=2, binding=0) uniform sampler2D NORMAL;
 layout(set=2, binding=1) uniform sampler2D DISPLACEMENT;
 layout(set=2, binding=2) uniform sampler2D ALBEDO;
@@ -44,19 +55,25 @@ layout(location=0) out vec4 outColor;
 vec3 computeDirectLightDiffuse(vec3 worldNormal, vec3 albedo) {
     vec3 light_energy = vec3(0.0);
 
-    // Sun Lights
+    vec4 clip = CLIP_FROM_WORLD * vec4(position, 1.0); //(w is the view depth)
+
+    // Sun Lights (shadowed by their cascades)
     for (uint i = 0; i < SUN_LIGHT_COUNT; ++i) {
         SunLight light = SUNLIGHTS[i];
+        float shadowTerm = sun_shadow(light, position, clip.w, SHADOW_ATLAS);
         vec3 L = normalize(light.DIRECTION);
         float NdotL = max(dot(worldNormal, L), -light.SIN_ANGLE);
 		float factor = (NdotL + light.SIN_ANGLE) / (light.SIN_ANGLE * 2.0f);
 		bool aboveHorizon = bool(floor(factor));
-        light_energy += (float(aboveHorizon) * NdotL + float(!aboveHorizon) * (factor * light.SIN_ANGLE)) * light.ENERGY * (albedo );
+        light_energy += (float(aboveHorizon) * NdotL + float(!aboveHorizon) * (factor * light.SIN_ANGLE)) * light.ENERGY * (albedo * shadowTerm);
     }
 
-    // Sphere Lights
-    for (uint i = 0; i < SPHERE_LIGHT_COUNT; ++i) {
-        SphereLight light = SPHERELIGHTS[i];
+    // Sphere Lights (only the ones whose range reaches this fragment's light cluster)
+    uint cluster = cluster_base(clip, CLUSTER_Z);
+    uint cluster_counts = CLUSTER_LIGHTS[cluster];
+    uint cluster_sphere_count = cluster_counts & 0xffff;
+    for (uint k = 0; k < cluster_sphere_count; ++k) {
+        SphereLight light = SPHERELIGHTS[CLUSTER_LIGHTS[cluster + 1 + k]];
         vec3 L = normalize(light.POSITION - position);
         float d = length(light.POSITION - position);
 		
@@ -80,9 +97,9 @@ vec3 computeDirectLightDiffuse(vec3 worldNormal, vec3 albedo) {
 
     }
 	
-    // Spot Lights
-    for (uint i = 0; i < SPOT_LIGHT_COUNT; ++i) {
-        SpotLight light = SPOTLIGHTS[i];
+    // Spot Lights (also from the cluster's list)
+    for (uint k = 0; k < (cluster_counts >> 16); ++k) {
+        SpotLight light = SPOTLIGHTS[CLUSTER_LIGHTS[cluster + 1 + cluster_sphere_count + k]];
 
 		float shadowTerm = 1.0f;
 		//calculate shadow
@@ -10,10 +10,14 @@ layout(set=1, binding=0, std140) readonly buffer Transforms {
 	Transform TRANSFORMS[];
 };
 
+#ifdef PACKED_VERTEX
+#include "packed_vertex.glsl"
+#else
 layout(location=0) in vec3 Position;
 layout(location=1) in vec3 Normal;
 layout(location=2) in vec4 Tangent;
 layout(location=3) in vec2 TexCoord;
+#endif
 
 layout(location=0) out vec3 position;
 layout(location=1) out vec2 texCoord;
@@ -2,8 +2,12 @@
 
 struct SunLight {
 	vec3 DIRECTION;
+	uint SHADOW_SIZE;
 	vec3 ENERGY; // divided by pi 
 	float SIN_ANGLE; // sin (theta / 2)
+	vec4 CASCADE_SPLITS; // view depth where each cascade ends
+	uint CASCADE_COUNT; // 0: unshadowed
+	mat4 ATLAS_COORD_FROM_WORLD[4]; // per cascade
 };
 
 struct SphereLight {
@@ -25,4 +29,14 @@ struct SpotLight {
 	mat4 ATLAS_COORD_FROM_WORLD;
 };
 
-#define PI 3.1415926538
\ No newline at end of file
+#define PI 3.1415926538
+
+//sun light visibility at 'position' (1: lit), from the first cascade whose slice reaches past 'view_depth':
+float sun_shadow(SunLight light, vec3 position, float view_depth, sampler2DShadow atlas) {
+	for (uint c = 0; c < light.CASCADE_COUNT; ++c) {
+		if (view_depth < light.CASCADE_SPLITS[c]) {
+			return textureProj(atlas, light.ATLAS_COORD_FROM_WORLD[c] * vec4(position, 1.0));
+		}
+	}
+	return 1.0;
+}
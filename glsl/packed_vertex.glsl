@@ -0,0 +1,20 @@
+//Vertex inputs for PosNorTanTexPackedVertex (--vertex-format packed), included by the object vertex shaders
+// when compiled with PACKED_VERTEX. Position, Normal, Tangent and TexCoord read the same as the float inputs:
+//positions arrive as unorm coordinates within the mesh's box, and the box decode is already folded into
+//CLIP_FROM_LOCAL and WORLD_FROM_LOCAL (the tangent is stored pre-scaled to match).
+
+layout(location=0) in vec4 PackedPosition; //xyz: position in the mesh box, w: tangent sign (0 or 1)
+layout(location=1) in vec2 PackedNormal; //octahedral
+layout(location=2) in vec2 PackedTangent; //octahedral
+layout(location=3) in vec2 TexCoord;
+
+vec3 oct_decode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+	return normalize(n);
+}
+
+#define Position (PackedPosition.xyz)
+#define Normal (oct_decode(PackedNormal))
+#define Tangent (vec4(oct_decode(PackedTangent), PackedPosition.w * 2.0 - 1.0))
@@ -8,6 +8,10 @@
 	#include "light.glsl"
 #endif
 
+#ifndef CLUSTERS
+	#include "clusters.glsl"
+#endif
+
 layout(set=0,binding=0,std140) uniform World {
 	vec3 CAMERA_POSITION;
 	uint ENVIRONMENT_MIPS;
@@ -15,6 +19,8 @@ layout(set=0,binding=0,std140) uniform World {
 	uint SPHERE_LIGHT_COUNT;
 	uint SPOT_LIGHT_COUNT;
 	uint SHADOW_ATLAS_SIZE;
+	mat4 CLIP_FROM_WORLD;
+	vec2 CLUSTER_Z;
 };
 
 layout(set=0, binding=1) uniform samplerCube ENVIRONMENT;
@@ -34,6 +40,10 @@ layout(set=0, binding=5, std140) readonly buffer SpotLights {
 
 layout(set=0, binding=6) uniform sampler2DShadow SHADOW_ATLAS;
 
+layout(set=0, binding=7, std430) readonly buffer Clusters {
+	uint CLUSTER_LIGHTS[]; //light lists of the view's clusters (see clusters.glsl)
+};
+
 layout(set=2, binding=0) uniform sampler2D NORMAL;
 layout(set=2, binding=1) uniform sampler2D DISPLACEMENT;
 layout(set=2, binding=2) uniform sampler2D ALBEDO;
@@ -106,9 +116,12 @@ vec3 specularContribution(vec3 L, vec3 V, vec3 N, vec3 F0, float roughness)
 vec3 computeDirectLight(vec3 worldNormal, vec3 viewDir, vec3 reflectDir, vec3 albedo, float roughness, vec3 F0, float metalness) {
     vec3 light_energy = vec3(0.0);
 	
-    // Sun Lights
+    vec4 clip = CLIP_FROM_WORLD * vec4(position, 1.0); //(w is the view depth)
+
+    // Sun Lights (shadowed by their cascades)
     for (uint i = 0; i < SUN_LIGHT_COUNT; ++i) {
         SunLight light = SUNLIGHTS[i];
+        float shadowTerm = sun_shadow(light, position, clip.w, SHADOW_ATLAS);
         vec3 L = normalize(light.DIRECTION);
         float NdotL = max(dot(worldNormal, L), -light.SIN_ANGLE);
 		float factor = (NdotL + light.SIN_ANGLE) / (light.SIN_ANGLE * 2.0f);
@@ -128,12 +141,15 @@ vec3 computeDirectLight(vec3 worldNormal, vec3 viewDir, vec3 reflectDir, vec3 al
 		float alpha = roughness * roughness;
 		float alpha_prime = clamp(alpha + light.SIN_ANGLE, 0.0, 1.0);
 		specular *= (alpha * alpha / (alpha_prime * alpha_prime));
-		light_energy += diffuse + specular ;
+		light_energy += (diffuse + specular) * shadowTerm;
     }
 
-    // Sphere Lights
-    for (uint i = 0; i < SPHERE_LIGHT_COUNT; ++i) {
-        SphereLight light = SPHERELIGHTS[i];
+    // Sphere Lights (only the ones whose range reaches this fragment's light cluster)
+    uint cluster = cluster_base(clip, CLUSTER_Z);
+    uint cluster_counts = CLUSTER_LIGHTS[cluster];
+    uint cluster_sphere_count = cluster_counts & 0xffff;
+    for (uint k = 0; k < cluster_sphere_count; ++k) {
+        SphereLight light = SPHERELIGHTS[CLUSTER_LIGHTS[cluster + 1 + k]];
 		vec3 lightRelativePosition = light.POSITION - position;
         vec3 L = normalize(lightRelativePosition);
         float d = length(light.POSITION - position);
@@ -169,9 +185,9 @@ vec3 computeDirectLight(vec3 worldNormal, vec3 viewDir, vec3 reflectDir, vec3 al
 		light_energy += diffuse + specular;
     }
 	
-    // Spot Lights
-    for (uint i = 0; i < SPOT_LIGHT_COUNT; ++i) {
-        SpotLight light = SPOTLIGHTS[i];
+    // Spot Lights (also from the cluster's list)
+    for (uint k = 0; k < (cluster_counts >> 16); ++k) {
+        SpotLight light = SPOTLIGHTS[CLUSTER_LIGHTS[cluster + 1 + cluster_sphere_count + k]];
 
 		float shadowTerm = 1.0f;
 		// calculate shadow
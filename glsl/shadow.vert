@@ -14,10 +14,14 @@ layout(set=0, binding=0, std140) readonly buffer Transforms {
 	Transform TRANSFORMS[];
 };
 
+#ifdef PACKED_VERTEX
+#include "packed_vertex.glsl"
+#else
 layout(location=0) in vec3 Position;
 layout(location=1) in vec3 Normal;
 layout(location=2) in vec4 Tangent;
 layout(location=3) in vec2 TexCoord;
+#endif
 
 void main() {
 	gl_Position = LIGHT_FROM_WORLD * TRANSFORMS[gl_InstanceIndex].WORLD_FROM_LOCAL * vec4(Position, 1.0);
@@ -0,0 +1,204 @@
+#include "light_binning.hpp"
+
+#include "simd.hpp"
+
+#include <bit>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+//the widest pack the compiler targets (simd.hpp):
+#if defined(RTG_AVX2)
+using Pack = Pack8;
+#elif defined(RTG_SSE)
+using Pack = Pack4;
+#else
+using Pack = Pack1;
+#endif
+constexpr uint32_t AllLanes = (1u << Pack::Width) - 1u;
+
+//view-space lights, one array per component, padded to whole packs with lights that reach nothing:
+struct LightSoA {
+	bool cones = false; //spot lights carry the axis and angle arrays
+	std::vector< float > x, y, z, range2; //position, squared range (infinite when unlimited, negative for padding)
+	std::vector< float > axis_x, axis_y, axis_z, cos_angle, sin_angle; //(cones) direction the light shines, outer half angle
+	std::vector< uint32_t > index; //in the renderer's light array
+
+	size_t size() const { return index.size(); }
+
+	void clear() {
+		for (std::vector< float > *v : {&x, &y, &z, &range2, &axis_x, &axis_y, &axis_z, &cos_angle, &sin_angle}) v->clear();
+		index.clear();
+	}
+
+	void push(glm::vec3 position, float range2_, glm::vec3 axis, float cos_, float sin_, uint32_t index_) {
+		x.emplace_back(position.x);
+		y.emplace_back(position.y);
+		z.emplace_back(position.z);
+		range2.emplace_back(range2_);
+		if (cones) {
+			axis_x.emplace_back(axis.x);
+			axis_y.emplace_back(axis.y);
+			axis_z.emplace_back(axis.z);
+			cos_angle.emplace_back(cos_);
+			sin_angle.emplace_back(sin_);
+		}
+		index.emplace_back(index_);
+	}
+
+	void push(LightSoA const &from, size_t i) {
+		if (cones) {
+			push(glm::vec3(from.x[i], from.y[i], from.z[i]), from.range2[i], glm::vec3(from.axis_x[i], from.axis_y[i], from.axis_z[i]), from.cos_angle[i], from.sin_angle[i], from.index[i]);
+		} else {
+			push(glm::vec3(from.x[i], from.y[i], from.z[i]), from.range2[i], glm::vec3(0.0f), 0.0f, 0.0f, from.index[i]);
+		}
+	}
+
+	void pad() {
+		while (size() % Pack::Width != 0) push(glm::vec3(0.0f), -1.0f, glm::vec3(0.0f), 1.0f, 0.0f, -1U);
+	}
+};
+
+struct Box {
+	glm::vec3 lo, hi;
+};
+
+//bit per light of the pack at 'first' whose range reaches the box:
+uint32_t reach_mask(LightSoA const &lights, size_t first, Box const &box) {
+	Pack zero = Pack::set(0.0f);
+	Pack x = Pack::load(&lights.x[first]);
+	Pack y = Pack::load(&lights.y[first]);
+	Pack z = Pack::load(&lights.z[first]);
+	//distance from the position to the box, per axis:
+	Pack dx = max(max(Pack::set(box.lo.x) - x, x - Pack::set(box.hi.x)), zero);
+	Pack dy = max(max(Pack::set(box.lo.y) - y, y - Pack::set(box.hi.y)), zero);
+	Pack dz = max(max(Pack::set(box.lo.z) - z, z - Pack::set(box.hi.z)), zero);
+	Pack dist2 = dx * dx + dy * dy + dz * dz;
+	return ~less_mask(Pack::load(&lights.range2[first]), dist2) & AllLanes;
+}
+
+//bit per spot light of the pack at 'first' whose cone reaches the ball at 'center' with 'radius'
+// (after Wronski, "Cull that cone!", 2017; as cone_touches_ball in light_clusters.comp):
+uint32_t cone_mask(LightSoA const &lights, size_t first, glm::vec3 center, float radius) {
+	Pack zero = Pack::set(0.0f);
+	Pack vx = Pack::set(center.x) - Pack::load(&lights.x[first]);
+	Pack vy = Pack::set(center.y) - Pack::load(&lights.y[first]);
+	Pack vz = Pack::set(center.z) - Pack::load(&lights.z[first]);
+	Pack along = vx * Pack::load(&lights.axis_x[first]) + vy * Pack::load(&lights.axis_y[first]) + vz * Pack::load(&lights.axis_z[first]);
+	Pack across = sqrt(max(vx * vx + vy * vy + vz * vz - along * along, zero));
+	Pack r = Pack::set(radius);
+	Pack dist = Pack::load(&lights.cos_angle[first]) * across - Pack::load(&lights.sin_angle[first]) * along;
+	return ~(less_mask(along, zero - r) | less_mask(r, dist)) & AllLanes;
+}
+
+//'out' gets the lights of 'in' whose range reaches the box:
+void keep_reaching(LightSoA const &in, Box const &box, LightSoA &out) {
+	out.clear();
+	for (size_t i = 0; i < in.size(); i += Pack::Width) {
+		for (uint32_t mask = reach_mask(in, i, box); mask != 0; mask &= mask - 1) {
+			out.push(in, i + std::countr_zero(mask));
+		}
+	}
+	out.pad();
+}
+
+} //namespace
+
+glm::vec2 LightBinning::depth_slicing(float near, float far, uint32_t count_z) {
+	float slices_per_log = float(count_z) / std::log(far / near);
+	return glm::vec2(slices_per_log, -std::log(near) * slices_per_log);
+}
+
+LightBinning::View LightBinning::make_view(glm::mat4x4 const &view_from_world, glm::mat4x4 const &clip_from_view, glm::vec2 cluster_z) {
+	return View{
+		.view_from_world = view_from_world,
+		.tan_half_fov = glm::vec2(1.0f / clip_from_view[0][0], 1.0f / clip_from_view[1][1]),
+		.cluster_z = cluster_z,
+	};
+}
+
+void LightBinning::bin(View const &view, ThreadPool *pool) {
+	lists.resize(size_t(count_x) * count_y * count_z * stride);
+
+	//move the lights to view space:
+	LightSoA spheres, spots;
+	spots.cones = true;
+	auto range2 = [](float range) {
+		return (range == 0.0f ? std::numeric_limits< float >::infinity() : range * range);
+	};
+	for (uint32_t i = 0; i < lights.spheres.size(); ++i) {
+		glm::vec4 const &light = lights.spheres[i];
+		spheres.push(glm::vec3(view.view_from_world * glm::vec4(glm::vec3(light), 1.0f)), range2(light.w), glm::vec3(0.0f), 0.0f, 0.0f, i);
+	}
+	spheres.pad();
+	for (uint32_t i = 0; i < lights.spots.size(); ++i) {
+		glm::vec4 const &light = lights.spots[i];
+		glm::vec4 const &cone = lights.spot_cones[i];
+		glm::vec3 axis = glm::normalize(glm::mat3(view.view_from_world) * glm::vec3(cone));
+		//cones at least as wide as a half space reach everything in front of the light (cos 0, sin 1 tests just that):
+		bool wide = (cone.w >= 1.5707963f);
+		spots.push(glm::vec3(view.view_from_world * glm::vec4(glm::vec3(light), 1.0f)), range2(light.w), axis,
+			wide ? 0.0f : std::cos(cone.w), wide ? 1.0f : std::sin(cone.w), i);
+	}
+	spots.pad();
+
+	//view-space box of tiles [lo, hi) in slice k (the camera looks down -z; the first and last slices reach the eye and infinity):
+	auto slice_depth = [&](uint32_t k) {
+		return std::exp((float(k) - view.cluster_z.y) / view.cluster_z.x);
+	};
+	glm::vec2 count_xy = glm::vec2(count_x, count_y);
+	auto tiles_box = [&](glm::uvec2 lo, glm::uvec2 hi, uint32_t k) {
+		float near = (k == 0 ? 0.0f : slice_depth(k));
+		float far = (k + 1 >= count_z ? 1.0e15f : slice_depth(k + 1));
+		glm::vec2 a = (glm::vec2(lo) / count_xy * 2.0f - 1.0f) * view.tan_half_fov;
+		glm::vec2 b = (glm::vec2(hi) / count_xy * 2.0f - 1.0f) * view.tan_half_fov;
+		glm::vec2 per_lo = glm::min(a, b), per_hi = glm::max(a, b); //(view-space x and y at unit depth)
+		return Box{
+			.lo = glm::vec3(glm::min(per_lo * near, per_lo * far), -far),
+			.hi = glm::vec3(glm::max(per_hi * near, per_hi * far), -near),
+		};
+	};
+
+	auto bin_slice = [&](uint32_t k) {
+		LightSoA slice_spheres, slice_spots, row_spheres, row_spots;
+		slice_spots.cones = row_spots.cones = true;
+		keep_reaching(spheres, tiles_box(glm::uvec2(0, 0), glm::uvec2(count_x, count_y), k), slice_spheres);
+		keep_reaching(spots, tiles_box(glm::uvec2(0, 0), glm::uvec2(count_x, count_y), k), slice_spots);
+
+		for (uint32_t y = 0; y < count_y; ++y) {
+			keep_reaching(slice_spheres, tiles_box(glm::uvec2(0, y), glm::uvec2(count_x, y + 1), k), row_spheres);
+			keep_reaching(slice_spots, tiles_box(glm::uvec2(0, y), glm::uvec2(count_x, y + 1), k), row_spots);
+
+			for (uint32_t x = 0; x < count_x; ++x) {
+				Box box = tiles_box(glm::uvec2(x, y), glm::uvec2(x + 1, y + 1), k);
+				glm::vec3 center = 0.5f * (box.lo + box.hi);
+				float radius = glm::length(box.hi - center);
+
+				uint32_t *list = &lists[((size_t(k) * count_y + y) * count_x + x) * stride];
+				uint32_t sphere_count = 0, spot_count = 0;
+				for (size_t i = 0; i < row_spheres.size() && sphere_count + 1 < stride; i += Pack::Width) {
+					for (uint32_t mask = reach_mask(row_spheres, i, box); mask != 0 && sphere_count + 1 < stride; mask &= mask - 1) {
+						list[1 + sphere_count] = row_spheres.index[i + std::countr_zero(mask)];
+						sphere_count += 1;
+					}
+				}
+				for (size_t i = 0; i < row_spots.size() && sphere_count + spot_count + 1 < stride; i += Pack::Width) {
+					uint32_t reaching = reach_mask(row_spots, i, box);
+					if (reaching == 0) continue;
+					for (uint32_t mask = reaching & cone_mask(row_spots, i, center, radius); mask != 0 && sphere_count + spot_count + 1 < stride; mask &= mask - 1) {
+						list[1 + sphere_count + spot_count] = row_spots.index[i + std::countr_zero(mask)];
+						spot_count += 1;
+					}
+				}
+				list[0] = sphere_count | (spot_count << 16);
+			}
+		}
+	};
+
+	if (pool) {
+		pool->parallel_for(count_z, bin_slice);
+	} else {
+		for (uint32_t k = 0; k < count_z; ++k) bin_slice(k);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "GLM.hpp"
+#include "ThreadPool.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ *  CPU light binning: the same clustered light lists the GPU's light cluster pass writes (see
+ *  RTGRenderer::LightClusterPipeline and glsl/light_clusters.comp), computed on the worker threads.
+ *
+ *  The view is split into count_x x count_y screen tiles by count_z slices of view depth, exponentially spaced
+ *  (slice of view depth d is log(d) * cluster_z.x + cluster_z.y). bin() lists, per cluster, the sphere lights
+ *  whose range reaches the cluster's box and the spot lights whose range and cone reach it. Each depth slice is
+ *  one job: it keeps the lights reaching the slice, then those reaching each row of tiles, then tests those
+ *  against each cluster a pack of lights at a time (simd.hpp).
+ *  Used by --light-binning cpu and by bin/light_binning_bench.
+ */
+
+struct LightBinning {
+	//grid size (the renderer uses LightClusterPipeline's):
+	uint32_t count_x = 16, count_y = 9, count_z = 24;
+	//uints per cluster list: the sphere light count (low 16 bits) and spot light count (high 16 bits), then the
+	// sphere light indices, then the spot light indices. The two kinds share the stride - 1 index slots (a combined
+	// cap, sphere lights first), and lights past it are dropped -- the same as light_clusters.comp:
+	uint32_t stride = 256;
+
+	struct View {
+		glm::mat4x4 view_from_world;
+		glm::vec2 tan_half_fov; //view-space x and y at unit depth on the screen edge at ndc +1
+		glm::vec2 cluster_z; //slice of view depth d is log(d) * x + y
+	};
+
+	//cluster_z for 'count_z' slices between view depths 'near' and 'far':
+	static glm::vec2 depth_slicing(float near, float far, uint32_t count_z);
+	static View make_view(glm::mat4x4 const &view_from_world, glm::mat4x4 const &clip_from_view, glm::vec2 cluster_z);
+
+	//world-space lights, in the renderer's order (a range of 0 is unlimited, like the lights' LIMIT):
+	struct Lights {
+		std::vector< glm::vec4 > spheres; //xyz: position, w: range
+		std::vector< glm::vec4 > spots; //xyz: position, w: range
+		std::vector< glm::vec4 > spot_cones; //xyz: direction the light shines, w: outer half angle
+	} lights;
+
+	//count_x * count_y * count_z lists of 'stride' uints; cluster (x, y, z) starts at ((z * count_y + y) * count_x + x) * stride:
+	std::vector< uint32_t > lists;
+
+	//bin 'lights' (parallel over depth slices when given a pool; don't call from a pool job):
+	void bin(View const &view, ThreadPool *pool = nullptr);
+
+	//bin the renderer's lights (LambertianPipeline::SphereLight and SpotLight, or anything with their members):
+	template< typename SphereLight, typename SpotLight >
+	void bin(std::vector< SphereLight > const &sphere_lights, std::vector< SpotLight > const &spot_lights, View const &view, ThreadPool *pool = nullptr) {
+		lights.spheres.clear();
+		for (SphereLight const &light : sphere_lights) {
+			lights.spheres.emplace_back(light.POSITION, light.LIMIT);
+		}
+		lights.spots.clear();
+		lights.spot_cones.clear();
+		for (SpotLight const &light : spot_lights) {
+			lights.spots.emplace_back(light.POSITION, light.LIMIT);
+			//(DIRECTION points back from the light)
+			lights.spot_cones.emplace_back(-light.DIRECTION, light.CONE_ANGLES.y);
+		}
+		bin(view, pool);
+	}
+};
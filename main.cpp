@@ -40,7 +40,7 @@ int main(int argc, char **argv) {
 		}
 
 		//loads scene hiearchy
-		Scene scene(configuration.scene_path, configuration.scene_camera, configuration.animation_settings);
+		Scene scene(configuration.scene_path, configuration.scene_camera, configuration.animation_settings, configuration.scene_cache);
 
 		//loads vulkan library, creates surface, initializes helpers:
 		RTG rtg(configuration);
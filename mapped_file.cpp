@@ -0,0 +1,97 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename) {
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping.");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size_ = size_t(file_size.QuadPart);
+	file_ = file;
+	if (size_ == 0) return; //nothing to map; data() stays nullptr
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		unmap();
+		throw std::runtime_error("Failed to create file mapping for '" + filename + "'.");
+	}
+	mapping_ = mapping;
+	data_ = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (data_ == nullptr) {
+		unmap();
+		throw std::runtime_error("Failed to map view of '" + filename + "'.");
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open '" + filename + "' for mapping.");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to stat '" + filename + "'.");
+	}
+	size_ = size_t(st.st_size);
+	if (size_ == 0) { //mmap of length zero is an error, so leave data() as nullptr
+		close(fd);
+		return;
+	}
+	void *ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //the mapping keeps its own reference to the file
+	if (ptr == MAP_FAILED) {
+		size_ = 0;
+		throw std::runtime_error("Failed to mmap '" + filename + "'.");
+	}
+	data_ = reinterpret_cast< char const * >(ptr);
+	#endif
+}
+
+MappedFile::MappedFile(MappedFile &&from) {
+	*this = std::move(from);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&from) {
+	if (this == &from) return *this;
+	unmap();
+	std::swap(data_, from.data_);
+	std::swap(size_, from.size_);
+	#if defined(_WIN32)
+	std::swap(file_, from.file_);
+	std::swap(mapping_, from.mapping_);
+	#endif
+	return *this;
+}
+
+MappedFile::~MappedFile() {
+	unmap();
+}
+
+void MappedFile::unmap() {
+	#if defined(_WIN32)
+	if (data_) UnmapViewOfFile(data_);
+	if (mapping_) CloseHandle(reinterpret_cast< HANDLE >(mapping_));
+	if (file_) CloseHandle(reinterpret_cast< HANDLE >(file_));
+	file_ = nullptr;
+	mapping_ = nullptr;
+	#else
+	if (data_) munmap(const_cast< char * >(data_), size_);
+	#endif
+	data_ = nullptr;
+	size_ = 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ *  Read-only memory mapping of a whole file, unmapped when the object is destroyed.
+ *  Throws std::runtime_error if the file cannot be opened or mapped.
+ */
+
+struct MappedFile {
+	MappedFile() = default;
+	explicit MappedFile(std::string const &filename);
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+	MappedFile(MappedFile &&from);
+	MappedFile &operator=(MappedFile &&from);
+	~MappedFile();
+
+	char const *data() const { return data_; }
+	size_t size() const { return size_; }
+	std::string_view view() const { return std::string_view(data_, size_); }
+
+private:
+	char const *data_ = nullptr;
+	size_t size_ = 0;
+	#if defined(_WIN32)
+	void *file_ = nullptr;
+	void *mapping_ = nullptr;
+	#endif
+	void unmap();
+};
@@ -0,0 +1,150 @@
+#include "mesh_indexing.hpp"
+
+#include <bit>
+#include <cstring>
+
+static uint64_t hash_vertex(PosNorTanTexVertex const &vertex) {
+	uint32_t words[sizeof(PosNorTanTexVertex) / 4];
+	std::memcpy(words, &vertex, sizeof(words));
+	uint64_t hash = 0x9e3779b97f4a7c15ull;
+	for (uint32_t word : words) {
+		hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+void weld_vertices(PosNorTanTexVertex const *vertices, uint32_t count, std::vector< PosNorTanTexVertex > &unique, std::vector< uint32_t > &indices) {
+	unique.clear();
+	indices.resize(count);
+	if (count == 0) return;
+
+	//open addressing table of indices into 'unique', kept at most half full:
+	uint32_t table_size = std::bit_ceil(2 * count);
+	std::vector< uint32_t > table(table_size, -1U);
+	for (uint32_t i = 0; i < count; ++i) {
+		PosNorTanTexVertex const &vertex = vertices[i];
+		uint32_t slot = uint32_t(hash_vertex(vertex)) & (table_size - 1);
+		while (table[slot] != -1U && std::memcmp(&unique[table[slot]], &vertex, sizeof(vertex)) != 0) {
+			slot = (slot + 1) & (table_size - 1);
+		}
+		if (table[slot] == -1U) {
+			table[slot] = uint32_t(unique.size());
+			unique.emplace_back(vertex);
+		}
+		indices[i] = table[slot];
+	}
+}
+
+void optimize_vertex_cache(std::vector< uint32_t > &indices, std::vector< PosNorTanTexVertex > &vertices, uint32_t cache_size) {
+	uint32_t vertex_count = uint32_t(vertices.size());
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+	if (triangle_count == 0 || triangle_count * 3 != indices.size()) return;
+
+	//triangles around each vertex (those of vertex v are adjacency[offsets[v]] up to adjacency[offsets[v+1]]):
+	std::vector< uint32_t > offsets(vertex_count + 1, 0);
+	for (uint32_t v : indices) {
+		offsets[v + 1] += 1;
+	}
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		offsets[v + 1] += offsets[v];
+	}
+	std::vector< uint32_t > adjacency(indices.size());
+	{
+		std::vector< uint32_t > fill(offsets.begin(), offsets.end() - 1);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				adjacency[fill[indices[3 * t + c]]++] = t;
+			}
+		}
+	}
+
+	std::vector< uint32_t > live(vertex_count); //triangles not yet emitted, per vertex
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		live[v] = offsets[v + 1] - offsets[v];
+	}
+	std::vector< uint32_t > cache_time(vertex_count, 0); //when each vertex last entered the (simulated FIFO) cache
+	std::vector< uint8_t > emitted(triangle_count, 0);
+	std::vector< uint32_t > dead_end; //recently emitted vertices, to resume from when the fan runs out
+	dead_end.reserve(indices.size());
+	std::vector< uint32_t > candidates;
+	std::vector< uint32_t > out;
+	out.reserve(indices.size());
+
+	uint32_t time = cache_size + 1;
+	uint32_t cursor = 0; //every vertex before this one has all of its triangles emitted
+	uint32_t fanning = indices[0];
+	while (fanning != -1U) {
+		//emit every remaining triangle around the fanning vertex:
+		candidates.clear();
+		for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+			uint32_t t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = 1;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3 * t + c];
+				out.emplace_back(v);
+				dead_end.emplace_back(v);
+				candidates.emplace_back(v);
+				live[v] -= 1;
+				if (time - cache_time[v] > cache_size) {
+					cache_time[v] = time;
+					time += 1;
+				}
+			}
+		}
+
+		//next, fan around the oldest candidate that will still be cached once its remaining triangles are emitted:
+		uint32_t next = -1U;
+		int64_t best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) continue;
+			int64_t priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size) priority = time - cache_time[v];
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+		//dead end: resume at the most recently used vertex with triangles left, else at the next one in order:
+		while (next == -1U && !dead_end.empty()) {
+			uint32_t v = dead_end.back();
+			dead_end.pop_back();
+			if (live[v] > 0) next = v;
+		}
+		if (next == -1U) {
+			while (cursor < vertex_count && live[cursor] == 0) ++cursor;
+			if (cursor < vertex_count) next = cursor;
+		}
+		fanning = next;
+	}
+
+	//renumber the vertices in order of first use:
+	std::vector< uint32_t > remap(vertex_count, -1U);
+	std::vector< PosNorTanTexVertex > reordered;
+	reordered.reserve(vertex_count);
+	for (uint32_t &v : out) {
+		if (remap[v] == -1U) {
+			remap[v] = uint32_t(reordered.size());
+			reordered.emplace_back(vertices[v]);
+		}
+		v = remap[v];
+	}
+	vertices.swap(reordered);
+	indices.swap(out);
+}
+
+float average_cache_miss_ratio(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size) {
+	if (indices.size() < 3) return 0.0f;
+	std::vector< uint32_t > cache_time(vertex_count, 0);
+	uint32_t time = cache_size + 1;
+	uint32_t misses = 0;
+	for (uint32_t v : indices) {
+		if (time - cache_time[v] > cache_size) {
+			cache_time[v] = time;
+			time += 1;
+			misses += 1;
+		}
+	}
+	return float(misses) / float(indices.size() / 3);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "PosNorTanTexVertex.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/**
+ *  Load-time conversion of the scene's non-indexed triangle lists into indexed meshes.
+ *
+ *  weld_vertices() merges bit-identical vertices (found by hashing their bytes), so each distinct vertex is
+ *  stored, fetched and shaded once. optimize_vertex_cache() reorders the triangles with Tipsify (Sander,
+ *  Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007) so
+ *  consecutive triangles reuse vertices still in the post-transform cache, then renumbers the vertices in
+ *  order of first use so vertex fetches walk forward through memory.
+ */
+
+//'count' vertices in; the distinct vertices out (in order of first appearance) and one index into them per input vertex:
+void weld_vertices(PosNorTanTexVertex const *vertices, uint32_t count, std::vector< PosNorTanTexVertex > &unique, std::vector< uint32_t > &indices);
+
+//reorder the triangles of 'indices' (a triangle list over 'vertices') for a vertex cache of about 'cache_size' entries,
+// then reorder 'vertices' by first use (rewriting 'indices' to match):
+void optimize_vertex_cache(std::vector< uint32_t > &indices, std::vector< PosNorTanTexVertex > &vertices, uint32_t cache_size = 16);
+
+//average vertex shader invocations per triangle of 'indices' with a FIFO cache of 'cache_size' entries (1/2 to 3; lower is better):
+float average_cache_miss_ratio(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size = 16);
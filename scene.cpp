@@ -7,10 +7,10 @@
 #include <unordered_map>
 #include <algorithm>
 
-Scene::Scene(std::string filename, std::optional<std::string> camera, uint8_t animation_setting_)
+Scene::Scene(std::string filename, std::optional<std::string> camera, uint8_t animation_setting_, std::optional<std::string> cache_dir)
 :animation_setting(animation_setting_)
 {
-    load(data_path(filename), camera);
+    load(data_path(filename), camera, cache_dir);
 }
 
 Scene::~Scene()
@@ -20,13 +20,90 @@ Scene::~Scene()
     }
 }
 
-void Scene::load(std::string filename, std::optional<std::string> requested_camera)
+void Scene::load(std::string filename, std::optional<std::string> requested_camera, std::optional<std::string> cache_dir)
 {
     if (filename.substr(filename.size()-4, 4) != ".s72") {
         throw std::runtime_error("Scene " + filename + " is not a compatible format (s72 required). Last 4 char is " + filename.substr(filename.size()-4, 4));
     }
     scene_path = filename.substr(0, filename.rfind('/'));;
-    sejp::value val = sejp::load(filename);
+
+    // try the compiled scene cache first, fall back to parsing the .s72 and (re)writing the cache
+    if (!cache_dir.has_value() || !read_cache(filename, cache_dir.value())) {
+        parse_s72(filename);
+        if (cache_dir.has_value()) {
+            write_cache(filename, cache_dir.value());
+        }
+    }
+
+    std::cout<< "----Finished loading " + filename +"----"<<std::endl;
+
+    { //build the camera and light local to world transform vectors
+
+        std::vector<uint32_t> cur_transform_list;
+        int spot_light_index = 0;
+		std::function<void(uint32_t)> fill_camera_light_transform = [&](uint32_t i) {
+			const Scene::Node& cur_node = nodes[i];
+            cur_transform_list.push_back(i);
+            if (cur_node.light_index != -1) {
+                if (lights[cur_node.light_index].light_type == Light::Sun) {
+                    light_instance_count.sun_light++;
+                }
+                else if (lights[cur_node.light_index].light_type == Light::Sphere) {
+                    light_instance_count.sphere_light++;
+                }
+                else if (lights[cur_node.light_index].light_type == Light::Spot) {
+                    light_instance_count.spot_light++;
+                    // only increment shadow for spot light for now
+                    if (lights[cur_node.light_index].shadow != 0.0f) {
+                        spot_lights_sorted_indices.push_back(LightInstance{uint32_t(spot_light_index), uint32_t(cur_node.light_index), cur_transform_list});
+                        spot_light_index++;
+                    }
+                }
+            }
+			if (cur_node.cameras_index != -1) {
+                cameras[cur_node.cameras_index].local_to_world = cur_transform_list;
+                if (requested_camera.has_value() && requested_camera.value() == cameras[cur_node.cameras_index].name) {
+                    requested_camera_index = cur_node.cameras_index;
+                }
+            }
+			// look for cameras and lights in children
+			for (uint32_t child_index : cur_node.children) {
+				fill_camera_light_transform(child_index);
+			}
+			cur_transform_list.pop_back();
+		};
+
+		//traverse the scene hiearchy:
+		for (uint32_t i = 0; i < root_nodes.size(); ++i) {
+			fill_camera_light_transform(root_nodes[i]);
+		}
+
+        std::sort(spot_lights_sorted_indices.begin(), spot_lights_sorted_indices.end(), [&](LightInstance a, LightInstance b) {
+            assert(lights[a.lights_index].shadow != 0.0f && lights[b.lights_index].shadow != 0.0f);
+			return lights[a.lights_index].shadow > lights[b.lights_index].shadow;
+		});
+
+	}
+    // could not find requested camera
+    if (requested_camera.has_value() && requested_camera_index == -1) {
+        throw std::runtime_error("Did not find camera with name: " + requested_camera.value() + ", aborting...");
+    }
+    if (requested_camera_index == -1) {
+        requested_camera_index = 0;
+    }
+
+    if (cloud != nullptr && cloud->cloud_type != Cloud::CloudType::NONE) {
+        has_cloud = true;
+    }
+
+    build_hierarchy();
+
+    debug();
+}
+
+void Scene::parse_s72(std::string filename)
+{
+    sejp::value val = sejp::load_mapped(filename);
     try {
         std::vector<sejp::value > const &object = val.as_array().value();
         if (object[0].as_string() != "s72-v2") {
@@ -54,7 +131,7 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
         });
 
         for (int32_t i = 1; i < int32_t(object.size()); ++i) {
-            auto object_i = object[i].as_object().value();
+            auto const &object_i = object[i].as_object().value();
             std::optional<std::string> type = object_i.find("type")->second.as_string();
             if (!type) {
                 throw std::runtime_error("expected a type value in objects in .s72 format");
@@ -750,25 +827,24 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
                     .channel = channel,
                     .interpolation = interp,
                 };
-                std::vector<sejp::value> times = object_i.find("times")->second.as_array().value();
-                std::vector<sejp::value> values = object_i.find("values")->second.as_array().value();
+                // decode the keyframe arrays in bulk, straight into the driver
+                if (!object_i.find("times")->second.as_floats(driver.times)) {
+                    throw std::runtime_error("Driver " + driver_name + " times must be an array of numbers");
+                }
+                if (!object_i.find("values")->second.as_floats(driver.values)) {
+                    throw std::runtime_error("Driver " + driver_name + " values must be an array of numbers");
+                }
                 if (channel == Driver::Channel::Rotation) {
-                    if (times.size() * 4 != values.size()) {
-                        std::cerr<<"Value size: "<<values.size()<< "; Time Size" << times.size()<<std::endl;
+                    if (driver.times.size() * 4 != driver.values.size()) {
+                        std::cerr<<"Value size: "<<driver.values.size()<< "; Time Size" << driver.times.size()<<std::endl;
                         throw std::runtime_error("Rotation driver " + driver_name +" does not have correct number of values (4 * time)");
                     }
                 }
-                else if (times.size() * 3 != values.size()){
-                    std::cerr<<"Value size: "<<values.size()<< "; Time Size" << times.size()<<std::endl;
+                else if (driver.times.size() * 3 != driver.values.size()){
+                    std::cerr<<"Value size: "<<driver.values.size()<< "; Time Size" << driver.times.size()<<std::endl;
                     throw std::runtime_error("Translation/Scaling driver " + driver_name +" does not have correct number of values (3 * time)");
                 }
-                for (uint32_t time_i = 0; time_i < times.size(); ++time_i) {
-                    driver.times.push_back(float(times[time_i].as_number().value()));
-                }
-                for (uint32_t value_i = 0; value_i < values.size(); ++value_i) {
-                    driver.values.push_back(float(values[value_i].as_number().value()));
-                }
-                drivers.push_back(driver);
+                drivers.emplace_back(std::move(driver));
             } else {
                 std::cerr << "Unknown type: " + type.value() <<std::endl;
             }
@@ -779,69 +855,6 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
         std::cerr<<"Exception occured while trying to parse .s72 scene file\n";
         throw e;
     }
-
-    std::cout<< "----Finished loading " + filename +"----"<<std::endl;
-
-    { //build the camera and light local to world transform vectors
-
-        std::vector<uint32_t> cur_transform_list;
-        int spot_light_index = 0;
-		std::function<void(uint32_t)> fill_camera_light_transform = [&](uint32_t i) {
-			const Scene::Node& cur_node = nodes[i];
-            cur_transform_list.push_back(i);
-            if (cur_node.light_index != -1) {
-                if (lights[cur_node.light_index].light_type == Light::Sun) {
-                    light_instance_count.sun_light++;
-                }
-                else if (lights[cur_node.light_index].light_type == Light::Sphere) {
-                    light_instance_count.sphere_light++;
-                }
-                else if (lights[cur_node.light_index].light_type == Light::Spot) {
-                    light_instance_count.spot_light++;
-                    // only increment shadow for spot light for now
-                    if (lights[cur_node.light_index].shadow != 0.0f) {
-                        spot_lights_sorted_indices.push_back(LightInstance{uint32_t(spot_light_index), uint32_t(cur_node.light_index), cur_transform_list});
-                        spot_light_index++;
-                    }
-                }
-            }
-			if (cur_node.cameras_index != -1) {
-                cameras[cur_node.cameras_index].local_to_world = cur_transform_list;
-                if (requested_camera.has_value() && requested_camera.value() == cameras[cur_node.cameras_index].name) {
-                    requested_camera_index = cur_node.cameras_index;
-                }
-            }
-			// look for cameras and lights in children
-			for (uint32_t child_index : cur_node.children) {
-				fill_camera_light_transform(child_index);
-			}
-			cur_transform_list.pop_back();
-		};
-
-		//traverse the scene hiearchy:
-		for (uint32_t i = 0; i < root_nodes.size(); ++i) {
-			fill_camera_light_transform(root_nodes[i]);
-		}
-
-        std::sort(spot_lights_sorted_indices.begin(), spot_lights_sorted_indices.end(), [&](LightInstance a, LightInstance b) {
-            assert(lights[a.lights_index].shadow != 0.0f && lights[b.lights_index].shadow != 0.0f);
-			return lights[a.lights_index].shadow > lights[b.lights_index].shadow;
-		});
-
-	}
-    // could not find requested camera
-    if (requested_camera.has_value() && requested_camera_index == -1) {
-        throw std::runtime_error("Did not find camera with name: " + requested_camera.value() + ", aborting...");
-    }
-    if (requested_camera_index == -1) {
-        requested_camera_index = 0;
-    }
-
-    if (cloud != nullptr && cloud->cloud_type != Cloud::CloudType::NONE) {
-        has_cloud = true;
-    }
-
-    debug();
 }
 
 void Scene::debug() {
@@ -1042,6 +1055,7 @@ void Scene::update_drivers(float dt)
     if (animation_setting == 2) return;
     for (Scene::Driver& driver : drivers) {
         if (driver.cur_time_index == driver.times.size()) continue;
+        mark_dirty(driver.node_index); // every path below writes the driven channel
         driver.cur_time += dt;
         auto found_it = std::upper_bound(driver.times.begin()+driver.cur_time_index,driver.times.end(), driver.cur_time);
 
@@ -1234,6 +1248,94 @@ void Scene::set_driver_time(float time)
     update_drivers(0.0f);
 }
 
+void Scene::build_hierarchy()
+{
+    hierarchy = Hierarchy();
+    hierarchy.node_entries.resize(nodes.size());
+    hierarchy.node_dirty.assign(nodes.size(), 0);
+
+    // iterative depth-first walk (children pushed in reverse so they come out in order):
+    std::vector<std::pair<uint32_t, int32_t>> stack; // node index, parent entry
+    for (auto it = root_nodes.rbegin(); it != root_nodes.rend(); ++it) {
+        stack.emplace_back(*it, -1);
+    }
+    while (!stack.empty()) {
+        auto [node_index, parent] = stack.back();
+        stack.pop_back();
+        uint32_t entry = uint32_t(hierarchy.node.size());
+        hierarchy.node.push_back(node_index);
+        hierarchy.parent.push_back(parent);
+        hierarchy.node_entries[node_index].push_back(entry);
+        std::vector<uint32_t> const &children = nodes[node_index].children;
+        for (auto it = children.rbegin(); it != children.rend(); ++it) {
+            stack.emplace_back(*it, int32_t(entry));
+        }
+    }
+
+    // a subtree ends where the next entry that isn't a descendant starts; walk backwards so children are done first:
+    uint32_t count = uint32_t(hierarchy.node.size());
+    hierarchy.subtree_end.resize(count);
+    for (uint32_t entry = count; entry-- > 0; ) {
+        hierarchy.subtree_end[entry] = std::max(hierarchy.subtree_end[entry], entry + 1);
+        if (int32_t parent = hierarchy.parent[entry]; parent != -1) {
+            hierarchy.subtree_end[parent] = std::max(hierarchy.subtree_end[parent], hierarchy.subtree_end[entry]);
+        }
+    }
+
+    hierarchy.local.resize(count);
+    hierarchy.world.resize(count);
+    hierarchy.world_normal.resize(count);
+    for (uint32_t node_index = 0; node_index < nodes.size(); ++node_index) {
+        mark_dirty(node_index);
+    }
+    update_hierarchy();
+}
+
+void Scene::mark_dirty(uint32_t node_index)
+{
+    if (hierarchy.node_dirty[node_index]) return;
+    hierarchy.node_dirty[node_index] = 1;
+    hierarchy.dirty_nodes.push_back(node_index);
+}
+
+uint32_t Scene::update_hierarchy()
+{
+    hierarchy.updated.clear();
+    if (hierarchy.dirty_nodes.empty()) return 0;
+
+    // every entry of a dirty node roots a subtree that needs new world matrices:
+    std::vector<uint32_t> dirty_entries;
+    for (uint32_t node_index : hierarchy.dirty_nodes) {
+        dirty_entries.insert(dirty_entries.end(), hierarchy.node_entries[node_index].begin(), hierarchy.node_entries[node_index].end());
+    }
+    std::sort(dirty_entries.begin(), dirty_entries.end());
+
+    uint32_t recomputed = 0;
+    uint32_t done_until = 0; // entries before this were already recomputed as part of an enclosing subtree
+    for (uint32_t first : dirty_entries) {
+        if (first < done_until) continue;
+        uint32_t end = hierarchy.subtree_end[first];
+        for (uint32_t entry = first; entry < end; ++entry) {
+            uint32_t node_index = hierarchy.node[entry];
+            if (hierarchy.node_dirty[node_index]) {
+                hierarchy.local[entry] = nodes[node_index].transform.parent_from_local();
+            }
+            int32_t parent = hierarchy.parent[entry];
+            hierarchy.world[entry] = (parent == -1 ? hierarchy.local[entry] : hierarchy.world[parent] * hierarchy.local[entry]);
+            hierarchy.world_normal[entry] = glm::mat4x4(glm::inverse(glm::transpose(glm::mat3(hierarchy.world[entry]))));
+        }
+        recomputed += end - first;
+        done_until = end;
+        hierarchy.updated.emplace_back(first, end);
+    }
+
+    for (uint32_t node_index : hierarchy.dirty_nodes) {
+        hierarchy.node_dirty[node_index] = 0;
+    }
+    hierarchy.dirty_nodes.clear();
+    return recomputed;
+}
+
 glm::mat4x4 Scene::Transform::parent_from_local() const
 {
     //compute:
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <utility>
 #include <variant>
 
 /**
@@ -198,9 +199,9 @@ struct Scene
     uint32_t vertices_count = 0;
 
     std::vector<Material> materials;
-    uint32_t MatPBR_count;
-    uint32_t MatLambertian_count;
-    uint32_t MatEnvMirror_count; // both environment and mirror just need normal and displacement
+    uint32_t MatPBR_count = 0;
+    uint32_t MatLambertian_count = 0;
+    uint32_t MatEnvMirror_count = 0; // both environment and mirror just need normal and displacement
 
     Cloud *cloud = nullptr;
     bool has_cloud = false;
@@ -214,11 +215,45 @@ struct Scene
     std::vector<uint32_t> root_nodes;
     std::string scene_path;
 
-    Scene(std::string filename, std::optional<std::string> camera, uint8_t animation_setting);
+    // Flattened transform hierarchy, structure-of-arrays with one entry per path from a root to a node (a node that is
+    // the child of several parents gets several entries). Entries are in depth-first pre-order, so a parent always
+    // comes before its children and every subtree is the contiguous range [entry, subtree_end[entry]).
+    struct Hierarchy {
+        std::vector<uint32_t> node; // entry -> index into nodes
+        std::vector<int32_t> parent; // entry -> parent entry, -1 for roots
+        std::vector<uint32_t> subtree_end; // entry -> one past the last entry of its subtree
+        std::vector<glm::mat4x4> local; // parent_from_local of the entry's node
+        std::vector<glm::mat4x4> world; // world_from_local
+        std::vector<glm::mat4x4> world_normal; // inverse transpose of world's upper 3x3 (for normals)
+
+        std::vector<std::vector<uint32_t>> node_entries; // node -> its entries
+        std::vector<uint8_t> node_dirty; // node -> local transform changed since the last update_hierarchy()
+        std::vector<uint32_t> dirty_nodes; // nodes with node_dirty set
+
+        std::vector<std::pair<uint32_t, uint32_t>> updated; // [first, end) entry ranges recomputed by the last update_hierarchy()
+    } hierarchy;
+
+    // (re)builds hierarchy from nodes/root_nodes and computes every matrix
+    void build_hierarchy();
+    // flags a node whose transform was modified; its subtrees are recomputed by the next update_hierarchy()
+    void mark_dirty(uint32_t node_index);
+    // recomputes world matrices under dirty nodes only, returns the number of entries recomputed
+    uint32_t update_hierarchy();
+
+    // cache_dir: if set, compiled scenes are read from / written to this directory (see scene_cache.cpp)
+    Scene(std::string filename, std::optional<std::string> camera, uint8_t animation_setting, std::optional<std::string> cache_dir = std::nullopt);
 
     ~Scene();
 
-    void load(std::string file_path, std::optional<std::string> requested_camera);
+    void load(std::string file_path, std::optional<std::string> requested_camera, std::optional<std::string> cache_dir = std::nullopt);
+
+    // parses the .s72 json into the scene tables
+    void parse_s72(std::string file_path);
+
+    // compiled binary scene cache, keyed by the content hash and mtime of the source .s72
+    // read_cache returns false (leaving the scene untouched) if there is no valid cache entry
+    bool read_cache(std::string const &file_path, std::string const &cache_dir);
+    void write_cache(std::string const &file_path, std::string const &cache_dir) const;
 
     void debug();
 
@@ -0,0 +1,673 @@
+#include "scene.hpp"
+#include "mapped_file.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+/**
+ *  Compiled binary scene cache for .s72 files.
+ *
+ *  Layout (native endianness, every section 4-byte aligned):
+ *    CacheHeader
+ *    NodeRecord[node_count]
+ *    CameraRecord[camera_count]
+ *    MeshRecord[mesh_count]
+ *    MaterialRecord[material_count]
+ *    TextureRecord[texture_count]
+ *    LightRecord[light_count]
+ *    DriverRecord[driver_count]
+ *    uint32_t[u32_pool_count]   (node children and root nodes)
+ *    float[float_pool_count]    (driver times and values)
+ *    char[string_pool_size]     (every name and path, referenced by offset + length)
+ *
+ *  The cache file name is the hash of the source path; the header stores the size, mtime and content hash
+ *  of the source .s72, and the entry is only used if all three still match.
+ *  Only the parsed tables are stored, the camera/light transform lists are rebuilt by Scene::load.
+ */
+
+namespace {
+
+constexpr char CacheMagic[4] = {'s', '7', '2', 'c'};
+constexpr uint32_t CacheVersion = 1;
+
+struct StringRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct Range {
+    uint32_t first;
+    uint32_t count;
+};
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t source_hash;
+
+    uint32_t node_count;
+    uint32_t camera_count;
+    uint32_t mesh_count;
+    uint32_t material_count;
+    uint32_t texture_count;
+    uint32_t light_count;
+    uint32_t driver_count;
+    uint32_t u32_pool_count;
+    uint32_t float_pool_count;
+    uint32_t string_pool_size;
+
+    Range root_nodes;
+    uint32_t vertices_count;
+    uint32_t MatPBR_count;
+    uint32_t MatLambertian_count;
+    uint32_t MatEnvMirror_count;
+
+    StringRef environment_name;
+    StringRef environment_source;
+
+    uint32_t has_cloud; // 1 if the scene had a CLOUD object (even of type NONE)
+    uint32_t cloud_type;
+    StringRef cloud_name;
+    StringRef cloud_folder_path;
+};
+
+struct NodeRecord {
+    StringRef name;
+    float position[3];
+    float rotation[4];
+    float scale[3];
+    Range children;
+    int32_t cameras_index;
+    int32_t mesh_index;
+    int32_t light_index;
+    uint32_t environment;
+};
+
+struct CameraRecord {
+    StringRef name;
+    float aspect;
+    float vfov;
+    float near;
+    float far;
+};
+
+struct MeshRecord {
+    StringRef name;
+    struct {
+        StringRef source;
+        uint32_t offset;
+        uint32_t stride;
+        uint32_t format;
+    } attributes[4];
+    uint32_t topology;
+    uint32_t count;
+    uint32_t material_index;
+};
+
+struct MaterialRecord {
+    StringRef name;
+    uint32_t material_type;
+    uint32_t normal_index;
+    uint32_t displacement_index;
+    uint32_t textures_kind; // index into Material::material_textures variant
+    uint32_t texture_indices[3]; // lambertian: albedo; pbr: albedo, roughness, metalness
+};
+
+struct TextureRecord {
+    uint32_t value_kind; // index into Texture::value variant
+    float value[3];
+    StringRef src;
+    uint32_t is_2D;
+    uint32_t has_src;
+    uint32_t single_channel;
+    uint32_t format;
+};
+
+struct LightRecord {
+    StringRef name;
+    float tint[3];
+    uint32_t shadow;
+    uint32_t light_type;
+    uint32_t params_kind; // index into Light::additional_params variant
+    float params[5];
+};
+
+struct DriverRecord {
+    StringRef name;
+    uint32_t node_index;
+    uint32_t channel;
+    uint32_t interpolation;
+    Range times;
+    Range values;
+};
+
+static_assert(sizeof(CacheHeader) % 4 == 0, "cache sections must stay 4-byte aligned");
+
+//64-bit FNV-1a, used for both the cache file name and the source content check:
+uint64_t fnv1a(char const *data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= uint8_t(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+std::string cache_file_path(std::string const &file_path, std::string const &cache_dir) {
+    std::string key = std::filesystem::absolute(file_path).lexically_normal().string();
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << fnv1a(key.data(), key.size());
+    return cache_dir + "/" + name.str() + ".s72c";
+}
+
+int64_t source_mtime(std::string const &file_path) {
+    return int64_t(std::filesystem::last_write_time(file_path).time_since_epoch().count());
+}
+
+//accumulates the variable-sized pools while the tables are written:
+struct CacheWriter {
+    std::vector<uint32_t> u32_pool;
+    std::vector<float> float_pool;
+    std::string string_pool;
+
+    StringRef string(std::string const &str) {
+        StringRef ref{uint32_t(string_pool.size()), uint32_t(str.size())};
+        string_pool += str;
+        return ref;
+    }
+    Range u32s(std::vector<uint32_t> const &vals) {
+        Range range{uint32_t(u32_pool.size()), uint32_t(vals.size())};
+        u32_pool.insert(u32_pool.end(), vals.begin(), vals.end());
+        return range;
+    }
+    Range floats(std::vector<float> const &vals) {
+        Range range{uint32_t(float_pool.size()), uint32_t(vals.size())};
+        float_pool.insert(float_pool.end(), vals.begin(), vals.end());
+        return range;
+    }
+};
+
+//bounds-checked cursor over the mapped cache file:
+struct CacheReader {
+    char const *data;
+    size_t size;
+    size_t at = 0;
+
+    template< typename T >
+    bool read(std::vector< T > &out, uint32_t count) {
+        size_t bytes = size_t(count) * sizeof(T);
+        if (bytes > size - at) return false;
+        out.resize(count);
+        if (bytes) std::memcpy(out.data(), data + at, bytes);
+        at += bytes;
+        return true;
+    }
+};
+
+} //namespace
+
+void Scene::write_cache(std::string const &file_path, std::string const &cache_dir) const
+{
+    CacheHeader header{};
+    std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = CacheVersion;
+    try {
+        MappedFile source(file_path);
+        header.source_size = source.size();
+        header.source_hash = fnv1a(source.data(), source.size());
+        header.source_mtime = source_mtime(file_path);
+    } catch (std::exception &e) {
+        std::cerr << "Warning: not writing scene cache, " << e.what() << std::endl;
+        return;
+    }
+
+    CacheWriter writer;
+
+    std::vector<NodeRecord> node_records;
+    node_records.reserve(nodes.size());
+    for (Node const &node : nodes) {
+        node_records.emplace_back(NodeRecord{
+            .name = writer.string(node.name),
+            .position = {node.transform.position.x, node.transform.position.y, node.transform.position.z},
+            .rotation = {node.transform.rotation.x, node.transform.rotation.y, node.transform.rotation.z, node.transform.rotation.w},
+            .scale = {node.transform.scale.x, node.transform.scale.y, node.transform.scale.z},
+            .children = writer.u32s(node.children),
+            .cameras_index = node.cameras_index,
+            .mesh_index = node.mesh_index,
+            .light_index = node.light_index,
+            .environment = node.environment ? 1u : 0u,
+        });
+    }
+
+    std::vector<CameraRecord> camera_records;
+    camera_records.reserve(cameras.size());
+    for (Camera const &camera : cameras) {
+        camera_records.emplace_back(CameraRecord{
+            .name = writer.string(camera.name),
+            .aspect = camera.aspect,
+            .vfov = camera.vfov,
+            .near = camera.near,
+            .far = camera.far,
+        });
+    }
+
+    std::vector<MeshRecord> mesh_records;
+    mesh_records.reserve(meshes.size());
+    for (Mesh const &mesh : meshes) {
+        MeshRecord record{
+            .name = writer.string(mesh.name),
+            .topology = uint32_t(mesh.topology),
+            .count = mesh.count,
+            .material_index = mesh.material_index,
+        };
+        for (uint32_t a = 0; a < 4; ++a) {
+            record.attributes[a].source = writer.string(mesh.attributes[a].source);
+            record.attributes[a].offset = mesh.attributes[a].offset;
+            record.attributes[a].stride = mesh.attributes[a].stride;
+            record.attributes[a].format = uint32_t(mesh.attributes[a].format);
+        }
+        mesh_records.emplace_back(record);
+    }
+
+    std::vector<MaterialRecord> material_records;
+    material_records.reserve(materials.size());
+    for (Material const &material : materials) {
+        MaterialRecord record{
+            .name = writer.string(material.name),
+            .material_type = uint32_t(material.material_type),
+            .normal_index = material.normal_index,
+            .displacement_index = material.displacement_index,
+            .textures_kind = uint32_t(material.material_textures.index()),
+            .texture_indices = {0, 0, 0},
+        };
+        if (auto lambertian = std::get_if<Material::MatLambertian>(&material.material_textures)) {
+            record.texture_indices[0] = lambertian->albedo_index;
+        } else if (auto pbr = std::get_if<Material::MatPBR>(&material.material_textures)) {
+            record.texture_indices[0] = pbr->albedo_index;
+            record.texture_indices[1] = pbr->roughness_index;
+            record.texture_indices[2] = pbr->metalness_index;
+        }
+        material_records.emplace_back(record);
+    }
+
+    std::vector<TextureRecord> texture_records;
+    texture_records.reserve(textures.size());
+    for (Texture const &texture : textures) {
+        TextureRecord record{
+            .value_kind = uint32_t(texture.value.index()),
+            .value = {0.0f, 0.0f, 0.0f},
+            .src = StringRef{0, 0},
+            .is_2D = texture.is_2D ? 1u : 0u,
+            .has_src = texture.has_src ? 1u : 0u,
+            .single_channel = texture.single_channel ? 1u : 0u,
+            .format = uint32_t(texture.format),
+        };
+        if (auto f = std::get_if<float>(&texture.value)) {
+            record.value[0] = *f;
+        } else if (auto v = std::get_if<glm::vec3>(&texture.value)) {
+            record.value[0] = v->x;
+            record.value[1] = v->y;
+            record.value[2] = v->z;
+        } else {
+            record.src = writer.string(std::get<std::string>(texture.value));
+        }
+        texture_records.emplace_back(record);
+    }
+
+    std::vector<LightRecord> light_records;
+    light_records.reserve(lights.size());
+    for (Light const &light : lights) {
+        LightRecord record{
+            .name = writer.string(light.name),
+            .tint = {light.tint.x, light.tint.y, light.tint.z},
+            .shadow = light.shadow,
+            .light_type = uint32_t(light.light_type),
+            .params_kind = uint32_t(light.additional_params.index()),
+            .params = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+        };
+        if (auto sun = std::get_if<Light::ParamSun>(&light.additional_params)) {
+            record.params[0] = sun->angle;
+            record.params[1] = sun->strength;
+        } else if (auto sphere = std::get_if<Light::ParamSphere>(&light.additional_params)) {
+            record.params[0] = sphere->radius;
+            record.params[1] = sphere->power;
+            record.params[2] = sphere->limit;
+        } else if (auto spot = std::get_if<Light::ParamSpot>(&light.additional_params)) {
+            record.params[0] = spot->radius;
+            record.params[1] = spot->power;
+            record.params[2] = spot->limit;
+            record.params[3] = spot->fov;
+            record.params[4] = spot->blend;
+        }
+        light_records.emplace_back(record);
+    }
+
+    std::vector<DriverRecord> driver_records;
+    driver_records.reserve(drivers.size());
+    for (Driver const &driver : drivers) {
+        driver_records.emplace_back(DriverRecord{
+            .name = writer.string(driver.name),
+            .node_index = driver.node_index,
+            .channel = uint32_t(driver.channel),
+            .interpolation = uint32_t(driver.interpolation),
+            .times = writer.floats(driver.times),
+            .values = writer.floats(driver.values),
+        });
+    }
+
+    header.root_nodes = writer.u32s(root_nodes);
+    header.vertices_count = vertices_count;
+    header.MatPBR_count = MatPBR_count;
+    header.MatLambertian_count = MatLambertian_count;
+    header.MatEnvMirror_count = MatEnvMirror_count;
+    header.environment_name = writer.string(environment.name);
+    header.environment_source = writer.string(environment.source);
+    if (cloud != nullptr) {
+        header.has_cloud = 1;
+        header.cloud_type = uint32_t(cloud->cloud_type);
+        header.cloud_name = writer.string(cloud->name);
+        header.cloud_folder_path = writer.string(cloud->folder_path);
+    }
+
+    header.node_count = uint32_t(node_records.size());
+    header.camera_count = uint32_t(camera_records.size());
+    header.mesh_count = uint32_t(mesh_records.size());
+    header.material_count = uint32_t(material_records.size());
+    header.texture_count = uint32_t(texture_records.size());
+    header.light_count = uint32_t(light_records.size());
+    header.driver_count = uint32_t(driver_records.size());
+    header.u32_pool_count = uint32_t(writer.u32_pool.size());
+    header.float_pool_count = uint32_t(writer.float_pool.size());
+    header.string_pool_size = uint32_t(writer.string_pool.size());
+
+    std::string cache_path = cache_file_path(file_path, cache_dir);
+    std::string temp_path = cache_path + ".tmp";
+    try {
+        std::filesystem::create_directories(cache_dir);
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out) throw std::runtime_error("failed to open '" + temp_path + "' for writing");
+            auto write_array = [&out](auto const &vec) {
+                out.write(reinterpret_cast< char const * >(vec.data()), std::streamsize(vec.size() * sizeof(vec[0])));
+            };
+            out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+            write_array(node_records);
+            write_array(camera_records);
+            write_array(mesh_records);
+            write_array(material_records);
+            write_array(texture_records);
+            write_array(light_records);
+            write_array(driver_records);
+            write_array(writer.u32_pool);
+            write_array(writer.float_pool);
+            out.write(writer.string_pool.data(), std::streamsize(writer.string_pool.size()));
+            if (!out) throw std::runtime_error("failed to write '" + temp_path + "'");
+        }
+        //rename so a concurrent reader never sees a partially written cache:
+        std::filesystem::rename(temp_path, cache_path);
+    } catch (std::exception &e) {
+        std::cerr << "Warning: failed to write scene cache: " << e.what() << std::endl;
+        std::error_code ec;
+        std::filesystem::remove(temp_path, ec);
+        return;
+    }
+    std::cout << "Wrote compiled scene cache " << cache_path << std::endl;
+}
+
+bool Scene::read_cache(std::string const &file_path, std::string const &cache_dir)
+{
+    std::string cache_path = cache_file_path(file_path, cache_dir);
+    std::error_code ec;
+    if (!std::filesystem::exists(cache_path, ec)) return false;
+
+    MappedFile cache;
+    MappedFile source;
+    try {
+        cache = MappedFile(cache_path);
+        source = MappedFile(file_path);
+    } catch (std::exception &e) {
+        std::cerr << "Warning: ignoring scene cache, " << e.what() << std::endl;
+        return false;
+    }
+
+    CacheHeader header;
+    if (cache.size() < sizeof(header)) return false;
+    std::memcpy(&header, cache.data(), sizeof(header));
+    if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != CacheVersion) {
+        std::cout << "Scene cache " << cache_path << " has an unknown format, rebuilding." << std::endl;
+        return false;
+    }
+    if (header.source_size != source.size()
+     || header.source_mtime != source_mtime(file_path)
+     || header.source_hash != fnv1a(source.data(), source.size())) {
+        std::cout << "Scene cache " << cache_path << " is stale, rebuilding." << std::endl;
+        return false;
+    }
+
+    CacheReader reader{cache.data(), cache.size(), sizeof(header)};
+    std::vector<NodeRecord> node_records;
+    std::vector<CameraRecord> camera_records;
+    std::vector<MeshRecord> mesh_records;
+    std::vector<MaterialRecord> material_records;
+    std::vector<TextureRecord> texture_records;
+    std::vector<LightRecord> light_records;
+    std::vector<DriverRecord> driver_records;
+    std::vector<uint32_t> u32_pool;
+    std::vector<float> float_pool;
+    if (!reader.read(node_records, header.node_count)
+     || !reader.read(camera_records, header.camera_count)
+     || !reader.read(mesh_records, header.mesh_count)
+     || !reader.read(material_records, header.material_count)
+     || !reader.read(texture_records, header.texture_count)
+     || !reader.read(light_records, header.light_count)
+     || !reader.read(driver_records, header.driver_count)
+     || !reader.read(u32_pool, header.u32_pool_count)
+     || !reader.read(float_pool, header.float_pool_count)
+     || header.string_pool_size != cache.size() - reader.at) {
+        std::cout << "Scene cache " << cache_path << " is truncated, rebuilding." << std::endl;
+        return false;
+    }
+    std::string_view string_pool(cache.data() + reader.at, header.string_pool_size);
+
+    //every reference is validated before the scene is touched:
+    bool valid = true;
+    auto str = [&](StringRef ref) -> std::string {
+        if (size_t(ref.offset) + ref.length > string_pool.size()) { valid = false; return ""; }
+        return std::string(string_pool.substr(ref.offset, ref.length));
+    };
+    auto u32s = [&](Range range) -> std::vector<uint32_t> {
+        if (size_t(range.first) + range.count > u32_pool.size()) { valid = false; return {}; }
+        return std::vector<uint32_t>(u32_pool.begin() + range.first, u32_pool.begin() + range.first + range.count);
+    };
+    auto floats = [&](Range range) -> std::vector<float> {
+        if (size_t(range.first) + range.count > float_pool.size()) { valid = false; return {}; }
+        return std::vector<float>(float_pool.begin() + range.first, float_pool.begin() + range.first + range.count);
+    };
+
+    std::vector<Node> new_nodes;
+    new_nodes.reserve(node_records.size());
+    for (NodeRecord const &record : node_records) {
+        Node node = {
+            .name = str(record.name),
+            .children = u32s(record.children),
+            .cameras_index = record.cameras_index,
+            .mesh_index = record.mesh_index,
+            .light_index = record.light_index,
+            .environment = record.environment != 0,
+        };
+        node.transform.position = glm::vec3(record.position[0], record.position[1], record.position[2]);
+        node.transform.rotation.x = record.rotation[0];
+        node.transform.rotation.y = record.rotation[1];
+        node.transform.rotation.z = record.rotation[2];
+        node.transform.rotation.w = record.rotation[3];
+        node.transform.scale = glm::vec3(record.scale[0], record.scale[1], record.scale[2]);
+        for (uint32_t child : node.children) {
+            if (child >= node_records.size()) valid = false;
+        }
+        if (record.cameras_index >= int32_t(camera_records.size())
+         || record.mesh_index >= int32_t(mesh_records.size())
+         || record.light_index >= int32_t(light_records.size())) valid = false;
+        new_nodes.emplace_back(std::move(node));
+    }
+
+    std::vector<Camera> new_cameras;
+    new_cameras.reserve(camera_records.size());
+    for (CameraRecord const &record : camera_records) {
+        new_cameras.emplace_back(Camera{
+            .name = str(record.name),
+            .aspect = record.aspect,
+            .vfov = record.vfov,
+            .near = record.near,
+            .far = record.far,
+        });
+    }
+
+    std::vector<Mesh> new_meshes;
+    new_meshes.reserve(mesh_records.size());
+    for (MeshRecord const &record : mesh_records) {
+        Mesh mesh = {
+            .name = str(record.name),
+            .topology = VkPrimitiveTopology(record.topology),
+            .count = record.count,
+            .material_index = record.material_index,
+        };
+        for (uint32_t a = 0; a < 4; ++a) {
+            mesh.attributes[a].source = str(record.attributes[a].source);
+            mesh.attributes[a].offset = record.attributes[a].offset;
+            mesh.attributes[a].stride = record.attributes[a].stride;
+            mesh.attributes[a].format = VkFormat(record.attributes[a].format);
+        }
+        if (record.material_index >= material_records.size()) valid = false;
+        new_meshes.emplace_back(std::move(mesh));
+    }
+
+    std::vector<Material> new_materials;
+    new_materials.reserve(material_records.size());
+    for (MaterialRecord const &record : material_records) {
+        Material material = {
+            .material_type = Material::MaterialType(record.material_type),
+            .name = str(record.name),
+            .normal_index = record.normal_index,
+            .displacement_index = record.displacement_index,
+        };
+        if (record.textures_kind == 1) {
+            material.material_textures = Material::MatLambertian{.albedo_index = record.texture_indices[0]};
+        } else if (record.textures_kind == 2) {
+            material.material_textures = Material::MatPBR{
+                .albedo_index = record.texture_indices[0],
+                .roughness_index = record.texture_indices[1],
+                .metalness_index = record.texture_indices[2],
+            };
+        } else if (record.textures_kind != 0) {
+            valid = false;
+        }
+        new_materials.emplace_back(std::move(material));
+    }
+
+    std::vector<Texture> new_textures;
+    new_textures.reserve(texture_records.size());
+    for (TextureRecord const &record : texture_records) {
+        Texture texture;
+        if (record.value_kind == 0) {
+            texture.value = record.value[0];
+        } else if (record.value_kind == 1) {
+            texture.value = glm::vec3(record.value[0], record.value[1], record.value[2]);
+        } else if (record.value_kind == 2) {
+            texture.value = str(record.src);
+        } else {
+            valid = false;
+        }
+        texture.is_2D = record.is_2D != 0;
+        texture.has_src = record.has_src != 0;
+        texture.single_channel = record.single_channel != 0;
+        texture.format = Texture::Format(record.format);
+        new_textures.emplace_back(std::move(texture));
+    }
+
+    std::vector<Light> new_lights;
+    new_lights.reserve(light_records.size());
+    for (LightRecord const &record : light_records) {
+        std::variant<Light::ParamSun, Light::ParamSphere, Light::ParamSpot> params = Light::ParamSun{.angle = record.params[0], .strength = record.params[1]};
+        if (record.params_kind == 1) {
+            params = Light::ParamSphere{.radius = record.params[0], .power = record.params[1], .limit = record.params[2]};
+        } else if (record.params_kind == 2) {
+            params = Light::ParamSpot{
+                .radius = record.params[0],
+                .power = record.params[1],
+                .limit = record.params[2],
+                .fov = record.params[3],
+                .blend = record.params[4],
+            };
+        } else if (record.params_kind != 0) {
+            valid = false;
+        }
+        new_lights.emplace_back(Light{
+            .name = str(record.name),
+            .tint = glm::vec3(record.tint[0], record.tint[1], record.tint[2]),
+            .shadow = record.shadow,
+            .light_type = Light::LightType(record.light_type),
+            .additional_params = params,
+        });
+    }
+
+    std::vector<Driver> new_drivers;
+    new_drivers.reserve(driver_records.size());
+    for (DriverRecord const &record : driver_records) {
+        if (record.node_index >= node_records.size()) valid = false;
+        new_drivers.emplace_back(Driver{
+            .name = str(record.name),
+            .node_index = record.node_index,
+            .channel = Driver::Channel(record.channel),
+            .times = floats(record.times),
+            .values = floats(record.values),
+            .interpolation = Driver::InterpolationMode(record.interpolation),
+        });
+    }
+
+    std::vector<uint32_t> new_root_nodes = u32s(header.root_nodes);
+    for (uint32_t root : new_root_nodes) {
+        if (root >= node_records.size()) valid = false;
+    }
+    Environment new_environment{
+        .name = str(header.environment_name),
+        .source = str(header.environment_source),
+    };
+    Cloud *new_cloud = nullptr;
+    if (header.has_cloud) {
+        new_cloud = new Cloud();
+        new_cloud->name = str(header.cloud_name);
+        new_cloud->folder_path = str(header.cloud_folder_path);
+        new_cloud->cloud_type = Cloud::CloudType(header.cloud_type);
+    }
+
+    if (!valid) {
+        delete new_cloud;
+        std::cout << "Scene cache " << cache_path << " has out-of-range references, rebuilding." << std::endl;
+        return false;
+    }
+
+    nodes = std::move(new_nodes);
+    cameras = std::move(new_cameras);
+    meshes = std::move(new_meshes);
+    materials = std::move(new_materials);
+    textures = std::move(new_textures);
+    lights = std::move(new_lights);
+    drivers = std::move(new_drivers);
+    root_nodes = std::move(new_root_nodes);
+    environment = std::move(new_environment);
+    if (cloud) delete cloud;
+    cloud = new_cloud;
+    vertices_count = header.vertices_count;
+    MatPBR_count = header.MatPBR_count;
+    MatLambertian_count = header.MatLambertian_count;
+    MatEnvMirror_count = header.MatEnvMirror_count;
+
+    std::cout << "Loaded compiled scene cache " << cache_path << std::endl;
+    return true;
+}
@@ -1,4 +1,5 @@
 #include "sejp.hpp"
+#include "mapped_file.hpp"
 
 #include <stdexcept>
 #include <cassert>
@@ -6,15 +7,42 @@
 #include <fstream>
 #include <sstream>
 #include <charconv>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEJP_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace sejp {
 
 struct parsed {
-	std::vector< std::optional< std::string > > strings;
+	//eager storage, filled by parse(std::istream &);
+	//for flat (zero-copy) results strings/arrays/objects are instead filled lazily by the as_* accessors:
+	mutable std::vector< std::optional< std::string > > strings;
 	std::vector< std::optional< double > > numbers;
 	//(nothing to store for booleans and nulls)
-	std::vector< std::optional< std::vector< value > > > arrays;
-	std::vector< std::optional< std::map< std::string, value > > > objects;
+	mutable std::vector< std::optional< std::vector< value > > > arrays;
+	mutable std::vector< std::optional< std::map< std::string, value > > > objects;
+
+	//flat storage, filled by parse_view:
+	bool flat = false;
+	std::shared_ptr< void const > owner; //keeps the buffer string_views point into alive
+	std::vector< std::string_view > string_views;
+	std::deque< std::string > unescaped; //backing storage for strings that contained escapes
+	struct Range { uint32_t first, count; };
+	std::vector< Range > array_ranges; //ranges of array_elements
+	std::vector< uint32_t > array_elements; //value indices
+	std::vector< Range > object_ranges; //ranges of member_keys / member_values, sorted by key
+	std::vector< std::string_view > member_keys;
+	std::vector< uint32_t > member_values; //value indices
+	mutable std::mutex materialize_mutex; //guards the lazy filling above
 };
 
 enum Masks : uint32_t {
@@ -33,6 +61,52 @@ enum Types : uint32_t {
 	Empty   = 0xe0000000, //<--- used during parsing
 };
 
+//returns the first position in [at, end) that is not an ASCII digit;
+//number-heavy files (driver times/values) spend much of their parse time here, so scan 16 bytes at a time where SSE2 is available:
+static char const *skip_digits(char const *at, char const *end) {
+	#ifdef SEJP_SSE2
+	__m128i const below = _mm_set1_epi8('0' - 1);
+	__m128i const above = _mm_set1_epi8('9' + 1);
+	while (end - at >= 16) {
+		__m128i chars = _mm_loadu_si128(reinterpret_cast< __m128i const * >(at));
+		//(bytes >= 0x80 compare as negative, so they correctly count as non-digits)
+		__m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(chars, below), _mm_cmplt_epi8(chars, above));
+		uint32_t non_digit = uint32_t(~_mm_movemask_epi8(is_digit)) & 0xffffu;
+		if (non_digit) {
+			#if defined(_MSC_VER)
+			unsigned long first;
+			_BitScanForward(&first, non_digit);
+			return at + first;
+			#else
+			return at + __builtin_ctz(non_digit);
+			#endif
+		}
+		at += 16;
+	}
+	#endif
+	while (at != end && '0' <= *at && *at <= '9') ++at;
+	return at;
+}
+
+//re-encode a code point as UTF8:
+static void append_utf8(std::string &ret, uint32_t value) {
+	if (value <= 0x007f) {
+		ret += char(value);
+	} else if (value <= 0x07ff) {
+		ret += char(0xc0 | (value >> 6));
+		ret += char(0x80 | (value & 0x3f));
+	} else if (value <= 0xffff) {
+		ret += char(0xe0 | (value >> 12));
+		ret += char(0x80 | ((value >> 6) & 0x3f));
+		ret += char(0x80 | (value & 0x3f));
+	} else { assert(value <= 0x10ffff);
+		ret += char(0xf0 | (value >> 18));
+		ret += char(0x80 | ((value >> 12) & 0x3f));
+		ret += char(0x80 | ((value >> 6) & 0x3f));
+		ret += char(0x80 | (value & 0x3f));
+	}
+}
+
 value parse(std::istream &from) {
 	//helpers to read from string:
 
@@ -148,23 +222,7 @@ value parse(std::istream &from) {
 					assert(value <= 0xffff);
 					//TODO: handle surrogate pairs!
 					// (might result in value > 0xffff)
-
-					//re-encode as UTF8:
-					if (value <= 0x007f) {
-						ret += char(value);
-					} else if (value <= 0x07ff) {
-						ret += char(0xc0 | (value >> 6));
-						ret += char(0x80 | (value & 0x3f));
-					} else if (value <= 0xffff) {
-						ret += char(0xe0 | (value >> 12));
-						ret += char(0x80 | ((value >> 6) & 0x3f));
-						ret += char(0x80 | (value & 0x3f));
-					} else { assert(value <= 0x10ffff);
-						ret += char(0xf0 | (value >> 18));
-						ret += char(0x80 | ((value >> 12) & 0x3f));
-						ret += char(0x80 | ((value >> 6) & 0x3f));
-						ret += char(0x80 | (value & 0x3f));
-					}
+					append_utf8(ret, value);
 				} else {
 					throw std::runtime_error(std::string("parse error: invalid escape '\\") + c + "'.");
 				}
@@ -299,13 +357,277 @@ value parse(std::istream &from) {
 	return root;
 }
 
+//------------------------------------------
+//zero-copy parsing from a buffer:
+
+value parse_view(std::string_view text, std::shared_ptr< void const > owner) {
+	char const *at = text.data();
+	char const *end = text.data() + text.size();
+
+	auto skip_wsp = [&at, end]() {
+		while (at != end && (*at == ' ' || *at == '\t' || *at == '\n' || *at == '\r')) ++at;
+	};
+
+	auto read_char = [&at, end]() -> char {
+		if (at == end) throw std::runtime_error("parse error: unexpected EOF.");
+		return *at++;
+	};
+
+	auto read_exactly = [&at, end](std::string_view expect) {
+		if (size_t(end - at) < expect.size() || std::memcmp(at, expect.data(), expect.size()) != 0) {
+			throw std::runtime_error("parse error: expected '" + std::string(expect) + "'.");
+		}
+		at += expect.size();
+	};
+
+	std::shared_ptr< sejp::parsed > parsed = std::make_shared< sejp::parsed >();
+	parsed->flat = true;
+	parsed->owner = owner;
+
+	//'first' is the (already consumed) first character of the number:
+	auto read_number = [&at, end, &read_char](char const *first) -> double {
+		auto digits = [&at, end]() {
+			at = skip_digits(at, end);
+		};
+		char c = *first;
+		if (c == '-') c = read_char();
+		if (c == '0') {
+			//proceed to fraction
+		} else if ('1' <= c && c <= '9') {
+			digits();
+		} else {
+			throw std::runtime_error(std::string("parse error: unexpected '") + c + "' in number.");
+		}
+		if (at != end && *at == '.') {
+			++at;
+			c = read_char();
+			if (!('0' <= c && c <= '9')) throw std::runtime_error(std::string("parse error: wanted fraction digits, got '") + c + "'.");
+			digits();
+		}
+		if (at != end && (*at == 'E' || *at == 'e')) {
+			++at;
+			if (at != end && (*at == '-' || *at == '+')) ++at;
+			c = read_char();
+			if (!('0' <= c && c <= '9')) throw std::runtime_error(std::string("parse error: wanted exponent digits, got '") + c + "'.");
+			digits();
+		}
+
+		double val;
+		#ifdef __APPLE__
+		//(until clang gets its charconv right)
+		val = std::stod(std::string(first, at));
+		#else
+		std::from_chars(first, at, val);
+		#endif
+		return val;
+	};
+
+	//reads up to and including the closing '"'; only strings with escapes get copied:
+	auto read_string = [&at, end, &read_char, &parsed]() -> std::string_view {
+		char const *begin = at;
+		while (at != end && *at != '"' && *at != '\\') ++at;
+		if (at == end) throw std::runtime_error("parse error: unexpected EOF.");
+		if (*at == '"') {
+			return std::string_view(begin, size_t((at++) - begin));
+		}
+
+		//the four hex digits of a \uNNNN escape:
+		auto read_hex4 = [&read_char]() -> uint32_t {
+			uint32_t value = 0;
+			for (uint32_t i = 0; i < 4; ++i) {
+				value <<= 4;
+				char c = read_char();
+				if      ('0' <= c && c <= '9') value += (c - '0');
+				else if ('a' <= c && c <= 'f') value += (c - 'a') + 10;
+				else if ('A' <= c && c <= 'F') value += (c - 'A') + 10;
+				else throw std::runtime_error(std::string("parse error: invalid character '") + c + "' in \\uNNNN escape.");
+			}
+			return value;
+		};
+
+		std::string ret(begin, at);
+		for (char c = read_char(); c != '"'; c = read_char()) {
+			if (c == '\\') {
+				c = read_char();
+				if      (c == '\\' || c == '/' || c == '"') ret += c;
+				else if (c == 'b') ret += '\b';
+				else if (c == 'f') ret += '\f';
+				else if (c == 'n') ret += '\n';
+				else if (c == 'r') ret += '\r';
+				else if (c == 't') ret += '\t';
+				else if (c == 'u') {
+					uint32_t value = read_hex4();
+					if (0xd800 <= value && value <= 0xdbff) {
+						//a high surrogate must be followed by an escaped low surrogate; the pair encodes a code point past U+FFFF:
+						if (read_char() != '\\' || read_char() != 'u') throw std::runtime_error("parse error: unpaired high surrogate in \\uNNNN escape.");
+						uint32_t low = read_hex4();
+						if (!(0xdc00 <= low && low <= 0xdfff)) throw std::runtime_error("parse error: unpaired high surrogate in \\uNNNN escape.");
+						value = 0x10000 + ((value - 0xd800) << 10) + (low - 0xdc00);
+					} else if (0xdc00 <= value && value <= 0xdfff) {
+						throw std::runtime_error("parse error: unpaired low surrogate in \\uNNNN escape.");
+					}
+					append_utf8(ret, value);
+				} else {
+					throw std::runtime_error(std::string("parse error: invalid escape '\\") + c + "'.");
+				}
+			} else {
+				ret += c;
+			}
+		}
+		parsed->unescaped.emplace_back(std::move(ret));
+		return std::string_view(parsed->unescaped.back());
+	};
+
+	//-------------------
+	//parsing:
+	//same state machine as the stream parser, except container members are gathered on a
+	//scratch stack and copied out contiguously (objects sorted by key) when the container closes
+
+	struct Member {
+		std::string_view key; //(empty for array entries)
+		uint32_t index;
+	};
+	std::vector< Member > scratch;
+
+	struct Parent {
+		uint32_t index;
+		size_t first; //first member in scratch
+	};
+	std::vector< Parent > parents;
+
+	uint32_t root = Empty;
+
+	auto close_parent = [&]() {
+		Parent parent = parents.back();
+		parents.pop_back();
+		auto members_begin = scratch.begin() + parent.first;
+		if ((parent.index & TypeBits) == Array) {
+			parsed->array_ranges[parent.index & IndexBits] = parsed::Range{ uint32_t(parsed->array_elements.size()), uint32_t(scratch.size() - parent.first) };
+			for (auto m = members_begin; m != scratch.end(); ++m) {
+				parsed->array_elements.emplace_back(m->index);
+			}
+		} else {
+			std::stable_sort(members_begin, scratch.end(), [](Member const &a, Member const &b) { return a.key < b.key; });
+			uint32_t first = uint32_t(parsed->member_keys.size());
+			for (auto m = members_begin; m != scratch.end(); ++m) {
+				//duplicate keys: last one wins (matches insert_or_assign in the stream parser)
+				if (parsed->member_keys.size() > first && parsed->member_keys.back() == m->key) {
+					parsed->member_values.back() = m->index;
+					continue;
+				}
+				parsed->member_keys.emplace_back(m->key);
+				parsed->member_values.emplace_back(m->index);
+			}
+			parsed->object_ranges[parent.index & IndexBits] = parsed::Range{ first, uint32_t(parsed->member_keys.size()) - first };
+		}
+		scratch.erase(members_begin, scratch.end());
+	};
+
+	while (root == Empty || !parents.empty()) {
+		skip_wsp();
+		char c = read_char(); //first character of value
+
+		std::string_view key;
+		if (!parents.empty()) {
+			Parent const &parent = parents.back();
+			bool first_member = (scratch.size() == parent.first);
+			if ((parent.index & TypeBits) == Object) {
+				if (c == '}') {
+					close_parent();
+					continue;
+				}
+				if (!first_member) {
+					if (c != ',') throw std::runtime_error("parse error: expected ',' between object members.");
+					skip_wsp();
+					c = read_char();
+				}
+				if (c != '"') throw std::runtime_error("parse error: expecting '\"' at start of key.");
+				key = read_string();
+				skip_wsp();
+				c = read_char();
+				if (c != ':') throw std::runtime_error("parse error: expecting ':' after value.");
+				skip_wsp();
+				c = read_char(); //actual first character of value
+			} else {
+				if (c == ']') {
+					close_parent();
+					continue;
+				}
+				if (!first_member) {
+					if (c != ',') throw std::runtime_error(std::string("parse error: expected ',' between array entries; got '") + c + "'.");
+					skip_wsp();
+					c = read_char(); //actual first character of value
+				}
+			}
+		}
+
+		uint32_t index;
+		bool opens = false;
+		if        (c == '{') { //object
+			if (uint32_t(parsed->object_ranges.size()) & ~IndexBits) throw std::runtime_error("parser error: too many objects.");
+			index = Object | uint32_t(parsed->object_ranges.size());
+			parsed->object_ranges.emplace_back();
+			opens = true;
+		} else if (c == '[') { //array
+			if (uint32_t(parsed->array_ranges.size()) & ~IndexBits) throw std::runtime_error("parser error: too many arrays.");
+			index = Array | uint32_t(parsed->array_ranges.size());
+			parsed->array_ranges.emplace_back();
+			opens = true;
+		} else if (c == '"') { //string
+			if (uint32_t(parsed->string_views.size()) & ~IndexBits) throw std::runtime_error("parser error: too many strings.");
+			index = String | uint32_t(parsed->string_views.size());
+			parsed->string_views.emplace_back(read_string());
+		} else if (c == '-' || (c >= '0' && c <= '9')) { //number
+			if (uint32_t(parsed->numbers.size()) & ~IndexBits) throw std::runtime_error("parser error: too many numbers.");
+			index = Number | uint32_t(parsed->numbers.size());
+			parsed->numbers.emplace_back(read_number(at - 1));
+		} else if (c == 't') { //true
+			read_exactly("rue");
+			index = True;
+		} else if (c == 'f') { //false
+			read_exactly("alse");
+			index = False;
+		} else if (c == 'n') { //null
+			read_exactly("ull");
+			index = Null;
+		} else {
+			throw std::runtime_error(std::string("parse error: value cannot start with '") + c + "'.");
+		}
+
+		if (parents.empty()) {
+			root = index;
+		} else {
+			scratch.emplace_back(Member{key, index});
+		}
+		if (opens) {
+			parents.emplace_back(Parent{index, scratch.size()});
+		}
+	}
+
+	skip_wsp();
+
+	if (at != end) throw std::runtime_error("parse error: trailing junk.");
+
+	//slots for the lazily-built containers used by the as_string / as_array / as_object interface:
+	parsed->strings.resize(parsed->string_views.size());
+	parsed->arrays.resize(parsed->array_ranges.size());
+	parsed->objects.resize(parsed->object_ranges.size());
+
+	return value(parsed, root);
+}
+
 //------------------------------------------
 
 
 std::optional< std::string > const &value::as_string() const {
 	static std::optional< std::string > const empty;
 	if ((index & TypeBits) == String) {
-		return data->strings[index & IndexBits];
+		std::optional< std::string > &ret = data->strings[index & IndexBits];
+		if (data->flat) {
+			std::lock_guard< std::mutex > lock(data->materialize_mutex);
+			if (!ret) ret.emplace(data->string_views[index & IndexBits]);
+		}
+		return ret;
 	} else {
 		return empty;
 	}
@@ -346,7 +668,19 @@ std::optional< nullptr_t > const &value::as_null() const {
 std::optional< std::vector< value > > const &value::as_array() const {
 	static std::optional< std::vector< value > > const empty;
 	if ((index & TypeBits) == Array) {
-		return data->arrays[index & IndexBits];
+		std::optional< std::vector< value > > &ret = data->arrays[index & IndexBits];
+		if (data->flat) {
+			std::lock_guard< std::mutex > lock(data->materialize_mutex);
+			if (!ret) {
+				parsed::Range range = data->array_ranges[index & IndexBits];
+				ret.emplace();
+				ret->reserve(range.count);
+				for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+					ret->emplace_back(data, data->array_elements[i]);
+				}
+			}
+		}
+		return ret;
 	} else {
 		return empty;
 	}
@@ -355,12 +689,93 @@ std::optional< std::vector< value > > const &value::as_array() const {
 std::optional< std::map< std::string, value > > const &value::as_object() const {
 	static std::optional< std::map< std::string, value > > const empty;
 	if ((index & TypeBits) == Object) {
-		return data->objects[index & IndexBits];
+		std::optional< std::map< std::string, value > > &ret = data->objects[index & IndexBits];
+		if (data->flat) {
+			std::lock_guard< std::mutex > lock(data->materialize_mutex);
+			if (!ret) {
+				parsed::Range range = data->object_ranges[index & IndexBits];
+				ret.emplace();
+				for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+					//keys are already sorted, so every insert lands at the end:
+					ret->emplace_hint(ret->end(), std::string(data->member_keys[i]), value(data, data->member_values[i]));
+				}
+			}
+		}
+		return ret;
 	} else {
 		return empty;
 	}
 }
 
+std::optional< std::string_view > value::as_string_view() const {
+	if ((index & TypeBits) != String) return std::nullopt;
+	if (data->flat) return data->string_views[index & IndexBits];
+	return std::string_view(data->strings[index & IndexBits].value());
+}
+
+size_t value::size() const {
+	if ((index & TypeBits) == Array) {
+		if (data->flat) return data->array_ranges[index & IndexBits].count;
+		return data->arrays[index & IndexBits]->size();
+	} else if ((index & TypeBits) == Object) {
+		if (data->flat) return data->object_ranges[index & IndexBits].count;
+		return data->objects[index & IndexBits]->size();
+	} else {
+		return 0;
+	}
+}
+
+value value::operator[](size_t i) const {
+	if ((index & TypeBits) != Array) throw std::runtime_error("sejp: indexing a value that is not an array.");
+	if (i >= size()) throw std::runtime_error("sejp: array index " + std::to_string(i) + " out of range.");
+	if (data->flat) return value(data, data->array_elements[data->array_ranges[index & IndexBits].first + i]);
+	return (*data->arrays[index & IndexBits])[i];
+}
+
+std::optional< value > value::find(std::string_view key) const {
+	if ((index & TypeBits) != Object) return std::nullopt;
+	if (data->flat) {
+		parsed::Range range = data->object_ranges[index & IndexBits];
+		auto begin = data->member_keys.begin() + range.first;
+		auto end = begin + range.count;
+		auto found = std::lower_bound(begin, end, key);
+		if (found == end || *found != key) return std::nullopt;
+		return value(data, data->member_values[found - data->member_keys.begin()]);
+	}
+	auto const &map = data->objects[index & IndexBits].value();
+	auto found = map.find(std::string(key));
+	if (found == map.end()) return std::nullopt;
+	return found->second;
+}
+
+bool value::as_floats(std::vector< float > &out) const {
+	out.clear();
+	if ((index & TypeBits) != Array) return false;
+
+	auto decode = [this, &out](uint32_t element) {
+		if ((element & TypeBits) != Number) return false;
+		out.emplace_back(float(*data->numbers[element & IndexBits]));
+		return true;
+	};
+
+	bool ok = true;
+	if (data->flat) {
+		parsed::Range range = data->array_ranges[index & IndexBits];
+		out.reserve(range.count);
+		for (uint32_t i = range.first; ok && i < range.first + range.count; ++i) {
+			ok = decode(data->array_elements[i]);
+		}
+	} else {
+		std::vector< value > const &array = data->arrays[index & IndexBits].value();
+		out.reserve(array.size());
+		for (auto element = array.begin(); ok && element != array.end(); ++element) {
+			ok = decode(element->index);
+		}
+	}
+	if (!ok) out.clear();
+	return ok;
+}
+
 //-------------------------------
 
 value load(std::string const &filename) {
@@ -373,4 +788,9 @@ value parse(std::string const &string) {
 	return parse(in);
 }
 
+value load_mapped(std::string const &filename) {
+	std::shared_ptr< MappedFile > file = std::make_shared< MappedFile >(filename);
+	return parse_view(file->view(), file);
+}
+
 } //namespace sejp
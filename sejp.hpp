@@ -5,6 +5,7 @@
 //then provides a generic "value" handle to the root.
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 #include <optional>
@@ -29,6 +30,18 @@ namespace sejp {
 		std::optional< nullptr_t > const &as_null() const;
 		std::optional< std::vector< value > > const &as_array() const;
 		std::optional< std::map< std::string, value > > const &as_object() const;
+
+		//zero-copy interface (no allocation; works on values from either parser):
+		//  NOTE: for values from parse_view / load_mapped the as_string/as_array/as_object
+		//        containers above are built (once) on first use, so prefer these on hot paths
+		std::optional< std::string_view > as_string_view() const;
+		size_t size() const; //number of array elements or object members; 0 for other types
+		value operator[](size_t i) const; //array element i; throws if not an array or out of range
+		std::optional< value > find(std::string_view key) const; //O(log members) object lookup
+
+		//bulk decode of an array of numbers into 'out' (replacing its contents) without creating per-element values;
+		//  returns false (and leaves 'out' empty) if this is not an array or any element is not a number
+		bool as_floats(std::vector< float > &out) const;
 	};
 
 	//how you make values:
@@ -38,4 +51,10 @@ namespace sejp {
 	value load(std::string const &filename);
 	value parse(std::string const &string);
 
+	//zero-copy variants: parse straight out of a buffer (memory-mapped for load_mapped),
+	//string values are views into that buffer and objects are stored as flat sorted key arrays
+	//  NOTE: 'owner' is retained (like the parsed data) so the viewed text stays alive
+	value load_mapped(std::string const &filename);
+	value parse_view(std::string_view text, std::shared_ptr< void const > owner = nullptr);
+
 } //namespace sejp
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+//Detects which x86 SIMD instruction sets the compiler is targeting; code using them keeps a scalar fallback.
+//  RTG_SSE: SSE/SSE2 (always available on x86-64)
+//  RTG_AVX2: AVX2 (only when the compiler targets it, e.g. with -mavx2 or -march=native)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RTG_SSE
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define RTG_AVX2
+#include <immintrin.h>
+#endif
+
+//SIMD packs of floats with the handful of operations the culling and light binning kernels need; less_mask returns one bit per lane.
+//Code picks the widest pack available and finishes the remainder with Pack1.
+struct Pack1
+{
+    static constexpr uint32_t Width = 1;
+    float v;
+    static Pack1 load(const float* p) { return { *p }; }
+    static Pack1 set(float f) { return { f }; }
+    void store(float* p) const { *p = v; }
+    friend Pack1 operator+(Pack1 a, Pack1 b) { return { a.v + b.v }; }
+    friend Pack1 operator-(Pack1 a, Pack1 b) { return { a.v - b.v }; }
+    friend Pack1 operator*(Pack1 a, Pack1 b) { return { a.v * b.v }; }
+    friend Pack1 abs(Pack1 a) { return { std::abs(a.v) }; }
+    friend Pack1 min(Pack1 a, Pack1 b) { return { std::min(a.v, b.v) }; }
+    friend Pack1 max(Pack1 a, Pack1 b) { return { std::max(a.v, b.v) }; }
+    friend Pack1 sqrt(Pack1 a) { return { std::sqrt(a.v) }; }
+    friend uint32_t less_mask(Pack1 a, Pack1 b) { return a.v < b.v ? 1u : 0u; }
+};
+
+#ifdef RTG_SSE
+struct Pack4
+{
+    static constexpr uint32_t Width = 4;
+    __m128 v;
+    static Pack4 load(const float* p) { return { _mm_loadu_ps(p) }; }
+    static Pack4 set(float f) { return { _mm_set1_ps(f) }; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    friend Pack4 operator+(Pack4 a, Pack4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend Pack4 operator-(Pack4 a, Pack4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend Pack4 operator*(Pack4 a, Pack4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    friend Pack4 abs(Pack4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+    friend Pack4 min(Pack4 a, Pack4 b) { return { _mm_min_ps(a.v, b.v) }; }
+    friend Pack4 max(Pack4 a, Pack4 b) { return { _mm_max_ps(a.v, b.v) }; }
+    friend Pack4 sqrt(Pack4 a) { return { _mm_sqrt_ps(a.v) }; }
+    friend uint32_t less_mask(Pack4 a, Pack4 b) { return uint32_t(_mm_movemask_ps(_mm_cmplt_ps(a.v, b.v))); }
+};
+#endif
+
+#ifdef RTG_AVX2
+struct Pack8
+{
+    static constexpr uint32_t Width = 8;
+    __m256 v;
+    static Pack8 load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    static Pack8 set(float f) { return { _mm256_set1_ps(f) }; }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+    friend Pack8 operator+(Pack8 a, Pack8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+    friend Pack8 operator-(Pack8 a, Pack8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    friend Pack8 operator*(Pack8 a, Pack8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    friend Pack8 abs(Pack8 a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+    friend Pack8 min(Pack8 a, Pack8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+    friend Pack8 max(Pack8 a, Pack8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+    friend Pack8 sqrt(Pack8 a) { return { _mm256_sqrt_ps(a.v) }; }
+    friend uint32_t less_mask(Pack8 a, Pack8 b) { return uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ))); }
+};
+#endif